@@ -20,39 +20,194 @@
 #include "db/Configured.hxx"
 #include "db/plugins/simple/SimpleDatabasePlugin.hxx"
 #include "db/update/Service.hxx"
+#include "db/update/FilteredSongUpdate.hxx"
 #include "storage/Configured.hxx"
 #include "storage/CompositeStorage.hxx"
+#include "storage/FileInfo.hxx"
+#include "storage/plugins/LocalStorage.hxx"
+#include "fs/FileSystem.hxx"
 #include "input/Init.hxx"
+#include "event/SignalMonitor.hxx"
+#include "util/ScopeExit.hxx"
 #include "util/UriExtract.hxx"
 
 #ifdef ENABLE_ARCHIVE
 #include "archive/ArchiveList.hxx"
 #endif
 
+#include <algorithm>
+#include <csignal>
+#include <deque>
 #include <iostream>
 #include <memory>
 #include <thread>
 #include <chrono>
+#include <string_view>
+#include <vector>
 #include "event/CoarseTimerEvent.hxx"
 #include "util/BindMethod.hxx"
 
-// Channel mode shared with FilteredSongUpdate
-enum class ChannelMode {
-	STEREO,
-	MULTICHANNEL,
-	ALL
+static ChannelMode channel_mode = ChannelMode::ALL;
+static std::string music_directory;
+static AllocatedPath database_path = nullptr;
+static bool verbose = false;
+static bool update_mode = false;
+static const char *update_jobs = nullptr;
+static const char *update_enumerators = nullptr;
+static const char *update_uring_depth = nullptr;
+static bool trust_mtime = false;
+static bool deep_verify = false;
+static bool resume = false;
+static bool streaming = false;
+static const char *database_format = nullptr;
+static const char *compression = nullptr;
+static const char *compress_level = nullptr;
+static const char *compress_jobs = nullptr;
+static AllocatedPath export_path = nullptr;
+
+// Top-level directories scanned into their own databases (--shard)
+static std::vector<std::string> shards;
+static bool all_shards = false;
+static std::vector<std::string> rescan_shards;
+static unsigned shard_jobs = 4;
+
+// Add the settings of the gzip compression of a database file
+static void AddCompressParams(ConfigBlock &block) {
+	if (compression != nullptr)
+		block.AddBlockParam("compress",
+				    std::string_view{compression} == "none"
+				    ? "no" : compression);
+	if (compress_level != nullptr)
+		block.AddBlockParam("compress_level", compress_level);
+	if (compress_jobs != nullptr)
+		block.AddBlockParam("compress_threads", compress_jobs);
+}
+
+// Add the update settings; the caches are kept next to the given
+// database file
+static void AddUpdateParams(ConfigData &config, const std::string &db_path) {
+	if (update_jobs != nullptr)
+		config.AddParam(ConfigOption::UPDATE_JOBS,
+				ConfigParam(update_jobs));
+	if (update_enumerators != nullptr)
+		config.AddParam(ConfigOption::UPDATE_ENUMERATORS,
+				ConfigParam(update_enumerators));
+	if (update_uring_depth != nullptr)
+		config.AddParam(ConfigOption::UPDATE_IO_URING_DEPTH,
+				ConfigParam(update_uring_depth));
+	if (trust_mtime && !deep_verify)
+		config.AddParam(ConfigOption::UPDATE_TRUST_MTIME,
+				ConfigParam("yes"));
+	// Remember unrecognized and filtered files next to the
+	// database, so --update does not read them again;
+	// --deep-verify ignores the old list and writes a new one
+	const auto negative_cache = db_path + ".excluded";
+	config.AddParam(ConfigOption::UPDATE_NEGATIVE_CACHE,
+			ConfigParam(negative_cache.c_str()));
+	if (deep_verify)
+		config.AddParam(ConfigOption::UPDATE_NEGATIVE_CACHE_REBUILD,
+				ConfigParam("yes"));
+
+	if (streaming) {
+		// Write each directory as soon as it is complete;
+		// neither the tag cache nor the journal, which both
+		// hold the whole library, would fit in its memory
+		config.AddParam(ConfigOption::UPDATE_STREAMING,
+				ConfigParam("yes"));
+		return;
+	}
+
+	if (!deep_verify) {
+		// Remember tags by inode, so moved and hard-linked
+		// files are not read again
+		const auto tag_cache = db_path + ".tags";
+		config.AddParam(ConfigOption::UPDATE_TAG_CACHE,
+				ConfigParam(tag_cache.c_str()));
+	}
+
+	// Record the completed directories, so an interrupted scan
+	// can be continued with --resume
+	const auto journal = db_path + ".journal";
+	config.AddParam(ConfigOption::UPDATE_JOURNAL,
+			ConfigParam(journal.c_str()));
+	if (resume)
+		config.AddParam(ConfigOption::UPDATE_RESUME,
+				ConfigParam("yes"));
+}
+
+// Scans the shards, at most shard_jobs at a time; each one gets its
+// own UpdateService (and thus its own thread), which updates the
+// database mounted at the shard's directory
+class ShardUpdater {
+	Instance &instance;
+	SimpleDatabase &db;
+	CompositeStorage &storage;
+	std::deque<std::string> pending;
+	std::vector<std::unique_ptr<UpdateService>> running;
+
+public:
+	ShardUpdater(Instance &_instance, SimpleDatabase &_db,
+		     CompositeStorage &_storage,
+		     std::deque<std::string> &&_pending)
+		: instance(_instance), db(_db), storage(_storage),
+		  pending(std::move(_pending)) {}
+
+	// Start new scans in place of finished ones; returns true
+	// when all shards are done
+	bool Poll() {
+		std::erase_if(running, [](const auto &update){
+			return update->GetId() == 0;
+		});
+
+		while (!pending.empty() && running.size() < shard_jobs) {
+			const auto name = std::move(pending.front());
+			pending.pop_front();
+
+			ConfigData config;
+			AddUpdateParams(config, ShardDatabasePath(name).ToUTF8());
+
+			auto &update = running.emplace_back(std::make_unique<UpdateService>(config,
+											   instance.event_loop,
+											   db, storage,
+											   instance));
+			update->Enqueue(name, !update_mode);
+
+			if (verbose)
+				std::cerr << "\nScanning shard " << name;
+		}
+
+		return running.empty();
+	}
+
+	// Stop the running scans and drop the pending ones
+	void Cancel() noexcept {
+		pending.clear();
+		for (auto &update : running)
+			update->CancelAllAsync();
+	}
+
+	static AllocatedPath ShardDirectory() {
+		return AllocatedPath::FromUTF8Throw(database_path.ToUTF8() + ".shards");
+	}
+
+	static AllocatedPath ShardDatabasePath(std::string_view name) {
+		return ShardDirectory() /
+			AllocatedPath::FromUTF8Throw(std::string{name} + ".shard");
+	}
 };
 
 // Helper class to check update completion with a timer
 class UpdateChecker {
 	Instance &instance;
+	ShardUpdater *const shard_updater;
 	CoarseTimerEvent timer;
 	bool verbose;
 	int progress_counter = 0;
 	
 public:
-	UpdateChecker(Instance &_instance, bool _verbose)
-		: instance(_instance),
+	UpdateChecker(Instance &_instance, ShardUpdater *_shard_updater,
+		      bool _verbose)
+		: instance(_instance), shard_updater(_shard_updater),
 		  timer(instance.event_loop, BIND_THIS_METHOD(OnTimer)),
 		  verbose(_verbose) {}
 	
@@ -62,7 +217,17 @@ public:
 	
 private:
 	void OnTimer() noexcept {
-		if (instance.update->GetId() == 0) {
+		bool shards_done = true;
+		if (shard_updater != nullptr) {
+			try {
+				shards_done = shard_updater->Poll();
+			} catch (...) {
+				LogError(std::current_exception(),
+					 "Failed to start shard update");
+			}
+		}
+
+		if (instance.update->GetId() == 0 && shards_done) {
 			// Update complete, break the event loop
 			instance.event_loop.Break();
 		} else {
@@ -78,11 +243,27 @@ private:
 	}
 };
 
-static ChannelMode channel_mode = ChannelMode::ALL;
-static std::string music_directory;
-static AllocatedPath database_path = nullptr;
-static bool verbose = false;
-static bool update_mode = false;
+// Set by SIGINT and SIGTERM, which cancel the scans; their journals
+// are kept for --resume
+static bool interrupted = false;
+static ShardUpdater *running_shards = nullptr;
+
+static void HandleInterrupt(void *ctx) noexcept {
+	auto &instance = *(Instance *)ctx;
+
+	interrupted = true;
+	if (instance.update != nullptr)
+		instance.update->CancelAllAsync();
+	if (running_shards != nullptr)
+		running_shards->Cancel();
+}
+
+// Additional databases written from a single scan (--output)
+struct OutputDatabase {
+	ChannelMode mode;
+	AllocatedPath path;
+};
+static std::vector<OutputDatabase> outputs;
 
 // Global instance pointer required by other MPD components  
 // This must be defined here as we're not linking with Main.cxx
@@ -99,14 +280,66 @@ static void PrintUsage() {
 		  << "  --music-dir <path>   Music directory\n"
 		  << "  --database <path>    Database file\n"
 		  << "  --update             Update existing database (incremental scan)\n"
+		  << "  --trust-mtime        With --update, skip directories with unchanged mtime\n"
+		  << "  --deep-verify        With --update, check every file (overrides --trust-mtime\n"
+		  << "                       and the lists of excluded files and cached tags)\n"
+		  << "  --resume             Continue an interrupted scan, skipping the directories\n"
+		  << "                       it completed unless they were modified since\n"
+		  << "  --streaming          Write the database while scanning and free each\n"
+		  << "                       directory once written, to scan large libraries\n"
+		  << "                       with little memory\n"
 		  << "  --stereo             Stereo only\n"
 		  << "  --multichannel       Multichannel only\n"
 		  << "  --all                All (default)\n"
+		  << "  --output <mode>:<path>\n"
+		  << "                       Also write a stereo, multichannel or all database\n"
+		  << "                       to <path>; may be repeated to scan only once\n"
+		  << "  --shard <dir>        Scan this top-level directory into its own database\n"
+		  << "                       and merge it; may be repeated\n"
+		  << "  --shards             Make every top-level directory a shard\n"
+		  << "  --rescan-shard <dir> With --update, scan this shard again (may be\n"
+		  << "                       repeated); the other shards are only scanned if\n"
+		  << "                       they have no saved database\n"
+		  << "  --shard-jobs <n>     Number of shards scanned at once (default 4)\n"
+		  << "  --format <format>    Database file format: text (default) or binary\n"
+		  << "  --compression <c>    Compression of the database file: gzip (default),\n"
+		  << "                       zstd (not readable by MPD) or none\n"
+		  << "  --compress-level <n> Compression level, gzip 0-9 (default 6) or zstd\n"
+		  << "                       1-22 (default 3)\n"
+		  << "  --compress-jobs <n>  Number of (de)compression threads (default: one\n"
+		  << "                       per CPU)\n"
+		  << "  --export-text <path> Convert an existing database to the MPD text format\n"
+		  << "  --jobs <n>           Number of tag reader threads (default 1)\n"
+		  << "  --enumerators <n>    Number of directory reader threads (default 0)\n"
+		  << "  --io-uring <depth>   Stat files with io_uring, <depth> requests at a time\n"
 		  << "  --verbose            Verbose output\n"
 		  << "  --help               Show help\n";
 }
 
+static ChannelMode ParseChannelMode(std::string_view s) {
+	if (s == "stereo")
+		return ChannelMode::STEREO;
+	else if (s == "multichannel")
+		return ChannelMode::MULTICHANNEL;
+	else if (s == "all")
+		return ChannelMode::ALL;
+	else
+		throw FmtRuntimeError("Unknown channel mode: {}", s);
+}
+
+static OutputDatabase ParseOutput(std::string_view s) {
+	const auto colon = s.find(':');
+	if (colon == s.npos || colon + 1 == s.size())
+		throw FmtRuntimeError("Malformed --output: {}", s);
+
+	return {
+		ParseChannelMode(s.substr(0, colon)),
+		AllocatedPath::FromUTF8Throw(s.substr(colon + 1)),
+	};
+}
+
 static void ParseArgs(int argc, char *argv[]) {
+	bool explicit_mode = false;
 	for (int i = 1; i < argc; i++) {
 		std::string arg = argv[i];
 		if (arg == "--help") {
@@ -114,14 +347,78 @@ static void ParseArgs(int argc, char *argv[]) {
 			exit(0);
 		} else if (arg == "--update") {
 			update_mode = true;
+		} else if (arg == "--trust-mtime") {
+			trust_mtime = true;
+		} else if (arg == "--deep-verify") {
+			deep_verify = true;
+		} else if (arg == "--resume") {
+			resume = true;
+		} else if (arg == "--streaming") {
+			streaming = true;
 		} else if (arg == "--stereo") {
 			channel_mode = ChannelMode::STEREO;
+			explicit_mode = true;
 		} else if (arg == "--multichannel") {
 			channel_mode = ChannelMode::MULTICHANNEL;
+			explicit_mode = true;
 		} else if (arg == "--all") {
 			channel_mode = ChannelMode::ALL;
+			explicit_mode = true;
+		} else if (arg == "--output") {
+			if (++i >= argc)
+				throw std::runtime_error("--output needs arg");
+			outputs.emplace_back(ParseOutput(argv[i]));
 		} else if (arg == "--verbose") {
 			verbose = true;
+		} else if (arg == "--jobs") {
+			if (++i >= argc)
+				throw std::runtime_error("--jobs needs arg");
+			update_jobs = argv[i];
+		} else if (arg == "--enumerators") {
+			if (++i >= argc)
+				throw std::runtime_error("--enumerators needs arg");
+			update_enumerators = argv[i];
+		} else if (arg == "--io-uring") {
+			if (++i >= argc)
+				throw std::runtime_error("--io-uring needs arg");
+			update_uring_depth = argv[i];
+		} else if (arg == "--shard") {
+			if (++i >= argc)
+				throw std::runtime_error("--shard needs arg");
+			if (std::find(shards.begin(), shards.end(), argv[i]) == shards.end())
+				shards.emplace_back(argv[i]);
+		} else if (arg == "--shards") {
+			all_shards = true;
+		} else if (arg == "--rescan-shard") {
+			if (++i >= argc)
+				throw std::runtime_error("--rescan-shard needs arg");
+			rescan_shards.emplace_back(argv[i]);
+		} else if (arg == "--shard-jobs") {
+			if (++i >= argc)
+				throw std::runtime_error("--shard-jobs needs arg");
+			shard_jobs = std::stoul(argv[i]);
+			if (shard_jobs == 0)
+				throw std::runtime_error("--shard-jobs must be positive");
+		} else if (arg == "--format") {
+			if (++i >= argc)
+				throw std::runtime_error("--format needs arg");
+			database_format = argv[i];
+		} else if (arg == "--compression") {
+			if (++i >= argc)
+				throw std::runtime_error("--compression needs arg");
+			compression = argv[i];
+		} else if (arg == "--compress-level") {
+			if (++i >= argc)
+				throw std::runtime_error("--compress-level needs arg");
+			compress_level = argv[i];
+		} else if (arg == "--compress-jobs") {
+			if (++i >= argc)
+				throw std::runtime_error("--compress-jobs needs arg");
+			compress_jobs = argv[i];
+		} else if (arg == "--export-text") {
+			if (++i >= argc)
+				throw std::runtime_error("--export-text needs arg");
+			export_path = AllocatedPath::FromUTF8Throw(argv[i]);
 		} else if (arg == "--music-dir") {
 			if (++i >= argc)
 				throw std::runtime_error("--music-dir needs arg");
@@ -134,10 +431,146 @@ static void ParseArgs(int argc, char *argv[]) {
 			throw FmtRuntimeError("Unknown: {}", arg);
 		}
 	}
-	if (music_directory.empty() || database_path.IsNull())
+	if (!export_path.IsNull()) {
+		if (database_path.IsNull())
+			throw std::runtime_error("--export-text requires --database");
+	} else if (music_directory.empty() || database_path.IsNull())
 		throw std::runtime_error("--music-dir and --database required");
+
+	if (!outputs.empty()) {
+		if (explicit_mode)
+			throw std::runtime_error("--output cannot be combined with --stereo, --multichannel or --all");
+		if (database_format != nullptr &&
+		    std::string_view{database_format} == "binary")
+			throw std::runtime_error("--output requires the text format");
+
+		/* keep everything in the main database; the outputs
+		   are filtered when they are written */
+		channel_mode = ChannelMode::SPLIT;
+	}
+
+	for (const auto &name : shards)
+		if (name.empty() || name.find('/') != name.npos ||
+		    name == "." || name == "..")
+			throw FmtRuntimeError("Not a top-level directory: {}", name);
+
+	if (!rescan_shards.empty()) {
+		if (shards.empty() && !all_shards)
+			throw std::runtime_error("--rescan-shard requires --shard or --shards");
+		if (!update_mode)
+			throw std::runtime_error("--rescan-shard requires --update");
+	}
+
+	if (!shards.empty() || all_shards) {
+		if (!outputs.empty())
+			throw std::runtime_error("--output cannot be combined with shards");
+		if (database_format != nullptr &&
+		    std::string_view{database_format} == "binary")
+			throw std::runtime_error("Shards require the text format");
+	}
+
+	if (streaming) {
+		/* the tree is gone after the scan; only a complete
+		   scan can be written while scanning */
+		if (update_mode || resume || !export_path.IsNull())
+			throw std::runtime_error("--streaming cannot be combined with --update, --resume or --export-text");
+		if (!outputs.empty() || !shards.empty() || all_shards)
+			throw std::runtime_error("--streaming cannot be combined with --output or shards");
+		if (database_format != nullptr &&
+		    std::string_view{database_format} == "binary")
+			throw std::runtime_error("--streaming requires the text format");
+	}
+}
+
+// The names of all directories in the music directory
+static std::vector<std::string> ListTopLevelDirectories(Storage &storage) {
+	std::vector<std::string> names;
+
+	const auto reader = storage.OpenDirectory("");
+	const char *name;
+	while ((name = reader->Read()) != nullptr)
+		if (reader->GetInfo(true).IsDirectory())
+			names.emplace_back(name);
+
+	std::sort(names.begin(), names.end());
+	return names;
 }
 
+// Mount a database and a storage for each shard; returns the shards
+// which need to be scanned
+static std::deque<std::string> MountShards(Instance &instance,
+					  SimpleDatabase &db,
+					  CompositeStorage &storage) {
+	if (all_shards)
+		for (auto &name : ListTopLevelDirectories(storage))
+			if (std::find(shards.begin(), shards.end(), name) == shards.end())
+				shards.emplace_back(std::move(name));
+
+	std::deque<std::string> scan;
+	for (const auto &name : shards) {
+		const auto info = storage.GetInfo(name, true);
+		if (!info.IsDirectory())
+			throw FmtRuntimeError("Not a directory: {}", name);
+
+		auto path_fs = storage.MapFS(name);
+		if (path_fs.IsNull())
+			throw std::runtime_error("Shards require a local music directory");
+
+		ConfigBlock block;
+		block.AddBlockParam("path",
+				    ShardUpdater::ShardDatabasePath(name).ToUTF8().c_str());
+		AddCompressParams(block);
+		auto shard_db = SimpleDatabase::Create(instance.event_loop,
+						       instance.io_thread.GetEventLoop(),
+						       instance, block);
+		shard_db->Open();
+
+		// With --update, reuse the saved database unless this
+		// shard shall be rescanned
+		const bool exists = static_cast<SimpleDatabase &>(*shard_db).FileExists();
+		if (!exists || !update_mode ||
+		    std::find(rescan_shards.begin(), rescan_shards.end(),
+			      name) != rescan_shards.end())
+			scan.emplace_back(name);
+
+		db.MountShard(name.c_str(), std::move(shard_db), info.mtime);
+		storage.Mount(name.c_str(), CreateLocalStorage(path_fs));
+	}
+
+	for (const auto &name : rescan_shards)
+		if (std::find(shards.begin(), shards.end(), name) == shards.end())
+			throw FmtRuntimeError("Not a shard: {}", name);
+
+	return scan;
+}
+
+// Write the scanned database, the merged shards and the --output
+// databases
+static void SaveDatabases(SimpleDatabase &simple_db, bool sharded) {
+	simple_db.Save();
+
+	if (sharded) {
+		// Combine the main database and the shards
+		simple_db.ExportMerged(database_path);
+
+		if (verbose)
+			std::cerr << "Merged " << shards.size()
+				  << " shards into " << database_path.ToUTF8() << "\n";
+	}
+
+	// Write the filtered databases from the same tree
+	for (const auto &output : outputs) {
+		const FilteredSongUpdate::ChannelSaveFilter filter(output.mode);
+		simple_db.Export(output.path,
+				 SimpleDatabase::Format::TEXT,
+				 &filter);
+
+		if (verbose)
+			std::cerr << "Wrote " << output.path.ToUTF8() << "\n";
+	}
+}
+
+
 int main(int argc, char *argv[]) {
 	try {
 		ParseArgs(argc, argv);
@@ -152,12 +585,26 @@ int main(int argc, char *argv[]) {
 		
 		// Config
 		ConfigData config;
-		config.AddParam(ConfigOption::MUSIC_DIR,
-				ConfigParam(music_directory.c_str()));
+		if (!music_directory.empty())
+			config.AddParam(ConfigOption::MUSIC_DIR,
+					ConfigParam(music_directory.c_str()));
+		AddUpdateParams(config, database_path.ToUTF8());
+		
+		// With shards, the main database holds only what is not in
+		// a shard, and the merged database is written at the end
+		const bool sharded = !shards.empty() || all_shards;
+		const auto main_database_path = sharded
+			? ShardUpdater::ShardDirectory() / Path::FromFS("root.db")
+			: database_path;
+		if (sharded)
+			CreateDirectoryNoThrow(ShardUpdater::ShardDirectory());
 		
 		ConfigBlock db_block;
 		db_block.AddBlockParam("plugin", "simple");
-		db_block.AddBlockParam("path", database_path.ToUTF8().c_str());
+		db_block.AddBlockParam("path", main_database_path.ToUTF8().c_str());
+		if (database_format != nullptr)
+			db_block.AddBlockParam("format", database_format);
+		AddCompressParams(db_block);
 		config.AddBlock(ConfigBlockOption::DATABASE, std::move(db_block));
 		
 		// Initialize subsystems
@@ -171,6 +618,16 @@ int main(int argc, char *argv[]) {
 		// Create Instance - this contains event loop
 		Instance instance;
 		global_instance = &instance;
+
+		// Before starting threads, which inherit the blocked
+		// signals
+		SignalMonitorInit(instance.event_loop);
+		AtScopeExit() { SignalMonitorFinish(); };
+#ifndef _WIN32
+		SignalMonitorRegister(SIGINT, {&instance, HandleInterrupt});
+		SignalMonitorRegister(SIGTERM, {&instance, HandleInterrupt});
+#endif
+
 		instance.io_thread.Start();
 		instance.rtio_thread.Start();
 		
@@ -188,7 +645,31 @@ int main(int argc, char *argv[]) {
 		if (!simple_db)
 			throw std::runtime_error("Not simple database");
 		
-		instance.database->Open();
+		// A streaming scan replaces the database file without
+		// loading it
+		if (streaming)
+			simple_db->OpenEmpty();
+		else
+			instance.database->Open();
+		
+		if (!export_path.IsNull()) {
+			// Convert only, no scan
+			if (!simple_db->FileExists())
+				throw std::runtime_error("Failed to load database");
+			
+			simple_db->Export(export_path,
+					  SimpleDatabase::Format::TEXT);
+			
+			instance.database->Close();
+			instance.database.reset();
+			instance.rtio_thread.Stop();
+			instance.io_thread.Stop();
+			
+			if (verbose)
+				std::cerr << "Exported to " << export_path.ToUTF8() << "\n";
+			
+			return 0;
+		}
 		
 		// Create storage
 		auto configured_storage = CreateConfiguredStorage(config,
@@ -206,18 +687,33 @@ int main(int argc, char *argv[]) {
 			composite->Mount("", std::move(configured_storage));
 		}
 		
+		std::unique_ptr<ShardUpdater> shard_updater;
+		if (sharded)
+			shard_updater = std::make_unique<ShardUpdater>(instance, *simple_db, *composite,
+								       MountShards(instance, *simple_db, *composite));
+		running_shards = shard_updater.get();
+		
 		if (verbose) {
 			std::cerr << "Music directory: " << music_directory << "\n";
 			std::cerr << "Database path: " << database_path.ToUTF8() << "\n";
 			std::cerr << "Mode: " << (update_mode ? "UPDATE (incremental)" : "CREATE (full scan)") << "\n";
+			if (update_mode && trust_mtime && !deep_verify)
+				std::cerr << "Skipping directories with unchanged mtime\n";
 			std::cerr << "Channel Mode: ";
 			if (channel_mode == ChannelMode::STEREO) {
 				std::cerr << "STEREO (filtering out multichannel)\n";
 			} else if (channel_mode == ChannelMode::MULTICHANNEL) {
 				std::cerr << "MULTICHANNEL (filtering out stereo)\n";
+			} else if (channel_mode == ChannelMode::SPLIT) {
+				std::cerr << "SPLIT (no filtering, " << outputs.size()
+					  << " filtered outputs)\n";
 			} else {
 				std::cerr << "ALL (no filtering)\n";
 			}
+			if (sharded)
+				std::cerr << "Shards: " << shards.size() << "\n";
+			if (streaming)
+				std::cerr << "Writing the database while scanning\n";
 			std::cerr << (update_mode ? "Updating" : "Scanning");
 			std::cerr.flush();
 		}
@@ -234,7 +730,7 @@ int main(int argc, char *argv[]) {
 		instance.update->Enqueue("", !update_mode);
 		
 		// Create update checker to monitor completion
-		UpdateChecker checker(instance, verbose);
+		UpdateChecker checker(instance, shard_updater.get(), verbose);
 		checker.Start();
 		
 		// Run the event loop - it will process update events and our timer
@@ -244,8 +740,21 @@ int main(int argc, char *argv[]) {
 		if (verbose)
 			std::cerr << "\n";
 		
-		// Save
-		simple_db->Save();
+		running_shards = nullptr;
+		
+		if (interrupted) {
+			// The scans have kept the old database files and
+			// their journals
+			if (streaming)
+				std::cerr << "Interrupted\n";
+			else
+				std::cerr << "Interrupted; run again with --resume to continue\n";
+		} else if (!streaming)
+			SaveDatabases(*simple_db, sharded);
+		else if (!simple_db->FileExists())
+			// The update thread has written it already,
+			// unless that failed
+			throw std::runtime_error("Failed to write the database");
 		
 		// Clean up update service first while event loops are still running
 		delete instance.update;
@@ -263,10 +772,10 @@ int main(int argc, char *argv[]) {
 		instance.rtio_thread.Stop();
 		instance.io_thread.Stop();
 		
-		if (verbose)
+		if (verbose && !interrupted)
 			std::cerr << "Done!\n";
 		
-		return 0;
+		return interrupted ? 1 : 0;
 	} catch (const std::exception &e) {
 		std::cerr << "Error: " << e.what() << "\n";
 		return 1;
@@ -19,8 +19,12 @@
 #include "util/StringStrip.hxx"
 #include "util/CNumberParser.hxx"
 
+#include <string_view>
+
 #include <stdlib.h>
 
+using std::string_view_literals::operator""sv;
+
 #define SONG_MTIME "mtime"
 #define SONG_ADDED "added"
 #define SONG_END "song_end"
@@ -37,14 +41,20 @@ range_save(BufferedOutputStream &os, unsigned start_ms, unsigned end_ms)
 void
 song_save(BufferedOutputStream &os, const Song &song)
 {
-	os.Fmt(SONG_BEGIN "{}\n", song.filename);
+	song_save(os, song, song.tag);
+}
+
+void
+song_save(BufferedOutputStream &os, const Song &song, const Tag &tag)
+{
+	os.Fmt(SONG_BEGIN "{}\n", song.filename.c_str());
 
 	if (!song.target.empty())
-		os.Fmt("Target: {}\n", song.target);
+		os.Fmt("Target: {}\n", song.target.c_str());
 
 	range_save(os, song.start_time.ToMS(), song.end_time.ToMS());
 
-	tag_save(os, song.tag);
+	tag_save(os, tag);
 
 	if (song.audio_format.IsDefined())
 		os.Fmt("Format: {}\n", song.audio_format);
@@ -81,14 +91,27 @@ song_save(BufferedOutputStream &os, const DetachedSong &song)
 	os.Write(SONG_END "\n");
 }
 
-DetachedSong
-song_load(LineReader &file, const char *uri,
-	  std::string *target_r, bool *in_playlist_r)
-{
-	DetachedSong song(uri);
+namespace {
 
-	TagBuilder tag;
+/**
+ * The song attributes parsed by LoadSongLines() which are stored
+ * differently in #Song and #DetachedSong.
+ */
+struct SongAttributes {
+	std::chrono::system_clock::time_point mtime =
+		std::chrono::system_clock::time_point::min();
+	std::chrono::system_clock::time_point added =
+		std::chrono::system_clock::time_point::min();
+	SongTime start_time = SongTime::zero(), end_time = SongTime::zero();
+	AudioFormat audio_format = AudioFormat::Undefined();
+};
+
+} // anonymous namespace
 
+static void
+LoadSongLines(LineReader &file, TagBuilder &tag, SongAttributes &a,
+	      std::string *target_r, bool *in_playlist_r)
+{
 	char *line;
 	while ((line = file.ReadLine()) != nullptr &&
 	       !StringIsEqual(line, SONG_END)) {
@@ -96,31 +119,30 @@ song_load(LineReader &file, const char *uri,
 		if (colon == nullptr || colon == line)
 			throw FmtRuntimeError("unknown line in db: {}", line);
 
-		*colon++ = 0;
-		const char *value = StripLeft(colon);
+		const std::string_view name{line, colon};
+		const char *value = StripLeft(colon + 1);
 
 		TagType type;
-		if ((type = tag_name_parse(line)) != TAG_NUM_OF_ITEM_TYPES) {
+		if ((type = tag_name_parse(name)) != TAG_NUM_OF_ITEM_TYPES) {
 			tag.AddItemUnchecked(type, value);
-		} else if (StringIsEqual(line, "Time")) {
+		} else if (name == "Time"sv) {
 			tag.SetDuration(SignedSongTime::FromS(ParseDouble(value)));
-		} else if (StringIsEqual(line, "Target")) {
+		} else if (name == "Target"sv) {
 			if (target_r != nullptr)
 				*target_r = value;
-		} else if (StringIsEqual(line, "Format")) {
+		} else if (name == "Format"sv) {
 			try {
-				song.SetAudioFormat(ParseAudioFormat(value,
-								     false));
+				a.audio_format = ParseAudioFormat(value, false);
 			} catch (...) {
 				/* ignore parser errors */
 			}
-		} else if (StringIsEqual(line, "Playlist")) {
+		} else if (name == "Playlist"sv) {
 			tag.SetHasPlaylist(StringIsEqual(value, "yes"));
-		} else if (StringIsEqual(line, SONG_MTIME)) {
-			song.SetLastModified(std::chrono::system_clock::from_time_t(atoi(value)));
-		} else if (StringIsEqual(line, SONG_ADDED)) {
-			song.SetAdded(std::chrono::system_clock::from_time_t(atoi(value)));
-		} else if (StringIsEqual(line, "Range")) {
+		} else if (name == SONG_MTIME ""sv) {
+			a.mtime = std::chrono::system_clock::from_time_t(atoi(value));
+		} else if (name == SONG_ADDED ""sv) {
+			a.added = std::chrono::system_clock::from_time_t(atoi(value));
+		} else if (name == "Range"sv) {
 			char *endptr;
 
 			unsigned start_ms = strtoul(value, &endptr, 10);
@@ -128,16 +150,51 @@ song_load(LineReader &file, const char *uri,
 				? strtoul(endptr + 1, nullptr, 10)
 				: 0;
 
-			song.SetStartTime(SongTime::FromMS(start_ms));
-			song.SetEndTime(SongTime::FromMS(end_ms));
-		} else if (StringIsEqual(line, "InPlaylist")) {
+			a.start_time = SongTime::FromMS(start_ms);
+			a.end_time = SongTime::FromMS(end_ms);
+		} else if (name == "InPlaylist"sv) {
 			if (in_playlist_r != nullptr)
 				*in_playlist_r = StringIsEqual(value, "yes");
 		} else {
+			*colon = 0;
 			throw FmtRuntimeError("unknown line in db: {}", line);
 		}
 	}
+}
+
+DetachedSong
+song_load(LineReader &file, const char *uri,
+	  std::string *target_r, bool *in_playlist_r)
+{
+	DetachedSong song(uri);
 
+	TagBuilder tag;
+	SongAttributes a;
+	LoadSongLines(file, tag, a, target_r, in_playlist_r);
+
+	song.SetLastModified(a.mtime);
+	song.SetAdded(a.added);
+	song.SetStartTime(a.start_time);
+	song.SetEndTime(a.end_time);
+	song.SetAudioFormat(a.audio_format);
 	song.SetTag(tag.Commit());
 	return song;
 }
+
+void
+song_load(LineReader &file, Song &song)
+{
+	TagBuilder tag;
+	SongAttributes a;
+	std::string target;
+	LoadSongLines(file, tag, a, &target, &song.in_playlist);
+
+	song.target = target;
+
+	song.mtime = a.mtime;
+	song.added = a.added;
+	song.start_time = a.start_time;
+	song.end_time = a.end_time;
+	song.audio_format = a.audio_format;
+	tag.Commit(song.tag);
+}
@@ -9,6 +9,7 @@
 #define SONG_BEGIN "song_begin: "
 
 struct Song;
+struct Tag;
 struct AudioFormat;
 class DetachedSong;
 class BufferedOutputStream;
@@ -17,6 +18,12 @@ class LineReader;
 void
 song_save(BufferedOutputStream &os, const Song &song);
 
+/**
+ * Like song_save(), but write the given tag instead of Song::tag.
+ */
+void
+song_save(BufferedOutputStream &os, const Song &song, const Tag &tag);
+
 void
 song_save(BufferedOutputStream &os, const DetachedSong &song);
 
@@ -30,4 +37,14 @@ DetachedSong
 song_load(LineReader &file, const char *uri,
 	  std::string *target_r=nullptr, bool *in_playlist_r=nullptr);
 
+/**
+ * Like the other song_load() overload, but fill an existing #Song
+ * (including #Song::target and #Song::in_playlist), avoiding the
+ * #DetachedSong copy.
+ *
+ * Throws on error.
+ */
+void
+song_load(LineReader &file, Song &song);
+
 #endif
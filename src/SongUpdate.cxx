@@ -5,6 +5,7 @@
 #include "db/Features.hxx" // for ENABLE_DATABASE
 #include "db/plugins/simple/Song.hxx"
 #include "db/plugins/simple/Directory.hxx"
+#include "db/update/TagCache.hxx"
 #include "storage/StorageInterface.hxx"
 #include "storage/FileInfo.hxx"
 #include "input/InputStream.hxx"
@@ -39,13 +40,14 @@ Song::IsPluginAvailable() const noexcept
 
 SongPtr
 Song::LoadFile(Storage &storage, std::string_view path_utf8,
-	       const StorageFileInfo &info, Directory &parent)
+	       const StorageFileInfo &info, Directory &parent,
+	       TagCache *tag_cache)
 {
 	assert(!uri_has_scheme(path_utf8));
 	assert(path_utf8.find('\n') == path_utf8.npos);
 
 	auto song = std::make_unique<Song>(path_utf8, parent);
-	if (!song->UpdateFile(storage, info))
+	if (!song->UpdateFile(storage, info, tag_cache))
 		return nullptr;
 
 	return song;
@@ -56,7 +58,8 @@ Song::LoadFile(Storage &storage, std::string_view path_utf8,
 #ifdef ENABLE_DATABASE
 
 bool
-Song::UpdateFile(Storage &storage, const StorageFileInfo &info)
+Song::UpdateFile(Storage &storage, const StorageFileInfo &info,
+		 TagCache *tag_cache)
 {
 	assert(info.IsRegular());
 
@@ -64,29 +67,38 @@ Song::UpdateFile(Storage &storage, const StorageFileInfo &info)
 
 	TagBuilder tag_builder;
 	auto new_audio_format = AudioFormat::Undefined();
+	TagCache::Reservation reservation;
+
+	/* I/O errors are propagated to the caller, which shall not
+	   mistake the file for an unrecognized one */
+	const auto path_fs = storage.MapFS(relative_uri);
+	if (path_fs.IsNull()) {
+		Mutex mutex;
+		const auto is = storage.OpenFile(relative_uri, mutex);
+		LockWaitReady(*is);
+		if (!tag_stream_scan(*is, tag_builder, &new_audio_format))
+			return false;
+	} else {
+		/* a file which was moved or hard-linked may have been
+		   scanned already */
+		if (tag_cache != nullptr) {
+			if (auto item = tag_cache->Lookup(info, reservation)) {
+				mtime = info.mtime;
+				audio_format = item->audio_format;
+				tag = std::move(item->tag);
+				return true;
+			}
+		}
 
-	try {
-		const auto path_fs = storage.MapFS(relative_uri);
-		if (path_fs.IsNull()) {
-			Mutex mutex;
-			const auto is = storage.OpenFile(relative_uri, mutex);
-			LockWaitReady(*is);
-			if (!tag_stream_scan(*is, tag_builder,
+		if (!ScanFileTagsWithGeneric(path_fs, tag_builder,
 					     &new_audio_format))
-				return false;
-		} else {
-			if (!ScanFileTagsWithGeneric(path_fs, tag_builder,
-						     &new_audio_format))
-				return false;
-		}
-	} catch (...) {
-		// TODO: log or propagate I/O errors?
-		return false;
+			return false;
 	}
 
 	mtime = info.mtime;
 	audio_format = new_audio_format;
 	tag_builder.Commit(tag);
+	reservation.Commit(tag, audio_format);
 	return true;
 }
 
@@ -59,6 +59,16 @@ enum class ConfigOption {
 	GAPLESS_MP3_PLAYBACK,
 	AUTO_UPDATE,
 	AUTO_UPDATE_DEPTH,
+	UPDATE_JOBS,
+	UPDATE_ENUMERATORS,
+	UPDATE_IO_URING_DEPTH,
+	UPDATE_TRUST_MTIME,
+	UPDATE_NEGATIVE_CACHE,
+	UPDATE_NEGATIVE_CACHE_REBUILD,
+	UPDATE_TAG_CACHE,
+	UPDATE_JOURNAL,
+	UPDATE_RESUME,
+	UPDATE_STREAMING,
 
 	MIXRAMP_ANALYZER,
 
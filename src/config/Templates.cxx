@@ -57,6 +57,16 @@ const ConfigTemplate config_param_templates[] = {
 	{ "gapless_mp3_playback", false, true },
 	{ "auto_update" },
 	{ "auto_update_depth" },
+	{ "update_jobs" },
+	{ "update_enumerators" },
+	{ "update_io_uring_depth" },
+	{ "update_trust_mtime" },
+	{ "update_negative_cache" },
+	{ "update_negative_cache_rebuild" },
+	{ "update_tag_cache" },
+	{ "update_journal" },
+	{ "update_resume" },
+	{ "update_streaming" },
 	{ "mixramp_analyzer" },
 };
 
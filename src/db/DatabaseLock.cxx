@@ -7,4 +7,6 @@ Mutex db_mutex;
 
 #ifndef NDEBUG
 ThreadId db_mutex_holder;
+thread_local bool db_mutex_borrowed = false;
+thread_local DatabaseLockStats db_lock_stats;
 #endif
@@ -20,8 +20,49 @@ extern Mutex db_mutex;
 
 #include "thread/Id.hxx"
 
+#include <chrono>
+#include <cstddef>
+
 extern ThreadId db_mutex_holder;
 
+/**
+ * Statistics about the #db_mutex, collected per thread in debug
+ * builds, e.g. to see how much an update walk contends with other
+ * threads.
+ */
+struct DatabaseLockStats {
+	using Duration = std::chrono::steady_clock::duration;
+
+	/**
+	 * The number of db_lock() calls.
+	 */
+	std::size_t n_locks = 0;
+
+	/**
+	 * The total time spent waiting for the lock.
+	 */
+	Duration wait{};
+
+	/**
+	 * The total and the longest time the lock was held.
+	 */
+	Duration hold{}, max_hold{};
+
+	/**
+	 * When did this thread obtain the lock?  Only valid while it
+	 * holds the lock.
+	 */
+	std::chrono::steady_clock::time_point locked_since;
+};
+
+extern thread_local DatabaseLockStats db_lock_stats;
+
+/**
+ * Is the current thread working on behalf of the lock holder?  See
+ * #ScopeDatabaseLockBorrow.
+ */
+extern thread_local bool db_mutex_borrowed;
+
 /**
  * Does the current thread hold the database lock?
  */
@@ -29,7 +70,7 @@ extern ThreadId db_mutex_holder;
 static inline bool
 holding_db_lock() noexcept
 {
-	return db_mutex_holder.IsInside();
+	return db_mutex_holder.IsInside() || db_mutex_borrowed;
 }
 
 #endif
@@ -43,11 +84,20 @@ db_lock(void)
 {
 	assert(!holding_db_lock());
 
+#ifndef NDEBUG
+	const auto start = std::chrono::steady_clock::now();
+#endif
+
 	db_mutex.lock();
 
 	assert(db_mutex_holder.IsNull());
 #ifndef NDEBUG
 	db_mutex_holder = ThreadId::GetCurrent();
+
+	auto &stats = db_lock_stats;
+	stats.locked_since = std::chrono::steady_clock::now();
+	stats.wait += stats.locked_since - start;
+	++stats.n_locks;
 #endif
 }
 
@@ -60,6 +110,12 @@ db_unlock(void)
 	assert(holding_db_lock());
 #ifndef NDEBUG
 	db_mutex_holder = ThreadId::Null();
+
+	auto &stats = db_lock_stats;
+	const auto hold = std::chrono::steady_clock::now() - stats.locked_since;
+	stats.hold += hold;
+	if (hold > stats.max_hold)
+		stats.max_hold = hold;
 #endif
 
 	db_mutex.unlock();
@@ -89,6 +145,32 @@ public:
 	}
 };
 
+/**
+ * Declare that the current thread works on behalf of the thread
+ * which holds the database lock, on objects which the lock holder
+ * has handed over and does not touch until this thread is done
+ * (e.g. a subtree being loaded by a #WorkerPool job).  This only
+ * affects the holding_db_lock() assertions; it does not lock
+ * anything.
+ */
+class ScopeDatabaseLockBorrow {
+#ifndef NDEBUG
+	const bool was_borrowed = db_mutex_borrowed;
+
+public:
+	ScopeDatabaseLockBorrow() noexcept {
+		db_mutex_borrowed = true;
+	}
+
+	~ScopeDatabaseLockBorrow() noexcept {
+		db_mutex_borrowed = was_borrowed;
+	}
+
+	ScopeDatabaseLockBorrow(const ScopeDatabaseLockBorrow &) = delete;
+	ScopeDatabaseLockBorrow &operator=(const ScopeDatabaseLockBorrow &) = delete;
+#endif
+};
+
 /**
  * Unlock the database while in the current scope.
  */
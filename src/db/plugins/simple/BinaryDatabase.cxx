@@ -0,0 +1,585 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#include "BinaryDatabase.hxx"
+#include "BinaryFormat.hxx"
+#include "Directory.hxx"
+#include "Song.hxx"
+#include "db/DatabaseLock.hxx"
+#include "db/PlaylistInfo.hxx"
+#include "io/FileReader.hxx"
+#include "io/MappedFile.hxx"
+#include "io/OutputStream.hxx"
+#include "lib/fmt/RuntimeError.hxx"
+#include "tag/Builder.hxx"
+#include "tag/Names.hxx"
+#include "tag/ParseName.hxx"
+#include "tag/Settings.hxx"
+#include "time/ChronoUtil.hxx"
+#include "fs/Charset.hxx"
+#include "fs/Path.hxx"
+#include "Version.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using namespace BinaryDatabase;
+
+static int64_t
+ExportTime(std::chrono::system_clock::time_point t) noexcept
+{
+	return IsNegative(t)
+		? UNKNOWN_TIME
+		: std::chrono::system_clock::to_time_t(t);
+}
+
+static std::chrono::system_clock::time_point
+ImportTime(int64_t t) noexcept
+{
+	return t == UNKNOWN_TIME
+		? std::chrono::system_clock::time_point::min()
+		: std::chrono::system_clock::from_time_t(t);
+}
+
+template<typename T>
+static uint32_t
+CheckedCount(const std::vector<T> &v)
+{
+	if (v.size() > std::numeric_limits<uint32_t>::max())
+		throw std::runtime_error("Database too large");
+
+	return v.size();
+}
+
+namespace {
+
+/**
+ * Collects all tables of the binary format in memory, and then
+ * writes them in one go.
+ */
+class BinaryWriter {
+	/**
+	 * The string table; all keys of #string_map point into the
+	 * #Directory tree (or to static strings), which is not
+	 * modified while saving.
+	 */
+	std::vector<char> strings{'\0'};
+	std::unordered_map<std::string_view, uint32_t> string_map;
+
+	/**
+	 * Maps #TagType to an index in #tag_names, or -1 if the tag
+	 * type was not seen yet.
+	 */
+	int tag_map[TAG_NUM_OF_ITEM_TYPES];
+	std::vector<uint32_t> tag_names;
+
+	std::vector<DirectoryRecord> directories;
+	std::vector<SongRecord> songs;
+	std::vector<TagItemRecord> tag_items;
+	std::vector<PlaylistRecord> playlists;
+
+public:
+	BinaryWriter();
+
+	void AddTree(const Directory &root);
+
+	void Write(OutputStream &os);
+
+private:
+	uint32_t String(std::string_view s);
+	uint8_t TagName(TagType type);
+
+	void AddDirectory(DirectoryRecord &r, const Directory &directory);
+	void AddSong(const Song &song);
+};
+
+}
+
+BinaryWriter::BinaryWriter()
+{
+	std::fill_n(tag_map, TAG_NUM_OF_ITEM_TYPES, -1);
+
+	/* list all enabled tags, even if no song uses them, to allow
+	   the loader to detect configuration changes */
+	for (unsigned i = 0; i < TAG_NUM_OF_ITEM_TYPES; ++i)
+		if (IsTagEnabled(i))
+			TagName(TagType(i));
+}
+
+inline uint32_t
+BinaryWriter::String(std::string_view s)
+{
+	if (s.empty())
+		return 0;
+
+	auto [i, inserted] = string_map.try_emplace(s, strings.size());
+	if (inserted) {
+		if (strings.size() + s.size() >= std::numeric_limits<uint32_t>::max())
+			throw std::runtime_error("Database string table too large");
+
+		strings.insert(strings.end(), s.begin(), s.end());
+		strings.push_back('\0');
+	}
+
+	return i->second;
+}
+
+inline uint8_t
+BinaryWriter::TagName(TagType type)
+{
+	if (tag_map[type] < 0) {
+		tag_map[type] = tag_names.size();
+		tag_names.push_back(String(tag_item_names[type]));
+	}
+
+	return tag_map[type];
+}
+
+inline void
+BinaryWriter::AddSong(const Song &song)
+{
+	SongRecord r{};
+	r.filename = String(song.filename);
+	r.target = String(song.target);
+	r.mtime = ExportTime(song.mtime);
+	r.added = ExportTime(song.added);
+	r.duration_ms = song.tag.duration.count();
+	r.start_ms = song.start_time.ToMS();
+	r.end_ms = song.end_time.ToMS();
+	r.sample_rate = song.audio_format.sample_rate;
+	r.sample_format = static_cast<uint8_t>(song.audio_format.format);
+	r.channels = song.audio_format.channels;
+
+	if (song.tag.has_playlist)
+		r.flags |= SongRecord::FLAG_HAS_PLAYLIST;
+	if (song.in_playlist)
+		r.flags |= SongRecord::FLAG_IN_PLAYLIST;
+
+	r.first_tag_item = CheckedCount(tag_items);
+	for (const auto &i : song.tag) {
+		TagItemRecord item{};
+		item.value = String(i.value);
+		item.type = TagName(i.type);
+		tag_items.push_back(item);
+	}
+
+	r.n_tag_items = tag_items.size() - r.first_tag_item;
+
+	songs.push_back(r);
+}
+
+inline void
+BinaryWriter::AddDirectory(DirectoryRecord &r, const Directory &directory)
+{
+	r.device = directory.device;
+	r.inode = directory.inode;
+	r.mtime = ExportTime(directory.mtime);
+
+	r.first_song = CheckedCount(songs);
+	for (const auto &song : directory.songs)
+		AddSong(song);
+	r.n_songs = songs.size() - r.first_song;
+
+	r.first_playlist = CheckedCount(playlists);
+	for (const auto &pi : directory.playlists) {
+		PlaylistRecord p{};
+		p.name = String(pi.name);
+		p.mtime = ExportTime(pi.mtime);
+		playlists.push_back(p);
+	}
+	r.n_playlists = playlists.size() - r.first_playlist;
+}
+
+void
+BinaryWriter::AddTree(const Directory &root)
+{
+	/* breadth-first, so the children of each directory get
+	   consecutive indices */
+	std::vector<const Directory *> queue{&root};
+	directories.emplace_back();
+
+	for (std::size_t i = 0; i < queue.size(); ++i) {
+		const Directory &directory = *queue[i];
+
+		const uint32_t first_child = CheckedCount(queue);
+		for (const auto &child : directory.children) {
+			if (child.IsMount())
+				continue;
+
+			DirectoryRecord c{};
+			c.name = String(child.GetName());
+			c.parent = i;
+			queue.push_back(&child);
+			directories.push_back(c);
+		}
+
+		/* the reference is obtained after the loop above,
+		   which may have reallocated the vector */
+		auto &r = directories[i];
+		r.first_child = first_child;
+		r.n_children = queue.size() - first_child;
+		AddDirectory(r, directory);
+	}
+}
+
+static constexpr uint64_t
+AlignTable(uint64_t offset) noexcept
+{
+	return (offset + 7) & ~uint64_t(7);
+}
+
+template<typename T>
+static Table
+MakeTable(uint64_t &offset, const std::vector<T> &v)
+{
+	offset = AlignTable(offset);
+	Table t{offset, CheckedCount(v), sizeof(T)};
+	offset += uint64_t(v.size()) * sizeof(T);
+	return t;
+}
+
+/**
+ * Write the given table, preceded by padding which aligns it to
+ * Table::offset.
+ */
+template<typename T>
+static void
+WriteTable(OutputStream &os, uint64_t &position, const Table &t,
+	   const std::vector<T> &v)
+{
+	static constexpr std::byte padding[8]{};
+	os.Write(std::span{padding}.first(t.offset - position));
+	os.Write(std::as_bytes(std::span{v}));
+	position = t.offset + uint64_t(v.size()) * sizeof(T);
+}
+
+void
+BinaryWriter::Write(OutputStream &os)
+{
+	Header header{};
+	std::copy_n(MAGIC, sizeof(MAGIC), header.magic);
+	header.byte_order = BYTE_ORDER_MARK;
+	header.version = FORMAT_VERSION;
+	header.fs_charset = String(GetFSCharset());
+	header.mpd_version = String(VERSION);
+
+	uint64_t offset = sizeof(header);
+	header.tag_names = MakeTable(offset, tag_names);
+	header.directories = MakeTable(offset, directories);
+	header.songs = MakeTable(offset, songs);
+	header.tag_items = MakeTable(offset, tag_items);
+	header.playlists = MakeTable(offset, playlists);
+	header.strings = MakeTable(offset, strings);
+	header.file_size = offset;
+
+	os.Write(std::as_bytes(std::span{&header, 1}));
+
+	uint64_t position = sizeof(header);
+	WriteTable(os, position, header.tag_names, tag_names);
+	WriteTable(os, position, header.directories, directories);
+	WriteTable(os, position, header.songs, songs);
+	WriteTable(os, position, header.tag_items, tag_items);
+	WriteTable(os, position, header.playlists, playlists);
+	WriteTable(os, position, header.strings, strings);
+}
+
+void
+db_save_binary(OutputStream &os, const Directory &root)
+{
+	BinaryWriter writer;
+	writer.AddTree(root);
+	writer.Write(os);
+}
+
+bool
+IsBinaryDatabase(Path path) noexcept
+try {
+	FileReader reader{path};
+
+	std::byte buffer[sizeof(MAGIC)];
+	return reader.Read(buffer) == sizeof(buffer) &&
+		std::memcmp(buffer, MAGIC, sizeof(MAGIC)) == 0;
+} catch (...) {
+	return false;
+}
+
+[[noreturn]]
+static void
+ThrowCorrupted()
+{
+	throw std::runtime_error("Database corrupted");
+}
+
+/**
+ * Throws if there are duplicates in the given list of names.
+ */
+static void
+CheckDuplicates(std::vector<std::string_view> &names, const char *what)
+{
+	std::sort(names.begin(), names.end());
+
+	const auto i = std::adjacent_find(names.begin(), names.end());
+	if (i != names.end())
+		throw FmtRuntimeError("Duplicate {} {:?}", what, *i);
+}
+
+namespace {
+
+/**
+ * Validates the mapped file and builds the #Directory tree from it.
+ */
+class BinaryLoader {
+	std::span<const std::byte> file;
+
+	std::span<const char> strings;
+	std::span<const DirectoryRecord> directories;
+	std::span<const SongRecord> songs;
+	std::span<const TagItemRecord> tag_items;
+	std::span<const PlaylistRecord> playlists;
+
+	/**
+	 * Maps TagItemRecord::type to #TagType;
+	 * #TAG_NUM_OF_ITEM_TYPES for tag names unknown to this MPD
+	 * version.
+	 */
+	std::vector<TagType> tag_types;
+
+public:
+	BinaryLoader(std::span<const std::byte> _file,
+		     bool ignore_config_mismatches);
+
+	void Load(Directory &root);
+
+private:
+	template<typename T>
+	std::span<const T> GetTable(const Table &t) const;
+
+	template<typename T>
+	static std::span<const T> GetRange(std::span<const T> table,
+					   uint32_t first, uint32_t n) {
+		if (first > table.size() || n > table.size() - first)
+			ThrowCorrupted();
+
+		return table.subspan(first, n);
+	}
+
+	std::string_view GetString(uint32_t ref) const {
+		if (ref >= strings.size())
+			ThrowCorrupted();
+
+		/* the last byte is known to be null, so this is
+		   bounded */
+		return strings.data() + ref;
+	}
+
+	/**
+	 * Returns the name of a song or a subdirectory, which must
+	 * not be empty and must not contain a slash.
+	 */
+	std::string_view GetName(uint32_t ref) const {
+		const auto name = GetString(ref);
+		if (name.empty() || name.find('/') != name.npos)
+			ThrowCorrupted();
+
+		return name;
+	}
+
+	void LoadSong(Directory &parent, const SongRecord &r);
+	void LoadDirectory(Directory &directory, uint32_t index);
+};
+
+}
+
+template<typename T>
+inline std::span<const T>
+BinaryLoader::GetTable(const Table &t) const
+{
+	if (t.entry_size != sizeof(T) ||
+	    t.offset % alignof(T) != 0 ||
+	    t.offset > file.size() ||
+	    t.count > (file.size() - t.offset) / sizeof(T))
+		ThrowCorrupted();
+
+	return {reinterpret_cast<const T *>(file.data() + t.offset), t.count};
+}
+
+BinaryLoader::BinaryLoader(std::span<const std::byte> _file,
+			   bool ignore_config_mismatches)
+	:file(_file)
+{
+	if (file.size() < sizeof(Header))
+		ThrowCorrupted();
+
+	const auto &header = *reinterpret_cast<const Header *>(file.data());
+	if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0)
+		ThrowCorrupted();
+
+	if (header.byte_order != BYTE_ORDER_MARK ||
+	    header.version != FORMAT_VERSION)
+		throw std::runtime_error("Database format mismatch, "
+					 "discarding database file");
+
+	if (header.file_size != file.size())
+		throw std::runtime_error("Database file truncated");
+
+	strings = GetTable<char>(header.strings);
+	if (strings.empty() || strings.back() != '\0')
+		ThrowCorrupted();
+
+	directories = GetTable<DirectoryRecord>(header.directories);
+	songs = GetTable<SongRecord>(header.songs);
+	tag_items = GetTable<TagItemRecord>(header.tag_items);
+	playlists = GetTable<PlaylistRecord>(header.playlists);
+
+	if (directories.empty())
+		ThrowCorrupted();
+
+	const auto tag_names = GetTable<uint32_t>(header.tag_names);
+	if (tag_names.size() > 256)
+		ThrowCorrupted();
+
+	bool tags[TAG_NUM_OF_ITEM_TYPES]{};
+	tag_types.reserve(tag_names.size());
+	for (const uint32_t name_ref : tag_names) {
+		const auto name = GetString(name_ref);
+		const TagType type = tag_name_parse(name);
+		if (type == TAG_NUM_OF_ITEM_TYPES) {
+			if (!ignore_config_mismatches)
+				throw FmtRuntimeError("Unrecognized tag {:?}, "
+						      "discarding database file",
+						      name);
+		} else
+			tags[type] = true;
+
+		tag_types.push_back(type);
+	}
+
+	if (ignore_config_mismatches)
+		return;
+
+	const auto new_charset = GetString(header.fs_charset);
+	const std::string_view old_charset = GetFSCharset();
+	if (!old_charset.empty() && new_charset != old_charset)
+		throw FmtRuntimeError("Existing database has charset "
+				      "{:?} instead of {:?}; "
+				      "discarding database file",
+				      new_charset, old_charset);
+
+	for (unsigned i = 0; i < TAG_NUM_OF_ITEM_TYPES; ++i)
+		if (IsTagEnabled(i) && !tags[i])
+			throw std::runtime_error("Tag list mismatch, "
+						 "discarding database file");
+}
+
+inline void
+BinaryLoader::LoadSong(Directory &parent, const SongRecord &r)
+{
+	auto song = std::make_unique<Song>(GetName(r.filename), parent);
+	song->target = GetString(r.target);
+	song->mtime = ImportTime(r.mtime);
+	song->added = ImportTime(r.added);
+	song->start_time = SongTime::FromMS(r.start_ms);
+	song->end_time = SongTime::FromMS(r.end_ms);
+	song->in_playlist = r.flags & SongRecord::FLAG_IN_PLAYLIST;
+
+	const AudioFormat audio_format(r.sample_rate,
+				       static_cast<SampleFormat>(r.sample_format),
+				       r.channels);
+	if (audio_format.IsMaskValid())
+		song->audio_format = audio_format;
+
+	TagBuilder tag;
+	tag.SetDuration(SignedSongTime::FromMS(r.duration_ms));
+	tag.SetHasPlaylist(r.flags & SongRecord::FLAG_HAS_PLAYLIST);
+
+	const auto items = GetRange(tag_items, r.first_tag_item,
+				    r.n_tag_items);
+	tag.Reserve(items.size());
+	for (const auto &item : items) {
+		if (item.type >= tag_types.size())
+			ThrowCorrupted();
+
+		const TagType type = tag_types[item.type];
+		if (type != TAG_NUM_OF_ITEM_TYPES)
+			tag.AddItemUnchecked(type, GetString(item.value));
+	}
+
+	song->tag = tag.Commit();
+
+	parent.AddSong(std::move(song));
+}
+
+void
+BinaryLoader::LoadDirectory(Directory &directory, uint32_t index)
+{
+	const auto &r = directories[index];
+
+	directory.device = r.device;
+	directory.inode = r.inode;
+	directory.mtime = ImportTime(r.mtime);
+
+	/* the names are collected and checked for duplicates at
+	   the end, like the text loader does */
+	std::vector<std::string_view> names;
+
+	const auto songs_range = GetRange(songs, r.first_song, r.n_songs);
+	names.reserve(songs_range.size());
+	for (const auto &song : songs_range) {
+		LoadSong(directory, song);
+		names.emplace_back(GetString(song.filename));
+	}
+
+	CheckDuplicates(names, "song");
+
+	for (const auto &p : GetRange(playlists, r.first_playlist,
+				      r.n_playlists))
+		directory.playlists.push_back(PlaylistInfo{GetString(p.name),
+							   ImportTime(p.mtime)});
+
+	/* children must have greater indices and point back to this
+	   directory, which rules out loops and shared subtrees */
+	if (r.n_children > 0 && r.first_child <= index)
+		ThrowCorrupted();
+
+	const auto children = GetRange(directories, r.first_child,
+				       r.n_children);
+	names.clear();
+	names.reserve(children.size());
+	for (uint32_t i = 0; i < children.size(); ++i) {
+		const auto &c = children[i];
+		const auto name = GetName(c.name);
+		if (c.parent != index)
+			ThrowCorrupted();
+
+		Directory *child = directory.CreateChild(name);
+		LoadDirectory(*child, r.first_child + i);
+		names.emplace_back(name);
+	}
+
+	CheckDuplicates(names, "subdirectory");
+}
+
+void
+BinaryLoader::Load(Directory &root)
+{
+	if (directories.front().parent != 0)
+		ThrowCorrupted();
+
+	const ScopeDatabaseLock protect;
+	LoadDirectory(root, 0);
+}
+
+void
+db_load_binary(Path path, Directory &root, bool ignore_config_mismatches)
+{
+	const MappedFile file{path};
+
+	BinaryLoader loader{file.get(), ignore_config_mismatches};
+	loader.Load(root);
+}
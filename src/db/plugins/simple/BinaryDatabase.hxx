@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#ifndef MPD_DATABASE_BINARY_HXX
+#define MPD_DATABASE_BINARY_HXX
+
+struct Directory;
+class OutputStream;
+class Path;
+
+/**
+ * Write the database in the binary format described in
+ * BinaryFormat.hxx.
+ *
+ * Throws on error.
+ */
+void
+db_save_binary(OutputStream &os, const Directory &root);
+
+/**
+ * Does the given file begin with the magic of the binary database
+ * format?  Returns false on I/O errors.
+ */
+[[gnu::pure]]
+bool
+IsBinaryDatabase(Path path) noexcept;
+
+/**
+ * Map a binary database file into memory and build the #Directory
+ * tree from it.
+ *
+ * Throws #std::runtime_error on error.
+ *
+ * @param ignore_config_mismatches if true, then configuration
+ * mismatches (e.g. enabled tags or filesystem charset) are ignored
+ */
+void
+db_load_binary(Path path, Directory &root,
+	       bool ignore_config_mismatches=false);
+
+#endif
@@ -0,0 +1,177 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#ifndef MPD_DB_BINARY_FORMAT_HXX
+#define MPD_DB_BINARY_FORMAT_HXX
+
+#include <cstdint>
+
+/**
+ * The on-disk layout of the binary database file.  The file is
+ * designed to be mapped into memory and used without parsing: it
+ * begins with a #Header, which points to a number of fixed-size
+ * record tables, followed by a string table.
+ *
+ * All integers are in host byte order; files written on a host with a
+ * different byte order are rejected (see Header::byte_order).  All
+ * tables are aligned to 8 bytes.
+ *
+ * Strings are referenced by their byte offset in the string table;
+ * each is null-terminated.  Offset 0 is always the empty string.
+ *
+ * Directories are stored in breadth-first order with the root at
+ * index 0, which makes the children of each directory a contiguous
+ * range of indices greater than its own.  The songs of a directory,
+ * the playlists of a directory and the tag items of a song are
+ * contiguous ranges of their tables, too.
+ */
+namespace BinaryDatabase {
+
+static constexpr char MAGIC[8] = {'M', 'P', 'D', 'B', 'I', 'N', '\r', '\n'};
+
+static constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+/**
+ * Increment this whenever the layout changes.
+ */
+static constexpr uint32_t FORMAT_VERSION = 1;
+
+/**
+ * Time stamps are stored in seconds since the epoch; this value
+ * means "unknown".
+ */
+static constexpr int64_t UNKNOWN_TIME = INT64_MIN;
+
+struct Table {
+	uint64_t offset;
+	uint32_t count;
+
+	/**
+	 * The size of one record; must match the size of the record
+	 * struct of this #FORMAT_VERSION.
+	 */
+	uint32_t entry_size;
+};
+
+struct Header {
+	char magic[sizeof(MAGIC)];
+	uint32_t byte_order;
+	uint32_t version;
+
+	/**
+	 * The size of the whole file; used to detect truncation.
+	 */
+	uint64_t file_size;
+
+	/**
+	 * String references to the filesystem charset and the MPD
+	 * version which wrote this file.
+	 */
+	uint32_t fs_charset, mpd_version;
+
+	/**
+	 * A list of string references to tag names (e.g. "Artist"):
+	 * all tags which were enabled when this file was written,
+	 * followed by other tags used by songs.
+	 * TagItemRecord::type is an index into this table.
+	 */
+	Table tag_names;
+
+	Table directories;
+	Table songs;
+	Table tag_items;
+	Table playlists;
+
+	/**
+	 * The string table; #entry_size is 1.  Its last byte must be
+	 * null.
+	 */
+	Table strings;
+};
+
+struct DirectoryRecord {
+	/**
+	 * The base name; empty for the root directory.
+	 */
+	uint32_t name;
+
+	/**
+	 * The index of the parent directory; 0 for the root
+	 * directory.
+	 */
+	uint32_t parent;
+
+	uint32_t first_child, n_children;
+	uint32_t first_song, n_songs;
+	uint32_t first_playlist, n_playlists;
+
+	/**
+	 * Directory::device, including the special DEVICE_* values.
+	 */
+	uint64_t device;
+
+	uint64_t inode;
+
+	int64_t mtime;
+};
+
+struct SongRecord {
+	uint32_t filename;
+
+	/**
+	 * Song::target; 0 (the empty string) if not set.
+	 */
+	uint32_t target;
+
+	uint32_t first_tag_item, n_tag_items;
+
+	int64_t mtime, added;
+
+	/**
+	 * Tag::duration in milliseconds; negative if unknown.
+	 */
+	int32_t duration_ms;
+
+	uint32_t start_ms, end_ms;
+
+	uint32_t sample_rate;
+	uint8_t sample_format;
+	uint8_t channels;
+
+	/**
+	 * A bit mask of SongRecord::FLAG_*.
+	 */
+	uint8_t flags;
+
+	uint8_t reserved[5];
+
+	static constexpr uint8_t FLAG_HAS_PLAYLIST = 0x1;
+	static constexpr uint8_t FLAG_IN_PLAYLIST = 0x2;
+};
+
+struct TagItemRecord {
+	uint32_t value;
+
+	/**
+	 * An index into Header::tag_names.
+	 */
+	uint8_t type;
+
+	uint8_t reserved[3];
+};
+
+struct PlaylistRecord {
+	uint32_t name;
+	uint32_t reserved;
+	int64_t mtime;
+};
+
+static_assert(sizeof(Header) == 128);
+static_assert(sizeof(DirectoryRecord) == 56);
+static_assert(sizeof(SongRecord) == 56);
+static_assert(sizeof(TagItemRecord) == 8);
+static_assert(sizeof(PlaylistRecord) == 16);
+
+} // namespace BinaryDatabase
+
+#endif
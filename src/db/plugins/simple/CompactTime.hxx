@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <limits>
+
+/**
+ * A std::chrono::system_clock::time_point in 32 bits for the #Song
+ * objects: unsigned seconds since the epoch, which is all the
+ * database file stores anyway.  Negative time points mean "unknown",
+ * like in the rest of the code, and are all mapped to
+ * time_point::min(); times after 2106 are clamped.
+ */
+class CompactTime {
+	using time_point = std::chrono::system_clock::time_point;
+
+	static constexpr uint32_t UNKNOWN = std::numeric_limits<uint32_t>::max();
+
+	uint32_t value = UNKNOWN;
+
+public:
+	constexpr CompactTime() noexcept = default;
+
+	constexpr CompactTime(time_point t) noexcept
+		:value(Pack(t)) {}
+
+	constexpr operator time_point() const noexcept {
+		return value == UNKNOWN
+			? time_point::min()
+			: time_point{std::chrono::seconds{value}};
+	}
+
+	constexpr bool IsUnknown() const noexcept {
+		return value == UNKNOWN;
+	}
+
+	friend constexpr bool operator==(CompactTime,
+					 CompactTime) noexcept = default;
+
+private:
+	static constexpr uint32_t Pack(time_point t) noexcept {
+		const auto s = std::chrono::duration_cast<std::chrono::seconds>(t.time_since_epoch()).count();
+		if (s < 0)
+			return UNKNOWN;
+
+		if (s >= UNKNOWN)
+			return UNKNOWN - 1;
+
+		return static_cast<uint32_t>(s);
+	}
+};
+
+/**
+ * Overload of IsNegative() from time/ChronoUtil.hxx.
+ */
+constexpr bool
+IsNegative(CompactTime t) noexcept
+{
+	return t.IsUnknown();
+}
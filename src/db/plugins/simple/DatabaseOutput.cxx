@@ -0,0 +1,92 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#include "config.h"
+#include "DatabaseOutput.hxx"
+
+#ifdef ENABLE_ZLIB
+#include "lib/zlib/GzipOutputStream.hxx"
+#include "lib/zlib/ParallelGzipOutputStream.hxx"
+#endif
+
+#ifdef ENABLE_ZSTD
+#include "lib/zstd/ZstdOutputStream.hxx"
+#endif
+
+DatabaseOutput::DatabaseOutput(Path path,
+			       SimpleDatabase::Compression compression,
+			       [[maybe_unused]] int level,
+			       [[maybe_unused]] unsigned n_threads)
+	:file(path)
+{
+	OutputStream *os = &file;
+
+	switch (compression) {
+	case SimpleDatabase::Compression::NONE:
+		break;
+
+	case SimpleDatabase::Compression::GZIP:
+#ifdef ENABLE_ZLIB
+		/* a large database takes several seconds to deflate
+		   in one thread; compress blocks of it on all cores
+		   instead */
+		if (n_threads > 1) {
+			parallel_gzip = std::make_unique<ParallelGzipOutputStream>(*os,
+										   level,
+										   n_threads);
+			os = parallel_gzip.get();
+		} else {
+			gzip = std::make_unique<GzipOutputStream>(*os, level);
+			os = gzip.get();
+		}
+#endif
+		break;
+
+	case SimpleDatabase::Compression::ZSTD:
+#ifdef ENABLE_ZSTD
+		zstd = std::make_unique<ZstdOutputStream>(*os,
+							  level < 0
+							  ? ZSTD_CLEVEL_DEFAULT
+							  : level,
+							  n_threads);
+		os = zstd.get();
+#endif
+		break;
+	}
+
+	buffered.emplace(*os);
+
+#ifdef ENABLE_ZSTD
+	if (zstd != nullptr)
+		/* start new frames only between top-level
+		   directories, so each frame is a meaningful part of
+		   the tree */
+		split = [this]{
+			buffered->Flush();
+			zstd->FrameBoundary();
+		};
+#endif
+}
+
+DatabaseOutput::~DatabaseOutput() noexcept = default;
+
+void
+DatabaseOutput::Commit()
+{
+	buffered->Flush();
+
+#ifdef ENABLE_ZLIB
+	if (gzip != nullptr)
+		gzip->Finish();
+
+	if (parallel_gzip != nullptr)
+		parallel_gzip->Finish();
+#endif
+
+#ifdef ENABLE_ZSTD
+	if (zstd != nullptr)
+		zstd->Finish();
+#endif
+
+	file.Commit();
+}
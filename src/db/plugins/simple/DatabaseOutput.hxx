@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#ifndef MPD_DATABASE_OUTPUT_HXX
+#define MPD_DATABASE_OUTPUT_HXX
+
+#include "SimpleDatabasePlugin.hxx"
+#include "config.h"
+#include "io/FileOutputStream.hxx"
+#include "io/BufferedOutputStream.hxx"
+
+#include <functional>
+#include <memory>
+#include <optional>
+
+#ifdef ENABLE_ZLIB
+class GzipOutputStream;
+class ParallelGzipOutputStream;
+#endif
+
+#ifdef ENABLE_ZSTD
+class ZstdOutputStream;
+#endif
+
+/**
+ * The output of a text database file: the file, an optional
+ * compressor and a buffer.
+ */
+class DatabaseOutput {
+	FileOutputStream file;
+
+#ifdef ENABLE_ZLIB
+	std::unique_ptr<GzipOutputStream> gzip;
+	std::unique_ptr<ParallelGzipOutputStream> parallel_gzip;
+#endif
+
+#ifdef ENABLE_ZSTD
+	std::unique_ptr<ZstdOutputStream> zstd;
+#endif
+
+	std::optional<BufferedOutputStream> buffered;
+
+	/**
+	 * See directory_save(); empty unless the compressor can make
+	 * use of it.
+	 */
+	std::function<void()> split;
+
+public:
+	/**
+	 * Throws on error.
+	 *
+	 * @param level the compression level or -1 for the default
+	 * @param n_threads the number of compression threads
+	 */
+	DatabaseOutput(Path path, SimpleDatabase::Compression compression,
+		       int level, unsigned n_threads);
+
+	~DatabaseOutput() noexcept;
+
+	DatabaseOutput(const DatabaseOutput &) = delete;
+	DatabaseOutput &operator=(const DatabaseOutput &) = delete;
+
+	BufferedOutputStream &GetStream() noexcept {
+		return *buffered;
+	}
+
+	const std::function<void()> &GetSplit() const noexcept {
+		return split;
+	}
+
+	/**
+	 * Finish the compressor and replace the file.  Without this
+	 * call, the file is left alone.
+	 *
+	 * Throws on error.
+	 */
+	void Commit();
+};
+
+#endif
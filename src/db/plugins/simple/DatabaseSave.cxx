@@ -4,6 +4,8 @@
 #include "DatabaseSave.hxx"
 #include "db/DatabaseLock.hxx"
 #include "DirectorySave.hxx"
+#include "Directory.hxx"
+#include "SimpleDatabasePlugin.hxx"
 #include "lib/fmt/RuntimeError.hxx"
 #include "io/BufferedOutputStream.hxx"
 #include "io/LineReader.hxx"
@@ -34,7 +36,7 @@ static constexpr unsigned DB_FORMAT = 2;
 static constexpr unsigned OLDEST_DB_FORMAT = 1;
 
 void
-db_save_internal(BufferedOutputStream &os, const Directory &music_root)
+db_save_header(BufferedOutputStream &os)
 {
 	os.Write(DIRECTORY_INFO_BEGIN "\n");
 	os.Fmt(DB_FORMAT_PREFIX "{}\n", DB_FORMAT);
@@ -47,13 +49,23 @@ db_save_internal(BufferedOutputStream &os, const Directory &music_root)
 			       tag_item_names[i]);
 
 	os.Write(DIRECTORY_INFO_END "\n");
-
-	directory_save(os, music_root);
 }
 
 void
-db_load_internal(LineReader &file, Directory &music_root,
-		 bool ignore_config_mismatches)
+db_save_internal(BufferedOutputStream &os, const Directory &music_root,
+		 const DatabaseSaveFilter *filter,
+		 const std::function<void()> &split,
+		 WorkerPool *pool)
+{
+	db_save_header(os);
+	directory_save(os, music_root, filter, nullptr, split, pool);
+}
+
+/**
+ * Throws #std::runtime_error on error.
+ */
+static void
+db_load_header(LineReader &file, bool ignore_config_mismatches)
 {
 	char *line;
 	unsigned format = 0;
@@ -119,7 +131,35 @@ db_load_internal(LineReader &file, Directory &music_root,
 			if (IsTagEnabled(i) && !tags[i])
 				throw std::runtime_error("Tag list mismatch, "
 							 "discarding database file");
+}
+
+void
+db_load_internal(LineReader &file, Directory &music_root,
+		 bool ignore_config_mismatches, WorkerPool *pool)
+{
+	db_load_header(file, ignore_config_mismatches);
 
 	const ScopeDatabaseLock protect;
-	directory_load(file, music_root);
+	directory_load(file, music_root, pool);
+}
+
+static void
+SaveMountFromFile(BufferedOutputStream &os, const Directory &mount)
+{
+	const auto *db = dynamic_cast<const SimpleDatabase *>(mount.mounted_database.get());
+	if (db == nullptr)
+		return;
+
+	const auto file = db->OpenFile();
+	db_load_header(*file, false);
+	directory_save_mount(os, mount, *file);
+}
+
+void
+db_save_merged(BufferedOutputStream &os, const Directory &music_root,
+	       const std::function<void()> &split, WorkerPool *pool)
+{
+	db_save_header(os);
+	directory_save(os, music_root, nullptr, SaveMountFromFile, split,
+		       pool);
 }
@@ -4,21 +4,59 @@
 #ifndef MPD_DATABASE_SAVE_HXX
 #define MPD_DATABASE_SAVE_HXX
 
+#include <functional>
+
 struct Directory;
 class BufferedOutputStream;
 class LineReader;
+class DatabaseSaveFilter;
+class WorkerPool;
+
+/**
+ * Write the header of a text database file; it must be followed by
+ * the contents of the root directory, see directory_save().
+ */
+void
+db_save_header(BufferedOutputStream &os);
+
+/**
+ * @param filter an optional filter which selects and modifies the
+ * songs to be written
+ * @param split an optional function which is called after each
+ * top-level directory, see directory_save()
+ * @param pool an optional #WorkerPool which serializes subtrees in
+ * parallel, see directory_save()
+ */
+void
+db_save_internal(BufferedOutputStream &os, const Directory &root,
+		 const DatabaseSaveFilter *filter=nullptr,
+		 const std::function<void()> &split={},
+		 WorkerPool *pool=nullptr);
 
+/**
+ * Like db_save_internal(), but instead of omitting mount points,
+ * copy the contents of the mounted #SimpleDatabase instances from
+ * their files.  The result is one database file which can be read
+ * by MPD.
+ *
+ * Throws on error.
+ */
 void
-db_save_internal(BufferedOutputStream &os, const Directory &root);
+db_save_merged(BufferedOutputStream &os, const Directory &root,
+	       const std::function<void()> &split={},
+	       WorkerPool *pool=nullptr);
 
 /**
  * Throws #std::runtime_error on error.
  *
  * @param ignore_config_mismatches if true, then configuration
  * mismatches (e.g. enabled tags or filesystem charset) are ignored
+ * @param pool if not nullptr, then the top-level directories are
+ * parsed in parallel by this #WorkerPool
  */
 void
 db_load_internal(LineReader &file, Directory &root,
-		 bool ignore_config_mismatches=false);
+		 bool ignore_config_mismatches=false,
+		 WorkerPool *pool=nullptr);
 
 #endif
@@ -0,0 +1,94 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#include "DatabaseStream.hxx"
+#include "DatabaseSave.hxx"
+#include "DirectorySave.hxx"
+#include "Directory.hxx"
+#include "db/DatabaseLock.hxx"
+
+#include <cassert>
+
+DatabaseStream::DatabaseStream(Path path,
+			       SimpleDatabase::Compression compression,
+			       int level, unsigned n_threads)
+	:output(path, compression, level, n_threads)
+{
+	db_save_header(output.GetStream());
+}
+
+void
+DatabaseStream::Open(const Directory &directory)
+{
+	if (directory.IsRoot() ||
+	    (!open.empty() && open.back() == &directory))
+		return;
+
+	Open(*directory.parent);
+	assert(open.empty()
+	       ? directory.parent->IsRoot()
+	       : open.back() == directory.parent);
+
+	directory_save_head(output.GetStream(), directory);
+	open.push_back(&directory);
+}
+
+void
+DatabaseStream::Add(Directory &directory)
+{
+	assert(!directory.IsRoot());
+
+	auto &os = output.GetStream();
+
+	const ScopeDatabaseLock protect;
+
+	directory.PruneEmpty();
+	directory.Sort();
+
+	bool written = true;
+	if (!open.empty() && open.back() == &directory) {
+		/* some of its children have been added already;
+		   write the rest */
+		open.pop_back();
+
+		for (const auto &child : directory.children)
+			if (!child.IsMount())
+				directory_save_child(os, child);
+
+		directory_save_end(os, directory);
+	} else if (!directory.IsEmpty()) {
+		Open(*directory.parent);
+		directory_save_child(os, directory);
+	} else
+		written = false;
+
+	const bool top_level = directory.parent->IsRoot();
+	directory.Delete();
+
+	if (written && top_level && output.GetSplit())
+		output.GetSplit()();
+}
+
+void
+DatabaseStream::Commit(Directory &root)
+{
+	assert(root.IsRoot());
+	assert(open.empty());
+
+	auto &os = output.GetStream();
+
+	{
+		const ScopeDatabaseLock protect;
+
+		root.PruneEmpty();
+		root.Sort();
+
+		for (const auto &child : root.children)
+			if (!child.IsMount())
+				directory_save_child(os, child);
+
+		directory_save_end(os, root);
+	}
+
+	output.Commit();
+}
@@ -0,0 +1,71 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#ifndef MPD_DATABASE_STREAM_HXX
+#define MPD_DATABASE_STREAM_HXX
+
+#include "DatabaseOutput.hxx"
+
+#include <vector>
+
+struct Directory;
+
+/**
+ * Writes a text database file while the tree is still being built:
+ * each directory is written and freed as soon as it is complete, so
+ * only the directories which are being walked stay in memory, not
+ * the whole tree.
+ *
+ * The directories must be added in the order of the file, i.e.
+ * sorted like Directory::Sort(), and each one after all of its
+ * children.  The result is the same as SimpleDatabase::Save().
+ */
+class DatabaseStream {
+	DatabaseOutput output;
+
+	/**
+	 * The directories whose "begin" line has been written, but
+	 * not their "end" line yet; outermost first.  The root is
+	 * implicitly open.
+	 */
+	std::vector<const Directory *> open;
+
+public:
+	/**
+	 * Create the file and write the header.
+	 *
+	 * Throws on error.
+	 */
+	DatabaseStream(Path path, SimpleDatabase::Compression compression,
+		       int level, unsigned n_threads);
+
+	/**
+	 * Write a complete directory (not the root) and free it.  All
+	 * of its earlier siblings must have been added before.
+	 * Empty directories are omitted, as by Save().
+	 *
+	 * Throws on error.
+	 *
+	 * Caller must not lock the #db_mutex.
+	 */
+	void Add(Directory &directory);
+
+	/**
+	 * Write the remaining contents of the root directory and
+	 * replace the database file.
+	 *
+	 * Throws on error.
+	 *
+	 * Caller must not lock the #db_mutex.
+	 */
+	void Commit(Directory &root);
+
+private:
+	/**
+	 * Make sure the "begin" lines of this directory and all of
+	 * its ancestors have been written.
+	 */
+	void Open(const Directory &directory);
+};
+
+#endif
@@ -15,17 +15,54 @@
 #include "lib/icu/Collate.hxx"
 #include "fs/Traits.hxx"
 #include "util/DeleteDisposer.hxx"
+#include "thread/WorkerPool.hxx"
 #include "util/SortList.hxx"
 #include "util/StringCompare.hxx"
 #include "util/StringSplit.hxx"
 
 #include <cassert>
+#include <memory>
+#include <vector>
 
 #include <string.h>
 #include <stdlib.h>
 
 using std::string_view_literals::operator""sv;
 
+/**
+ * Directories with fewer children and songs than this are searched
+ * linearly; an index would not pay off.
+ */
+static constexpr std::size_t INDEX_THRESHOLD = 256;
+
+struct DirectoryIndex {
+	struct GetChildName {
+		[[gnu::pure]]
+		std::string_view operator()(const Directory &directory) const noexcept {
+			return directory.GetName();
+		}
+	};
+
+	struct GetSongName {
+		[[gnu::pure]]
+		std::string_view operator()(const Song &song) const noexcept {
+			return song.filename;
+		}
+	};
+
+	IntrusiveHashSet<Directory, 1021,
+			 IntrusiveHashSetOperators<Directory, GetChildName,
+						   std::hash<std::string_view>,
+						   std::equal_to<std::string_view>>,
+			 IntrusiveHashSetMemberHookTraits<&Directory::index_hook>> children;
+
+	IntrusiveHashSet<Song, 1021,
+			 IntrusiveHashSetOperators<Song, GetSongName,
+						   std::hash<std::string_view>,
+						   std::equal_to<std::string_view>>,
+			 IntrusiveHashSetMemberHookTraits<&Song::index_hook>> songs;
+};
+
 Directory::Directory(std::string &&_path_utf8, Directory *_parent) noexcept
 	:parent(_parent),
 	 path(std::move(_path_utf8))
@@ -81,19 +118,50 @@ Directory::CreateChild(std::string_view name_utf8) noexcept
 
 	auto *child = new Directory(std::move(path_utf8), this);
 	children.push_back(*child);
+	if (index != nullptr)
+		index->children.insert(*child);
 	return child;
 }
 
-const Directory *
-Directory::FindChild(std::string_view name) const noexcept
+void
+Directory::CreateIndex() noexcept
+{
+	assert(index == nullptr);
+
+	index = std::make_unique<DirectoryIndex>();
+
+	for (auto &child : children)
+		index->children.insert(child);
+
+	for (auto &song : songs)
+		index->songs.insert(song);
+}
+
+Directory *
+Directory::FindChild(std::string_view name) noexcept
 {
 	assert(holding_db_lock());
 
-	for (const auto &child : children)
-		if (child.GetName() == name)
-			return &child;
+	if (index == nullptr) {
+		std::size_t n = 0;
+		for (auto &child : children) {
+			if (child.GetName() == name)
+				return &child;
+
+			if (++n >= INDEX_THRESHOLD)
+				break;
+		}
+
+		if (n < INDEX_THRESHOLD)
+			return nullptr;
+
+		/* this is a large directory: switch to the index
+		   for this and all further lookups */
+		CreateIndex();
+	}
 
-	return nullptr;
+	auto i = index->children.find(name);
+	return i != index->children.end() ? &*i : nullptr;
 }
 
 Song *
@@ -176,7 +244,10 @@ Directory::AddSong(SongPtr song) noexcept
 	assert(song != nullptr);
 	assert(&song->parent == this);
 
-	songs.push_back(*song.release());
+	songs.push_back(*song);
+	if (index != nullptr)
+		index->songs.insert(*song);
+	song.release();
 }
 
 SongPtr
@@ -187,29 +258,60 @@ Directory::RemoveSong(Song *song) noexcept
 	assert(&song->parent == this);
 
 	songs.erase(songs.iterator_to(*song));
+	if (song->index_hook.is_linked())
+		song->index_hook.unlink();
 	return SongPtr(song);
 }
 
-const Song *
-Directory::FindSong(std::string_view name_utf8) const noexcept
+Song *
+Directory::FindSong(std::string_view name_utf8) noexcept
 {
 	assert(holding_db_lock());
 
-	for (auto &song : songs) {
-		assert(&song.parent == this);
+	if (index == nullptr) {
+		std::size_t n = 0;
+		for (auto &song : songs) {
+			assert(&song.parent == this);
+
+			if (song.filename == name_utf8)
+				return &song;
+
+			if (++n >= INDEX_THRESHOLD)
+				break;
+		}
+
+		if (n < INDEX_THRESHOLD)
+			return nullptr;
 
-		if (song.filename == name_utf8)
-			return &song;
+		/* this is a large directory: switch to the index
+		   for this and all further lookups */
+		CreateIndex();
 	}
 
-	return nullptr;
+	auto i = index->songs.find(name_utf8);
+	return i != index->songs.end() ? &*i : nullptr;
 }
 
-[[gnu::pure]]
-static bool
-directory_cmp(const Directory &a, const Directory &b) noexcept
+/**
+ * Sort the children and songs of this directory (not recursively).
+ */
+static void
+SortEntries(Directory &directory) noexcept
 {
-	return IcuCollate(a.path, b.path) < 0;
+	SortListByKey(directory.children, [](const Directory &child){
+		return IcuCollateKey(child.path);
+	});
+
+	song_list_sort(directory.songs);
+}
+
+static void
+SortTree(Directory &directory) noexcept
+{
+	SortEntries(directory);
+
+	for (auto &child : directory.children)
+		SortTree(child);
 }
 
 void
@@ -217,11 +319,59 @@ Directory::Sort() noexcept
 {
 	assert(holding_db_lock());
 
-	SortList(children, directory_cmp);
-	song_list_sort(songs);
+	SortTree(*this);
+}
+
+namespace {
 
-	for (auto &child : children)
-		child.Sort();
+class SortJob final : public WorkerPool::Job {
+	Directory &directory;
+
+public:
+	explicit SortJob(Directory &_directory) noexcept
+		:directory(_directory) {}
+
+	/* virtual methods from class WorkerPool::Job */
+	void Run() noexcept override {
+		SortTree(directory);
+	}
+};
+
+}
+
+void
+Directory::Sort(WorkerPool &pool) noexcept
+{
+	assert(holding_db_lock());
+
+	/* sort the top levels in this thread until there are enough
+	   independent subtrees to keep all threads busy */
+	const std::size_t min_jobs = pool.GetThreadCount() * 4;
+
+	std::vector<Directory *> subtrees{this};
+	while (subtrees.size() < min_jobs) {
+		std::vector<Directory *> next;
+		for (auto *directory : subtrees) {
+			SortEntries(*directory);
+
+			for (auto &child : directory->children)
+				next.push_back(&child);
+		}
+
+		if (next.empty())
+			return;
+
+		subtrees = std::move(next);
+	}
+
+	std::vector<std::unique_ptr<SortJob>> jobs;
+	jobs.reserve(subtrees.size());
+
+	for (auto *directory : subtrees)
+		pool.Push(*jobs.emplace_back(std::make_unique<SortJob>(*directory)));
+
+	for (auto &job : jobs)
+		pool.Wait(*job);
 }
 
 void
@@ -10,7 +10,9 @@
 #include "db/PlaylistVector.hxx"
 #include "db/Ptr.hxx"
 #include "util/IntrusiveList.hxx"
+#include "util/IntrusiveHashSet.hxx"
 
+#include <memory>
 #include <string>
 #include <string_view>
 
@@ -34,6 +36,8 @@ static constexpr unsigned DEVICE_CONTAINER = -2;
 static constexpr unsigned DEVICE_PLAYLIST = -3;
 
 class SongFilter;
+class WorkerPool;
+struct DirectoryIndex;
 
 struct Directory : IntrusiveListHook<> {
 	/* Note: the #IntrusiveListHook is protected with the global
@@ -42,6 +46,13 @@ struct Directory : IntrusiveListHook<> {
 
 	using List = IntrusiveList<Directory>;
 
+	/**
+	 * Links this directory into its parent's name index (if it
+	 * has one); unlinked automatically when the directory is
+	 * freed.
+	 */
+	IntrusiveHashSetHook<IntrusiveHookMode::AUTO_UNLINK> index_hook;
+
 	/**
 	 * A doubly linked list of child directories.
 	 *
@@ -81,6 +92,19 @@ struct Directory : IntrusiveListHook<> {
 	 */
 	bool mark;
 
+private:
+	/**
+	 * Hash tables of #children and #songs by name, which replace
+	 * the linear scans of FindChild() and FindSong() in large
+	 * directories.  It is created by these methods as soon as
+	 * they have to scan more than a certain number of entries, and
+	 * from then on, AddSong() and CreateChild() insert into it;
+	 * freed items unlink themselves.
+	 *
+	 * This attribute is protected with the global #db_mutex.
+	 */
+	std::unique_ptr<DirectoryIndex> index;
+
 public:
 	Directory(std::string &&_path_utf8, Directory *_parent) noexcept;
 	~Directory() noexcept;
@@ -139,13 +163,11 @@ public:
 	/**
 	 * Caller must lock the #db_mutex.
 	 */
-	[[gnu::pure]]
-	const Directory *FindChild(std::string_view name) const noexcept;
+	Directory *FindChild(std::string_view name) noexcept;
 
-	[[gnu::pure]]
-	Directory *FindChild(std::string_view name) noexcept {
-		const Directory *cthis = this;
-		return const_cast<Directory *>(cthis->FindChild(name));
+	const Directory *FindChild(std::string_view name) const noexcept {
+		/* the const_cast is only for building the index */
+		return const_cast<Directory *>(this)->FindChild(name);
 	}
 
 	/**
@@ -186,10 +208,8 @@ public:
 	 *
 	 * @param uri the relative URI
 	 */
-	[[gnu::pure]]
 	LookupResult LookupDirectory(std::string_view uri) noexcept;
 
-	[[gnu::pure]]
 	Song *LookupTargetSong(std::string_view target) noexcept;
 
 	[[gnu::pure]]
@@ -241,13 +261,11 @@ public:
 	 *
 	 * Caller must lock the #db_mutex.
 	 */
-	[[gnu::pure]]
-	const Song *FindSong(std::string_view name_utf8) const noexcept;
+	Song *FindSong(std::string_view name_utf8) noexcept;
 
-	[[gnu::pure]]
-	Song *FindSong(std::string_view name_utf8) noexcept {
-		const Directory *cthis = this;
-		return const_cast<Song *>(cthis->FindSong(name_utf8));
+	const Song *FindSong(std::string_view name_utf8) const noexcept {
+		/* the const_cast is only for building the index */
+		return const_cast<Directory *>(this)->FindSong(name_utf8);
 	}
 
 	/**
@@ -283,6 +301,14 @@ public:
 	 */
 	void Sort() noexcept;
 
+	/**
+	 * Like Sort(), but sort independent subtrees in parallel in
+	 * the given #WorkerPool.
+	 *
+	 * Caller must lock the #db_mutex.
+	 */
+	void Sort(WorkerPool &pool) noexcept;
+
 	/**
 	 * Caller must lock #db_mutex.
 	 */
@@ -293,6 +319,9 @@ public:
 
 	[[gnu::pure]]
 	LightDirectory Export() const noexcept;
+
+private:
+	void CreateIndex() noexcept;
 };
 
 #endif
@@ -5,20 +5,32 @@
 #include "Directory.hxx"
 #include "Song.hxx"
 #include "SongSave.hxx"
-#include "song/DetachedSong.hxx"
+#include "SongSort.hxx"
+#include "SaveFilter.hxx"
 #include "PlaylistDatabase.hxx"
+#include "db/DatabaseLock.hxx"
 #include "io/LineReader.hxx"
+#include "io/MemoryLineReader.hxx"
 #include "io/BufferedOutputStream.hxx"
+#include "io/StringOutputStream.hxx"
+#include "thread/OrderedJobQueue.hxx"
 #include "time/ChronoUtil.hxx"
 #include "lib/fmt/RuntimeError.hxx"
+#include "util/DeleteDisposer.hxx"
 #include "util/StringAPI.hxx"
 #include "util/StringCompare.hxx"
 #include "util/CNumberParser.hxx"
 
 #include <fmt/format.h>
 
-#include <set>
+#include <algorithm>
+#include <cassert>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <string>
 #include <string_view>
+#include <vector>
 
 #include <string.h>
 
@@ -61,31 +73,81 @@ ParseTypeString(const char *type) noexcept
 		return 0;
 }
 
-void
-directory_save(BufferedOutputStream &os, const Directory &directory)
+[[gnu::pure]]
+static bool
+HasIncludedSongs(const Directory &directory,
+		 const DatabaseSaveFilter &filter) noexcept
+{
+	for (const auto &song : directory.songs)
+		if (filter.IncludeSong(directory, song))
+			return true;
+
+	return false;
+}
+
+static void
+SaveFilteredSongs(BufferedOutputStream &os, const Directory &directory,
+		  const DatabaseSaveFilter &filter)
 {
-	if (!directory.IsRoot()) {
-		const char *type = DeviceToTypeString(directory.device);
-		if (type != nullptr)
-			os.Fmt(DIRECTORY_TYPE "{}\n", type);
+	std::size_t n = 0;
+	for ([[maybe_unused]] const auto &song : directory.songs)
+		++n;
 
-		if (!IsNegative(directory.mtime))
-			os.Fmt(DIRECTORY_MTIME "{}\n",
-			       std::chrono::system_clock::to_time_t(directory.mtime));
+	/* reserved in advance, because #songs points into it */
+	std::vector<Tag> tags;
+	tags.reserve(n);
 
-		os.Fmt(DIRECTORY_BEGIN "{}\n", directory.GetPath());
-	}
+	std::vector<std::pair<const Song *, const Tag *>> songs;
+	songs.reserve(n);
 
-	for (const auto &child : directory.children) {
-		if (child.IsMount())
+	for (const auto &song : directory.songs) {
+		if (!filter.IncludeSong(directory, song))
 			continue;
 
-		os.Fmt(DIRECTORY_DIR "{}\n", child.GetName());
-		directory_save(os, child);
+		if (auto tag = filter.TransformTag(directory, song)) {
+			tags.emplace_back(std::move(*tag));
+			songs.emplace_back(&song, &tags.back());
+		} else
+			songs.emplace_back(&song, &song.tag);
 	}
 
-	for (const auto &song : directory.songs)
-		song_save(os, song);
+	if (!tags.empty())
+		song_ptr_sort(songs);
+
+	for (const auto &[song, tag] : songs)
+		song_save(os, *song, *tag);
+}
+
+static void
+directory_save_begin(BufferedOutputStream &os, const Directory &directory)
+{
+	const char *type = DeviceToTypeString(directory.device);
+	if (type != nullptr)
+		os.Fmt(DIRECTORY_TYPE "{}\n", type);
+
+	if (!IsNegative(directory.mtime))
+		os.Fmt(DIRECTORY_MTIME "{}\n",
+		       std::chrono::system_clock::to_time_t(directory.mtime));
+
+	os.Fmt(DIRECTORY_BEGIN "{}\n", directory.GetPath());
+}
+
+void
+directory_save_head(BufferedOutputStream &os, const Directory &directory)
+{
+	os.Fmt(DIRECTORY_DIR "{}\n", directory.GetName());
+	directory_save_begin(os, directory);
+}
+
+void
+directory_save_end(BufferedOutputStream &os, const Directory &directory,
+		   const DatabaseSaveFilter *filter)
+{
+	if (filter != nullptr)
+		SaveFilteredSongs(os, directory, *filter);
+	else
+		for (const auto &song : directory.songs)
+			song_save(os, song);
 
 	playlist_vector_save(os, directory.playlists);
 
@@ -93,6 +155,328 @@ directory_save(BufferedOutputStream &os, const Directory &directory)
 		os.Fmt(DIRECTORY_END "{}\n", directory.GetPath());
 }
 
+/**
+ * Shall this child be omitted by directory_save()?
+ */
+[[gnu::pure]]
+static bool
+SkipChild(const Directory &child, const DatabaseSaveFilter *filter) noexcept
+{
+	return filter != nullptr && child.device == DEVICE_CONTAINER &&
+		!HasIncludedSongs(child, *filter);
+}
+
+namespace {
+
+/**
+ * Serializes a part of the tree into a string in a #WorkerPool
+ * thread.
+ */
+class SaveJob final : public WorkerPool::Job {
+public:
+	enum class Part {
+		/**
+		 * The "directory" line and the attributes of a
+		 * directory, up to its "begin" line.
+		 */
+		HEAD,
+
+		/**
+		 * The whole directory, starting with its "directory"
+		 * line.
+		 */
+		SUBTREE,
+
+		/**
+		 * See directory_save_end().
+		 */
+		TAIL,
+	};
+
+private:
+	const Directory &directory;
+	const DatabaseSaveFilter *const filter;
+	const MountSaveFunction save_mount;
+	const Part part;
+
+public:
+	std::string output;
+
+	std::exception_ptr error;
+
+	/**
+	 * Call the "split" function after #output has been
+	 * written?
+	 */
+	bool split_after = false;
+
+	SaveJob(const Directory &_directory,
+		const DatabaseSaveFilter *_filter,
+		MountSaveFunction _save_mount, Part _part) noexcept
+		:directory(_directory), filter(_filter),
+		 save_mount(_save_mount), part(_part) {}
+
+	/* virtual methods from class WorkerPool::Job */
+	void Run() noexcept override {
+		try {
+			StringOutputStream sos;
+			BufferedOutputStream bos{sos};
+
+			switch (part) {
+			case Part::HEAD:
+				directory_save_head(bos, directory);
+				break;
+
+			case Part::SUBTREE:
+				directory_save_child(bos, directory, filter,
+						     save_mount);
+				break;
+
+			case Part::TAIL:
+				directory_save_end(bos, directory, filter);
+				break;
+			}
+
+			bos.Flush();
+			output = std::move(sos).GetValue();
+		} catch (...) {
+			error = std::current_exception();
+		}
+	}
+};
+
+/**
+ * Serializes the tree with a #WorkerPool.  The tree is cut into
+ * independent parts (see #SaveJob), whose output is written in the
+ * original order, so the result is the same as directory_save()
+ * without a pool.  Only a limited number of jobs is kept in flight,
+ * to bound the memory used by their output.
+ */
+class ParallelDirectorySaver {
+	BufferedOutputStream &os;
+	const DatabaseSaveFilter *const filter;
+	const MountSaveFunction save_mount;
+	const std::function<void()> &split;
+
+	const std::size_t max_jobs;
+
+	/**
+	 * Directories with subdirectories at a smaller depth than
+	 * this are cut into several jobs.  The root has depth 0.
+	 */
+	unsigned split_depth = 0;
+
+	OrderedJobQueue<SaveJob> jobs;
+
+public:
+	ParallelDirectorySaver(BufferedOutputStream &_os,
+			       const DatabaseSaveFilter *_filter,
+			       MountSaveFunction _save_mount,
+			       const std::function<void()> &_split,
+			       WorkerPool &pool) noexcept
+		:os(_os), filter(_filter), save_mount(_save_mount),
+		 split(_split),
+		 max_jobs(std::max(pool.GetThreadCount(), 1U) * 4),
+		 jobs(pool, max_jobs) {}
+
+	void Save(const Directory &root) {
+		assert(root.IsRoot());
+
+		split_depth = FindSplitDepth(root, max_jobs);
+
+		SaveChildren(root, 0);
+		Push(root, SaveJob::Part::TAIL);
+		Flush();
+	}
+
+private:
+	/**
+	 * Find the smallest depth with enough directories to keep
+	 * all threads busy.
+	 */
+	[[gnu::pure]]
+	static unsigned FindSplitDepth(const Directory &root,
+				       std::size_t min_jobs) noexcept {
+		std::vector<const Directory *> level{&root};
+		unsigned depth = 0;
+
+		while (true) {
+			std::vector<const Directory *> next;
+			for (const auto *directory : level)
+				for (const auto &child : directory->children)
+					next.push_back(&child);
+
+			if (next.empty())
+				return depth;
+
+			++depth;
+			if (next.size() >= min_jobs)
+				return depth;
+
+			level = std::move(next);
+		}
+	}
+
+	void SaveChildren(const Directory &directory, unsigned depth) {
+		for (const auto &child : directory.children) {
+			if (child.IsMount()) {
+				if (save_mount != nullptr) {
+					/* the mount is written by
+					   this thread, after all
+					   output before it */
+					Flush();
+					save_mount(os, child);
+					if (depth == 0 && split)
+						split();
+				}
+
+				continue;
+			}
+
+			if (SkipChild(child, filter))
+				continue;
+
+			SaveDirectory(child, depth + 1);
+
+			if (depth == 0)
+				jobs.GetNewest().split_after = true;
+		}
+	}
+
+	void SaveDirectory(const Directory &directory, unsigned depth) {
+		if (depth < split_depth && !directory.children.empty()) {
+			Push(directory, SaveJob::Part::HEAD);
+			SaveChildren(directory, depth);
+			Push(directory, SaveJob::Part::TAIL);
+		} else
+			Push(directory, SaveJob::Part::SUBTREE);
+	}
+
+	void Push(const Directory &directory, SaveJob::Part part) {
+		if (jobs.IsFull())
+			Pop();
+
+		jobs.Push(std::make_unique<SaveJob>(directory, filter,
+						    save_mount, part));
+	}
+
+	/**
+	 * Wait for the oldest job and write its output.
+	 */
+	void Pop() {
+		const auto job = jobs.Pop();
+
+		os.Write(std::string_view{job->output});
+
+		if (job->split_after && split)
+			split();
+	}
+
+	void Flush() {
+		while (!jobs.IsEmpty())
+			Pop();
+	}
+};
+
+} // anonymous namespace
+
+void
+directory_save(BufferedOutputStream &os, const Directory &directory,
+	       const DatabaseSaveFilter *filter,
+	       MountSaveFunction save_mount,
+	       const std::function<void()> &split,
+	       WorkerPool *pool)
+{
+	if (pool != nullptr && directory.IsRoot()) {
+		ParallelDirectorySaver saver{os, filter, save_mount, split, *pool};
+		saver.Save(directory);
+		return;
+	}
+
+	if (!directory.IsRoot())
+		directory_save_begin(os, directory);
+
+	for (const auto &child : directory.children) {
+		if (child.IsMount()) {
+			if (save_mount != nullptr) {
+				save_mount(os, child);
+				if (split)
+					split();
+			}
+
+			continue;
+		}
+
+		if (SkipChild(child, filter))
+			continue;
+
+		directory_save_child(os, child, filter, save_mount);
+
+		if (split)
+			split();
+	}
+
+	directory_save_end(os, directory, filter);
+}
+
+void
+directory_save_child(BufferedOutputStream &os, const Directory &directory,
+		     const DatabaseSaveFilter *filter,
+		     MountSaveFunction save_mount)
+{
+	os.Fmt(DIRECTORY_DIR "{}\n", directory.GetName());
+	directory_save(os, directory, filter, save_mount);
+}
+
+void
+directory_save_mount(BufferedOutputStream &os, const Directory &mount,
+		     LineReader &file)
+{
+	const char *line = file.ReadLine();
+	if (line == nullptr)
+		/* empty; it would have been pruned */
+		return;
+
+	const std::string_view prefix = mount.GetPath();
+
+	directory_save_head(os, mount);
+
+	do {
+		/* no song or playlist attribute is called "begin" or
+		   "end", so these prefixes are always the paths of
+		   subdirectories */
+		const char *p;
+		if ((p = StringAfterPrefix(line, DIRECTORY_BEGIN)))
+			os.Fmt(DIRECTORY_BEGIN "{}/{}\n", prefix, p);
+		else if ((p = StringAfterPrefix(line, DIRECTORY_END)))
+			os.Fmt(DIRECTORY_END "{}/{}\n", prefix, p);
+		else {
+			os.Write(std::string_view{line});
+			os.Write('\n');
+		}
+	} while ((line = file.ReadLine()) != nullptr);
+
+	os.Fmt(DIRECTORY_END "{}\n", prefix);
+}
+
+void
+directory_save_checkpoint(BufferedOutputStream &os, const Directory &directory)
+{
+	assert(!directory.IsRoot());
+
+	directory_save_begin(os, directory);
+
+	for (const auto &child : directory.children) {
+		/* real subdirectories have checkpoints of their own */
+		if (!child.IsReallyAFile() || child.IsMount())
+			continue;
+
+		directory_save_child(os, child);
+	}
+
+	directory_save_end(os, directory, nullptr);
+}
+
 static bool
 ParseLine(Directory &directory, const char *line)
 {
@@ -109,25 +493,35 @@ ParseLine(Directory &directory, const char *line)
 	return true;
 }
 
+/**
+ * Parse the attributes of a directory up to its "begin" line, and
+ * then its contents.
+ */
+static void
+directory_load_contents(LineReader &file, Directory &directory)
+{
+	while (true) {
+		const char *line = file.ReadLine();
+		if (line == nullptr)
+			throw std::runtime_error("Unexpected end of file");
+
+		if (StringStartsWith(line, DIRECTORY_BEGIN))
+			break;
+
+		if (!ParseLine(directory, line))
+			throw FmtRuntimeError("Malformed line: {:?}", line);
+	}
+
+	directory_load(file, directory);
+}
+
 static Directory *
 directory_load_subdir(LineReader &file, Directory &parent, std::string_view name)
 {
 	Directory *directory = parent.CreateChild(name);
 
 	try {
-		while (true) {
-			const char *line = file.ReadLine();
-			if (line == nullptr)
-				throw std::runtime_error("Unexpected end of file");
-
-			if (StringStartsWith(line, DIRECTORY_BEGIN))
-				break;
-
-			if (!ParseLine(*directory, line))
-				throw FmtRuntimeError("Malformed line: {:?}", line);
-		}
-
-		directory_load(file, *directory);
+		directory_load_contents(file, *directory);
 	} catch (...) {
 		directory->Delete();
 		throw;
@@ -136,12 +530,121 @@ directory_load_subdir(LineReader &file, Directory &parent, std::string_view name
 	return directory;
 }
 
+namespace {
+
+/**
+ * Loads one subtree from a copy of its lines in a #WorkerPool
+ * thread.  The #Directory has already been created by the thread
+ * which holds the database lock; nobody else touches it until the
+ * job has finished.
+ */
+class LoadSubdirJob final : public WorkerPool::Job {
+	Directory &directory;
+
+public:
+	/**
+	 * The lines of the subtree after the "directory" line,
+	 * each terminated with a newline character.
+	 */
+	std::string lines;
+
+	std::exception_ptr error;
+
+	explicit LoadSubdirJob(Directory &_directory) noexcept
+		:directory(_directory) {}
+
+	/* virtual methods from class WorkerPool::Job */
+	void Run() noexcept override {
+		const ScopeDatabaseLockBorrow borrow;
+
+		try {
+			MemoryLineReader reader{lines};
+			directory_load_contents(reader, directory);
+		} catch (...) {
+			error = std::current_exception();
+		}
+
+		lines = {};
+	}
+};
+
+/**
+ * Submits the subtrees of a directory to a #WorkerPool.  Only a
+ * limited number of jobs is kept in flight, to bound the memory used
+ * by their copies of the input.
+ */
+class ParallelSubdirLoader {
+	OrderedJobQueue<LoadSubdirJob> jobs;
+
+public:
+	explicit ParallelSubdirLoader(WorkerPool &pool) noexcept
+		:jobs(pool, std::max(pool.GetThreadCount(), 1U) * 2) {}
+
+	/**
+	 * Copy the subtree from the input and submit it.
+	 *
+	 * Throws on error (of this subtree or of an earlier one).
+	 */
+	void Load(LineReader &file, Directory &directory) {
+		if (jobs.IsFull())
+			jobs.Pop();
+
+		auto job = std::make_unique<LoadSubdirJob>(directory);
+
+		/* the subtree ends with the "end" line of this
+		   directory; nested "end" lines have longer paths */
+		const std::string_view path = directory.GetPath();
+
+		const char *line;
+		while ((line = file.ReadLine()) != nullptr) {
+			job->lines.append(line);
+			job->lines.push_back('\n');
+
+			const char *p = StringAfterPrefix(line, DIRECTORY_END);
+			if (p != nullptr && p == path)
+				break;
+		}
+
+		jobs.Push(std::move(job));
+	}
+
+	/**
+	 * Wait for all jobs.
+	 *
+	 * Throws the first error.
+	 */
+	void Finish() {
+		while (!jobs.IsEmpty())
+			jobs.Pop();
+	}
+};
+
+} // anonymous namespace
+
+/**
+ * Throws if there are duplicates in the given list of names.
+ */
+static void
+CheckDuplicates(std::vector<std::string_view> &names, const char *what)
+{
+	std::sort(names.begin(), names.end());
+
+	const auto i = std::adjacent_find(names.begin(), names.end());
+	if (i != names.end())
+		throw FmtRuntimeError("Duplicate {} {:?}", what, *i);
+}
+
 void
-directory_load(LineReader &file, Directory &directory)
+directory_load(LineReader &file, Directory &directory, WorkerPool *pool)
 {
-	/* these sets are used to quickly check for duplicates,
-	   avoiding linear lookups */
-	std::set<std::string_view> children, songs;
+	/* the names are collected in flat lists and checked for
+	   duplicates at the end, which is cheaper than inserting
+	   each one into a search tree */
+	std::vector<std::string_view> children, songs;
+
+	std::optional<ParallelSubdirLoader> parallel;
+	if (pool != nullptr)
+		parallel.emplace(*pool);
 
 	const char *line;
 
@@ -149,28 +652,19 @@ directory_load(LineReader &file, Directory &directory)
 	       !StringStartsWith(line, DIRECTORY_END)) {
 		const char *p;
 		if ((p = StringAfterPrefix(line, DIRECTORY_DIR))) {
-			auto *child = directory_load_subdir(file, directory, p);
-
-			const std::string_view name = child->GetName();
-			if (!children.emplace(name).second)
-				throw FmtRuntimeError("Duplicate subdirectory {:?}", name);
+			Directory *child;
+			if (parallel) {
+				child = directory.CreateChild(p);
+				parallel->Load(file, *child);
+			} else
+				child = directory_load_subdir(file, directory, p);
+
+			children.emplace_back(child->GetName());
 		} else if ((p = StringAfterPrefix(line, SONG_BEGIN))) {
-			const char *name = p;
-
-			std::string target;
-			bool in_playlist = false;
-			auto detached_song = song_load(file, name,
-						       &target, &in_playlist);
-
-			auto song = std::make_unique<Song>(std::move(detached_song),
-							   directory);
-			song->target = std::move(target);
-			song->in_playlist = in_playlist;
-
-			if (!songs.emplace(song->filename).second)
-				throw FmtRuntimeError("Duplicate song {:?}",
-						      name);
+			auto song = std::make_unique<Song>(p, directory);
+			song_load(file, *song);
 
+			songs.emplace_back(song->filename);
 			directory.AddSong(std::move(song));
 		} else if ((p = StringAfterPrefix(line, PLAYLIST_META_BEGIN))) {
 			const char *name = p;
@@ -179,4 +673,30 @@ directory_load(LineReader &file, Directory &directory)
 			throw FmtRuntimeError("Malformed line: {:?}", line);
 		}
 	}
+
+	if (parallel)
+		parallel->Finish();
+
+	CheckDuplicates(children, "subdirectory");
+	CheckDuplicates(songs, "song");
+}
+
+void
+directory_load_checkpoint(LineReader &file, Directory &directory)
+{
+	assert(!directory.IsRoot());
+	assert(holding_db_lock());
+
+	directory.songs.clear_and_dispose(DeleteDisposer());
+	directory.playlists.erase(directory.playlists.begin(),
+				  directory.playlists.end());
+	directory.ForEachChildSafe([](Directory &child){
+		if (child.IsReallyAFile() && !child.IsMount())
+			child.Delete();
+	});
+
+	directory.mtime = std::chrono::system_clock::time_point::min();
+	directory.inode = directory.device = 0;
+
+	directory_load_contents(file, directory);
 }
@@ -4,17 +4,114 @@
 #ifndef MPD_DIRECTORY_SAVE_HXX
 #define MPD_DIRECTORY_SAVE_HXX
 
+#include <functional>
+
 struct Directory;
 class LineReader;
 class BufferedOutputStream;
+class DatabaseSaveFilter;
+class WorkerPool;
+
+/**
+ * Writes the contents of a mount point, e.g. by calling
+ * directory_save_mount().
+ */
+using MountSaveFunction = void (*)(BufferedOutputStream &os,
+				   const Directory &mount);
+
+/**
+ * @param filter an optional filter which selects and modifies the
+ * songs to be written
+ * @param save_mount an optional function which writes mount points;
+ * if nullptr, they are omitted
+ * @param split an optional function which is called after each
+ * child of the root directory has been written; the output may be
+ * split into independent parts there
+ * @param pool if not nullptr and this is the root directory, then
+ * subtrees are serialized by this #WorkerPool; the output is the
+ * same
+ */
+void
+directory_save(BufferedOutputStream &os, const Directory &directory,
+	       const DatabaseSaveFilter *filter=nullptr,
+	       MountSaveFunction save_mount=nullptr,
+	       const std::function<void()> &split={},
+	       WorkerPool *pool=nullptr);
+
+/**
+ * Write a directory (not the root) the way its parent's
+ * directory_save() does, i.e. starting with its "directory" line.
+ */
+void
+directory_save_child(BufferedOutputStream &os, const Directory &directory,
+		     const DatabaseSaveFilter *filter=nullptr,
+		     MountSaveFunction save_mount=nullptr);
+
+/**
+ * Write the beginning of a directory (not the root) up to its
+ * "begin" line.  It can be followed by directory_save_child() for
+ * each of its children and must be completed by
+ * directory_save_end().  This writes a directory piece by piece
+ * instead of all at once, e.g. while it is still being updated.
+ */
+void
+directory_save_head(BufferedOutputStream &os, const Directory &directory);
 
+/**
+ * Write the songs, the playlists and the "end" line of a directory
+ * (no "end" line for the root).
+ *
+ * @param filter an optional filter which selects and modifies the
+ * songs to be written
+ */
+void
+directory_save_end(BufferedOutputStream &os, const Directory &directory,
+		   const DatabaseSaveFilter *filter=nullptr);
+
+/**
+ * Write a mount point with the contents of the mounted database,
+ * copied from its file.  Paths are prefixed with the mount point's
+ * path, so the result is the same as if the tree had been saved as
+ * one.  Nothing is written if the mounted database is empty.
+ *
+ * Throws on error.
+ *
+ * @param file the mounted database's file, positioned after its
+ * header
+ */
+void
+directory_save_mount(BufferedOutputStream &os, const Directory &mount,
+		     LineReader &file);
+
+/**
+ * Write a checkpoint of one directory (not the root): its songs,
+ * playlists and virtual children (e.g. the tracks of a container
+ * file), but not its real subdirectories and mount points.
+ */
+void
+directory_save_checkpoint(BufferedOutputStream &os, const Directory &directory);
+
+/**
+ * Throws #std::runtime_error on error.
+ *
+ * @param pool if not nullptr, then the subdirectories of this
+ * directory are parsed by this #WorkerPool (the caller must hold the
+ * database lock); the result is the same
+ */
 void
-directory_save(BufferedOutputStream &os, const Directory &directory);
+directory_load(LineReader &file, Directory &directory,
+	       WorkerPool *pool=nullptr);
 
 /**
+ * Load a checkpoint written by directory_save_checkpoint(),
+ * replacing the attributes, songs, playlists and virtual children of
+ * the given directory.  Its real subdirectories are left alone.
+ *
  * Throws #std::runtime_error on error.
+ *
+ * Caller must lock the #db_mutex.
  */
 void
-directory_load(LineReader &file, Directory &directory);
+directory_load_checkpoint(LineReader &file, Directory &directory);
 
 #endif
@@ -0,0 +1,192 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#include "InternedString.hxx"
+#include "thread/Mutex.hxx"
+#include "util/VarSize.hxx"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <functional>
+#include <memory>
+
+/**
+ * The pool is split into this many shards, each with its own lock
+ * and hash table, so threads interning different strings rarely wait
+ * for each other.
+ */
+static constexpr std::size_t N_SHARDS = 64;
+
+[[gnu::pure]]
+static std::size_t
+HashValue(std::string_view value) noexcept
+{
+	return std::hash<std::string_view>{}(value);
+}
+
+inline
+InternedString::Item::Item(std::string_view _value) noexcept
+	:length(_value.size())
+{
+	*std::copy(_value.begin(), _value.end(), value) = 0;
+}
+
+inline InternedString::Item *
+InternedString::Item::Create(std::string_view value) noexcept
+{
+	Item *dummy;
+	return NewVarSize<Item>(sizeof(dummy->value),
+				value.size() + 1,
+				value);
+}
+
+/**
+ * One shard of the pool: a chained hash table which starts small and
+ * doubles its size whenever it has more items than buckets.
+ */
+class alignas(64) InternedStringShard {
+	using Item = InternedString::Item;
+
+	static constexpr std::size_t INITIAL_BUCKETS = 64;
+
+	Mutex mutex;
+
+	/**
+	 * An array of #n_buckets singly linked lists; #n_buckets is
+	 * zero or a power of two.
+	 */
+	std::unique_ptr<Item *[]> buckets;
+
+	std::size_t n_buckets = 0, n_items = 0;
+
+public:
+	/**
+	 * Obtain a reference to an existing item or create a new
+	 * one.
+	 */
+	Item *Get(std::size_t hash, std::string_view value) noexcept {
+		const std::scoped_lock protect{mutex};
+
+		if (n_buckets > 0)
+			for (auto *i = buckets[GetBucket(hash, n_buckets)];
+			     i != nullptr; i = i->next)
+				if (i->GetValue() == value && TryRef(*i))
+					return i;
+
+		if (n_items >= n_buckets)
+			Grow();
+
+		auto *item = Item::Create(value);
+		auto &bucket = buckets[GetBucket(hash, n_buckets)];
+		item->next = bucket;
+		bucket = item;
+		++n_items;
+		return item;
+	}
+
+	/**
+	 * Remove an item whose reference counter has dropped to zero
+	 * and delete it.
+	 */
+	void Delete(std::size_t hash, Item &item) noexcept {
+		assert(item.ref == 0);
+
+		{
+			const std::scoped_lock protect{mutex};
+
+			Item **p = &buckets[GetBucket(hash, n_buckets)];
+			while (*p != &item) {
+				assert(*p != nullptr);
+				p = &(*p)->next;
+			}
+
+			*p = item.next;
+			--n_items;
+		}
+
+		DeleteVarSize(&item);
+	}
+
+private:
+	/**
+	 * Obtain another reference unless the counter is already at
+	 * zero.
+	 *
+	 * @return true on success
+	 */
+	static bool TryRef(Item &item) noexcept {
+		uint32_t old = item.ref.load(std::memory_order_relaxed);
+		do {
+			if (old == 0)
+				return false;
+		} while (!item.ref.compare_exchange_weak(old, old + 1,
+							 std::memory_order_relaxed));
+		return true;
+	}
+
+	static constexpr std::size_t GetBucket(std::size_t hash,
+					       std::size_t size) noexcept {
+		/* the lower bits have selected the shard already */
+		return hash / N_SHARDS & (size - 1);
+	}
+
+	void Grow() noexcept {
+		const std::size_t new_size = n_buckets > 0
+			? n_buckets * 2
+			: INITIAL_BUCKETS;
+		auto new_buckets = std::make_unique<Item *[]>(new_size);
+
+		for (std::size_t b = 0; b < n_buckets; ++b) {
+			for (auto *i = buckets[b]; i != nullptr;) {
+				auto *next = i->next;
+				auto &bucket = new_buckets[GetBucket(HashValue(i->GetValue()),
+								     new_size)];
+				i->next = bucket;
+				bucket = i;
+				i = next;
+			}
+		}
+
+		buckets = std::move(new_buckets);
+		n_buckets = new_size;
+	}
+};
+
+static constinit std::array<InternedStringShard, N_SHARDS> interned_string_pool;
+
+InternedString::InternedString(std::string_view value) noexcept
+{
+	if (value.empty())
+		return;
+
+	const std::size_t hash = HashValue(value);
+	item = interned_string_pool[hash % N_SHARDS].Get(hash, value);
+}
+
+InternedString::InternedString(const InternedString &src) noexcept
+	:item(src.item)
+{
+	if (item != nullptr) {
+		/* the source holds a reference, so the counter
+		   cannot drop to zero meanwhile */
+		assert(item->ref > 0);
+		item->ref.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+InternedString::~InternedString() noexcept
+{
+	if (item == nullptr)
+		return;
+
+	assert(item->ref > 0);
+
+	if (item->ref.fetch_sub(1, std::memory_order_acq_rel) > 1)
+		return;
+
+	/* this was the last reference; nobody can obtain a new one
+	   because TryRef() refuses zero */
+	const std::size_t hash = HashValue(item->GetValue());
+	interned_string_pool[hash % N_SHARDS].Delete(hash, *item);
+}
@@ -0,0 +1,95 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+
+/**
+ * An immutable string in a global pool which is shared by all equal
+ * strings, like the values in the tag pool.  It is used for the file
+ * names and targets of #Song objects: a pointer instead of a
+ * std::string, and the names which repeat in every CUE sheet and
+ * playlist ("track0001", "../image.flac") are stored only once.  The
+ * empty string is a null pointer.
+ *
+ * This class is thread-safe.
+ */
+class InternedString {
+	struct Item {
+		/**
+		 * The next item in the same hash bucket.
+		 */
+		Item *next = nullptr;
+
+		/**
+		 * The reference counter.  It is modified without
+		 * holding the shard lock, except when it drops to
+		 * zero; an item whose counter is zero is about to be
+		 * deleted and must not be referenced again.
+		 */
+		std::atomic<uint32_t> ref = 1;
+
+		uint32_t length;
+		char value[sizeof(std::size_t)];
+
+		explicit Item(std::string_view _value) noexcept;
+
+		static Item *Create(std::string_view value) noexcept;
+
+		std::string_view GetValue() const noexcept {
+			return {value, length};
+		}
+	};
+
+	friend class InternedStringShard;
+
+	Item *item = nullptr;
+
+public:
+	InternedString() noexcept = default;
+
+	explicit InternedString(std::string_view value) noexcept;
+
+	InternedString(const InternedString &src) noexcept;
+
+	InternedString(InternedString &&src) noexcept
+		:item(std::exchange(src.item, nullptr)) {}
+
+	~InternedString() noexcept;
+
+	InternedString &operator=(const InternedString &src) noexcept {
+		InternedString tmp{src};
+		std::swap(item, tmp.item);
+		return *this;
+	}
+
+	InternedString &operator=(InternedString &&src) noexcept {
+		std::swap(item, src.item);
+		return *this;
+	}
+
+	InternedString &operator=(std::string_view value) noexcept {
+		return *this = InternedString{value};
+	}
+
+	bool empty() const noexcept {
+		return item == nullptr;
+	}
+
+	const char *c_str() const noexcept {
+		return item != nullptr ? item->value : "";
+	}
+
+	operator std::string_view() const noexcept {
+		return item != nullptr ? item->GetValue() : std::string_view{};
+	}
+
+	friend bool operator==(const InternedString &a,
+			       std::string_view b) noexcept {
+		return std::string_view{a} == b;
+	}
+};
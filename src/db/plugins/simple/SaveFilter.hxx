@@ -0,0 +1,42 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#ifndef MPD_DATABASE_SAVE_FILTER_HXX
+#define MPD_DATABASE_SAVE_FILTER_HXX
+
+#include "tag/Tag.hxx"
+
+#include <optional>
+
+struct Directory;
+struct Song;
+
+/**
+ * Selects and modifies the songs written by db_save_internal().  This
+ * allows writing several different databases from one #Directory
+ * tree without modifying it.
+ */
+class DatabaseSaveFilter {
+public:
+	virtual ~DatabaseSaveFilter() noexcept = default;
+
+	/**
+	 * Shall the given song be written?
+	 *
+	 * A #DEVICE_CONTAINER directory without any included songs is
+	 * omitted.
+	 */
+	[[gnu::pure]]
+	virtual bool IncludeSong(const Directory &directory,
+				 const Song &song) const noexcept = 0;
+
+	/**
+	 * Returns a replacement for Song::tag, or std::nullopt to
+	 * write the song's tag unmodified.  Songs with replaced tags
+	 * are sorted again by their new tags.
+	 */
+	virtual std::optional<Tag> TransformTag(const Directory &directory,
+						const Song &song) const = 0;
+};
+
+#endif
@@ -15,43 +15,101 @@
 #include "Directory.hxx"
 #include "Song.hxx"
 #include "DatabaseSave.hxx"
+#include "DatabaseOutput.hxx"
+#include "DatabaseStream.hxx"
+#include "BinaryDatabase.hxx"
 #include "db/DatabaseLock.hxx"
 #include "db/DatabaseError.hxx"
 #include "lib/fmt/PathFormatter.hxx"
+#include "lib/fmt/RuntimeError.hxx"
 #include "lib/zlib/AutoGunzipFileLineReader.hxx"
 #include "io/BufferedOutputStream.hxx"
 #include "io/FileOutputStream.hxx"
 #include "fs/FileInfo.hxx"
 #include "config/Block.hxx"
+#include "config/Parser.hxx"
 #include "fs/FileSystem.hxx"
+#include "thread/WorkerPool.hxx"
 #include "lib/fmt/SystemError.hxx"
 #include "util/CharUtil.hxx"
 #include "util/Domain.hxx"
 #include "util/RecursiveMap.hxx"
+#include "util/StringAPI.hxx"
 #include "Log.hxx"
 
-#ifdef ENABLE_ZLIB
-#include "lib/zlib/GzipOutputStream.hxx"
+#ifdef ENABLE_ZSTD
+#include "lib/zstd/ZstdFileLineReader.hxx"
 #endif
 
 #include <cerrno>
+#include <functional>
 #include <memory>
+#include <stdexcept>
+#include <thread>
 
 static constexpr Domain simple_db_domain("simple_db");
 
+static SimpleDatabase::Compression
+ParseCompression(const char *value)
+{
+	if (StringIsEqual(value, "gzip"))
+#ifdef ENABLE_ZLIB
+		return SimpleDatabase::Compression::GZIP;
+#else
+		throw std::runtime_error("gzip support is disabled");
+#endif
+	else if (StringIsEqual(value, "zstd"))
+#ifdef ENABLE_ZSTD
+		return SimpleDatabase::Compression::ZSTD;
+#else
+		throw std::runtime_error("zstd support is disabled");
+#endif
+
+	/* "yes" means gzip (if available) for compatibility with
+	   older versions */
+#ifdef ENABLE_ZLIB
+	if (ParseBool(value))
+		return SimpleDatabase::Compression::GZIP;
+#else
+	ParseBool(value);
+#endif
+
+	return SimpleDatabase::Compression::NONE;
+}
+
+static SimpleDatabase::Format
+ParseFormat(const char *value)
+{
+	if (StringIsEqual(value, "text"))
+		return SimpleDatabase::Format::TEXT;
+	else if (StringIsEqual(value, "binary"))
+		return SimpleDatabase::Format::BINARY;
+	else
+		throw FmtRuntimeError("Unrecognized database format {:?}",
+				      value);
+}
+
 inline SimpleDatabase::SimpleDatabase(const ConfigBlock &block)
 	:Database(simple_db_plugin),
 	 path(block.GetPath("path")),
 	 cache_path(block.GetPath("cache_directory")),
-#ifdef ENABLE_ZLIB
-	 compress(block.GetBlockValue("compress", true)),
-#endif
-	 hide_playlist_targets(block.GetBlockValue("hide_playlist_targets", true))
+	 compression(ParseCompression(block.GetBlockValue("compress", "yes"))),
+	 hide_playlist_targets(block.GetBlockValue("hide_playlist_targets", true)),
+	 format(ParseFormat(block.GetBlockValue("format", "text")))
 {
 	if (path.IsNull())
 		throw std::runtime_error("No \"path\" parameter specified");
 
 	path_utf8 = path.ToUTF8();
+
+	compress_level = block.GetBlockValue("compress_level", compress_level);
+	if (compress_level < -1 ||
+	    compress_level > (compression == Compression::ZSTD ? 22 : 9))
+		throw FmtRuntimeError("Invalid compress_level {}",
+				      compress_level);
+
+	compress_threads = block.GetBlockValue("compress_threads",
+					       compress_threads);
 }
 
 inline
@@ -66,9 +124,12 @@ SimpleDatabase::SimpleDatabase(AllocatedPath &&_path,
 	 path_utf8(path.ToUTF8()),
 	 cache_path(nullptr),
 #ifdef ENABLE_ZLIB
-	 compress(_compress),
+	 compression(_compress ? Compression::GZIP : Compression::NONE),
+#else
+	 compression(Compression::NONE),
 #endif
-	 hide_playlist_targets(_hide_playlist_targets)
+	 hide_playlist_targets(_hide_playlist_targets),
+	 format(Format::TEXT)
 {
 }
 
@@ -129,25 +190,74 @@ SimpleDatabase::Check() const
 #endif
 }
 
+/**
+ * Create a #WorkerPool with one thread per CPU core.  Returns
+ * nullptr if there is only one core or if the threads cannot be
+ * created; the caller shall then do the work in this thread.
+ */
+static std::unique_ptr<WorkerPool>
+MakeWorkerPool(const char *name) noexcept
+{
+	const unsigned n_threads = std::thread::hardware_concurrency();
+	if (n_threads <= 1)
+		return nullptr;
+
+	try {
+		return std::make_unique<WorkerPool>(n_threads, name);
+	} catch (...) {
+		return nullptr;
+	}
+}
+
 void
 SimpleDatabase::Load()
 {
 	assert(!path.IsNull());
 	assert(root != nullptr);
 
-	AutoGunzipFileLineReader file{path};
+	if (IsBinaryDatabase(path)) {
+		LogDebug(simple_db_domain, "reading binary DB");
+
+		db_load_binary(path, *root);
+	} else {
+		const auto file = OpenFile();
 
-	LogDebug(simple_db_domain, "reading DB");
+		LogDebug(simple_db_domain, "reading DB");
 
-	db_load_internal(file, *root);
+		/* parse the top-level directories using all CPU
+		   cores */
+		const auto pool = MakeWorkerPool("load");
+
+		db_load_internal(*file, *root, false, pool.get());
+	}
 
 	FileInfo fi;
 	if (GetFileInfo(path, fi))
 		mtime = fi.GetModificationTime();
 }
 
+unsigned
+SimpleDatabase::GetCompressThreads() const noexcept
+{
+	return compress_threads > 0
+		? compress_threads
+		: std::thread::hardware_concurrency();
+}
+
+std::unique_ptr<LineReader>
+SimpleDatabase::OpenFile() const
+{
+#ifdef ENABLE_ZSTD
+	if (IsZstdFile(path))
+		return std::make_unique<ZstdFileLineReader>(path,
+							    GetCompressThreads());
+#endif
+
+	return std::make_unique<AutoGunzipFileLineReader>(path);
+}
+
 void
-SimpleDatabase::Open()
+SimpleDatabase::OpenEmpty() noexcept
 {
 	assert(prefixed_light_song == nullptr);
 
@@ -157,6 +267,12 @@ SimpleDatabase::Open()
 #ifndef NDEBUG
 	borrowed_song_count = 0;
 #endif
+}
+
+void
+SimpleDatabase::Open()
+{
+	OpenEmpty();
 
 	try {
 		Load();
@@ -329,6 +445,27 @@ SimpleDatabase::GetStats(const DatabaseSelection &selection) const
 	return ::GetStats(*this, selection);
 }
 
+/**
+ * Sort the whole database, using all CPU cores.
+ */
+static void
+SortTree(Directory &root) noexcept
+{
+	const unsigned n_threads = std::thread::hardware_concurrency();
+	if (n_threads > 1) {
+		try {
+			WorkerPool pool(n_threads, "sort");
+			root.Sort(pool);
+			return;
+		} catch (...) {
+			/* failed to create threads: sort in this
+			   thread */
+		}
+	}
+
+	root.Sort();
+}
+
 void
 SimpleDatabase::Save()
 {
@@ -339,43 +476,91 @@ SimpleDatabase::Save()
 		root->PruneEmpty();
 
 		LogDebug(simple_db_domain, "sorting DB");
-		root->Sort();
+		SortTree(*root);
 	}
 
 	LogDebug(simple_db_domain, "writing DB");
 
-	FileOutputStream fos(path);
-
-	OutputStream *os = &fos;
+	Write(path, format);
 
-#ifdef ENABLE_ZLIB
-	std::unique_ptr<GzipOutputStream> gzip;
-	if (compress) {
-		gzip = std::make_unique<GzipOutputStream>(*os);
-		os = gzip.get();
-	}
-#endif
-
-	BufferedOutputStream bos(*os);
+	FileInfo fi;
+	if (GetFileInfo(path, fi))
+		mtime = fi.GetModificationTime();
+}
 
-	db_save_internal(bos, *root);
+std::unique_ptr<DatabaseStream>
+SimpleDatabase::OpenStream() const
+{
+	if (format == Format::BINARY)
+		throw std::runtime_error("Cannot stream binary databases");
 
-	bos.Flush();
+	return std::make_unique<DatabaseStream>(path, compression,
+						compress_level,
+						GetCompressThreads());
+}
 
-#ifdef ENABLE_ZLIB
-	if (gzip != nullptr) {
-		gzip->Finish();
-		gzip.reset();
-	}
-#endif
+void
+SimpleDatabase::CommitStream(DatabaseStream &stream)
+{
+	assert(root != nullptr);
 
-	fos.Commit();
+	stream.Commit(*root);
 
 	FileInfo fi;
 	if (GetFileInfo(path, fi))
 		mtime = fi.GetModificationTime();
 }
 
+void
+SimpleDatabase::Export(Path export_path, Format export_format,
+		       const DatabaseSaveFilter *filter) const
+{
+	assert(root != nullptr);
+
+	Write(export_path, export_format, filter);
+}
+
+void
+SimpleDatabase::ExportMerged(Path export_path) const
+{
+	assert(root != nullptr);
+
+	Write(export_path, Format::TEXT, nullptr, true);
+}
+
+void
+SimpleDatabase::Write(Path write_path, Format write_format,
+		      const DatabaseSaveFilter *filter,
+		      bool merge_mounts) const
+{
+	if (write_format == Format::BINARY && filter != nullptr)
+		throw std::invalid_argument("Cannot filter binary databases");
+
+	if (write_format == Format::BINARY) {
+		/* never compressed, because it is meant to be
+		   mapped into memory */
+		FileOutputStream fos(write_path);
+		db_save_binary(fos, *root);
+		fos.Commit();
+		return;
+	}
+
+	DatabaseOutput output(write_path, compression, compress_level,
+			      GetCompressThreads());
+
+	/* format the subtrees on all CPU cores */
+	const auto pool = MakeWorkerPool("save");
+
+	if (merge_mounts)
+		db_save_merged(output.GetStream(), *root, output.GetSplit(),
+			       pool.get());
+	else
+		db_save_internal(output.GetStream(), *root, filter,
+				 output.GetSplit(), pool.get());
+
+	output.Commit();
+}
+
 void
 SimpleDatabase::Mount(const char *uri, DatabasePtr db)
 {
@@ -401,6 +586,22 @@ SimpleDatabase::Mount(const char *uri, DatabasePtr db)
 	mnt->mounted_database = std::move(db);
 }
 
+void
+SimpleDatabase::MountShard(const char *uri, DatabasePtr db,
+			   std::chrono::system_clock::time_point _mtime)
+{
+	{
+		const ScopeDatabaseLock protect;
+		if (auto *old = root->FindChild(uri))
+			old->Delete();
+	}
+
+	Mount(uri, std::move(db));
+
+	const ScopeDatabaseLock protect;
+	root->FindChild(uri)->mtime = _mtime;
+}
+
 static constexpr bool
 IsSafeChar(char ch)
 {
@@ -425,7 +626,9 @@ SimpleDatabase::Mount(const char *local_uri, const char *storage_uri)
 
 	const auto name_fs = AllocatedPath::FromUTF8Throw(name);
 
-#ifndef ENABLE_ZLIB
+#ifdef ENABLE_ZLIB
+	const bool compress = compression != Compression::NONE;
+#else
 	constexpr bool compress = false;
 #endif
 	auto db = std::make_unique<SimpleDatabase>(cache_path / name_fs,
@@ -12,6 +12,8 @@
 #include "config.h"
 
 #include <cassert>
+#include <cstdint>
+#include <memory>
 
 struct ConfigBlock;
 struct Directory;
@@ -19,8 +21,46 @@ struct DatabasePlugin;
 class EventLoop;
 class DatabaseListener;
 class PrefixedLightSong;
+class DatabaseSaveFilter;
+class LineReader;
+class DatabaseStream;
 
 class SimpleDatabase : public Database {
+public:
+	/**
+	 * The file format of the database file.
+	 */
+	enum class Format : uint_least8_t {
+		/**
+		 * The classic line-oriented MPD format (optionally
+		 * gzip-compressed).
+		 */
+		TEXT,
+
+		/**
+		 * A memory-mappable binary format, see
+		 * BinaryFormat.hxx.
+		 */
+		BINARY,
+	};
+
+	/**
+	 * The compression of #Format::TEXT files.  Load() detects it
+	 * automatically.
+	 */
+	enum class Compression : uint_least8_t {
+		NONE,
+
+		GZIP,
+
+		/**
+		 * zstd frames with a seek table, see
+		 * #ZstdOutputStream; not supported by MPD.
+		 */
+		ZSTD,
+	};
+
+private:
 	const AllocatedPath path;
 	std::string path_utf8;
 
@@ -48,12 +88,28 @@ class SimpleDatabase : public Database {
 	mutable unsigned borrowed_song_count;
 #endif
 
-#ifdef ENABLE_ZLIB
-	const bool compress;
-#endif
+	const Compression compression;
+
+	/**
+	 * The gzip or zstd compression level; -1 is the library's
+	 * default.
+	 */
+	int compress_level = -1;
+
+	/**
+	 * The number of threads compressing and decompressing the
+	 * database file; 0 means one per CPU core.
+	 */
+	unsigned compress_threads = 0;
 
 	const bool hide_playlist_targets;
 
+	/**
+	 * The format used by Save().  Load() detects the format
+	 * automatically.
+	 */
+	const Format format;
+
 public:
 	SimpleDatabase(const ConfigBlock &block);
 	SimpleDatabase(AllocatedPath &&_path, bool _compress,
@@ -75,8 +131,72 @@ public:
 		return !cache_path.IsNull();
 	}
 
+	/**
+	 * The path of the database file.
+	 */
+	const AllocatedPath &GetPath() const noexcept {
+		return path;
+	}
+
 	void Save();
 
+	/**
+	 * Like Open(), but start with an empty tree instead of
+	 * loading the database file, e.g. before a complete update
+	 * with OpenStream().
+	 */
+	void OpenEmpty() noexcept;
+
+	/**
+	 * Start writing a new database file while the tree is being
+	 * built (see #DatabaseStream), instead of calling Save()
+	 * afterwards.  The old file is replaced by CommitStream().
+	 * Only #Format::TEXT is supported.
+	 *
+	 * Throws on error.
+	 */
+	std::unique_ptr<DatabaseStream> OpenStream() const;
+
+	/**
+	 * Write what is left of the tree to the #DatabaseStream and
+	 * replace the database file.
+	 *
+	 * Throws on error.
+	 */
+	void CommitStream(DatabaseStream &stream);
+
+	/**
+	 * Open the (text) database file for reading, decompressing it
+	 * if necessary.
+	 *
+	 * Throws on error.
+	 */
+	std::unique_ptr<LineReader> OpenFile() const;
+
+	/**
+	 * Write the database to another file, e.g. to convert a
+	 * binary database to the text format which can be read by
+	 * MPD.
+	 *
+	 * Throws on error.
+	 *
+	 * @param filter an optional filter which selects and modifies
+	 * the songs to be written; only supported by #Format::TEXT
+	 */
+	void Export(Path export_path, Format export_format,
+		    const DatabaseSaveFilter *filter=nullptr) const;
+
+	/**
+	 * Like Export() with #Format::TEXT, but include the contents
+	 * of all mounted #SimpleDatabase instances (copied from their
+	 * files, which must be up to date) instead of omitting the
+	 * mount points.  This combines the shards of a sharded scan
+	 * into one database file.
+	 *
+	 * Throws on error.
+	 */
+	void ExportMerged(Path export_path) const;
+
 	/**
 	 * Returns true if there is a valid database file on the disk.
 	 */
@@ -91,6 +211,19 @@ public:
 	[[gnu::nonnull]]
 	void Mount(const char *uri, DatabasePtr db);
 
+	/**
+	 * Mount one shard of a sharded scan (see ExportMerged()).
+	 * Unlike Mount(), this replaces a directory which exists
+	 * already at this path, because it may have been scanned into
+	 * this database before it became a shard.
+	 *
+	 * @param mtime the modification time of the shard's
+	 * directory, which is written by ExportMerged()
+	 */
+	[[gnu::nonnull]]
+	void MountShard(const char *uri, DatabasePtr db,
+			std::chrono::system_clock::time_point mtime);
+
 	/**
 	 * Throws #std::runtime_error on error.
 	 *
@@ -133,6 +266,20 @@ private:
 	 */
 	void Load();
 
+	/**
+	 * The number of threads for compressing and decompressing
+	 * the database file.
+	 */
+	[[gnu::pure]]
+	unsigned GetCompressThreads() const noexcept;
+
+	/**
+	 * Throws on error.
+	 */
+	void Write(Path write_path, Format write_format,
+		   const DatabaseSaveFilter *filter=nullptr,
+		   bool merge_mounts=false) const;
+
 	DatabasePtr LockUmountSteal(const char *uri) noexcept;
 };
 
@@ -38,7 +38,7 @@ std::string
 Song::GetURI() const noexcept
 {
 	if (parent.IsRoot())
-		return filename;
+		return std::string{filename};
 	else {
 		const char *path = parent.GetPath();
 		return PathTraitsUTF8::Build(path, filename);
@@ -48,7 +48,6 @@ Song::GetURI() const noexcept
 /**
  * Path name traversal of a #Directory.
  */
-[[gnu::pure]]
 static const Directory *
 FindTargetDirectory(const Directory &base, std::string_view path) noexcept
 {
@@ -70,7 +69,6 @@ FindTargetDirectory(const Directory &base, std::string_view path) noexcept
 /**
  * Path name traversal of a #Song.
  */
-[[gnu::pure]]
 static const Song *
 FindTargetSong(const Directory &_directory, std::string_view target) noexcept
 {
@@ -4,13 +4,17 @@
 #pragma once
 
 #include "Ptr.hxx"
+#include "CompactTime.hxx"
+#include "InternedString.hxx"
 #include "Chrono.hxx"
 #include "archive/Features.h" // for ENABLE_ARCHIVE
 #include "tag/Tag.hxx"
 #include "pcm/AudioFormat.hxx"
 #include "util/IntrusiveList.hxx"
+#include "util/IntrusiveHashSet.hxx"
 
 #include <string>
+#include <string_view>
 
 struct Directory;
 struct StorageFileInfo;
@@ -18,6 +22,7 @@ class ExportedSong;
 class DetachedSong;
 class Storage;
 class ArchiveFile;
+class TagCache;
 
 /**
  * A song file inside the configured music directory.  Internal
@@ -33,10 +38,16 @@ struct Song : IntrusiveListHook<> {
 	 */
 	Directory &parent;
 
+	/**
+	 * Links this song into the #Directory's name index (if it has
+	 * one); unlinked automatically when the song is freed.
+	 */
+	IntrusiveHashSetHook<IntrusiveHookMode::AUTO_UNLINK> index_hook;
+
 	/**
 	 * The file name.
 	 */
-	std::string filename;
+	InternedString filename;
 
 	/**
 	 * If non-empty, then this object does not describe a file
@@ -45,7 +56,7 @@ struct Song : IntrusiveListHook<> {
 	 * (i.e. with URI scheme) or a URI relative to this object
 	 * (which may begin with one or more "../").
 	 */
-	std::string target;
+	InternedString target;
 
 	Tag tag;
 
@@ -53,15 +64,13 @@ struct Song : IntrusiveListHook<> {
 	 * The time stamp of the last file modification.  A negative
 	 * value means that this is unknown/unavailable.
 	 */
-	std::chrono::system_clock::time_point mtime =
-		std::chrono::system_clock::time_point::min();
+	CompactTime mtime;
 
 	/**
 	 * The time stamp when the file was added. A negative
 	 * value means that this is unknown/unavailable.
 	 */
-	std::chrono::system_clock::time_point added =
-		std::chrono::system_clock::time_point::min();
+	CompactTime added;
 
 	/**
 	 * Start of this sub-song within the file.
@@ -92,9 +101,8 @@ struct Song : IntrusiveListHook<> {
 	 */
 	bool mark;
 
-	template<typename F>
-	Song(F &&_filename, Directory &_parent) noexcept
-		:parent(_parent), filename(std::forward<F>(_filename)) {}
+	Song(std::string_view _filename, Directory &_parent) noexcept
+		:parent(_parent), filename(_filename) {}
 
 	Song(DetachedSong &&other, Directory &_parent) noexcept;
 
@@ -115,19 +123,24 @@ struct Song : IntrusiveListHook<> {
 	 *
 	 * Throws on error.
 	 *
+	 * @param tag_cache an optional cache which is consulted
+	 * before the file is scanned, and which receives the result
 	 * @return the song on success, nullptr if the file was not
 	 * recognized
 	 */
 	static SongPtr LoadFile(Storage &storage, std::string_view name_utf8,
 				const StorageFileInfo &info,
-				Directory &parent);
+				Directory &parent,
+				TagCache *tag_cache=nullptr);
 
 	/**
 	 * Throws on error.
 	 *
+	 * @param tag_cache see LoadFile()
 	 * @return true on success, false if the file was not recognized
 	 */
-	bool UpdateFile(Storage &storage, const StorageFileInfo &info);
+	bool UpdateFile(Storage &storage, const StorageFileInfo &info,
+			TagCache *tag_cache=nullptr);
 
 #ifdef ENABLE_ARCHIVE
 	static SongPtr LoadFromArchive(ArchiveFile &archive,
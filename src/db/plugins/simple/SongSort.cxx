@@ -8,85 +8,112 @@
 #include "util/IntrusiveList.hxx"
 #include "util/SortList.hxx"
 
-#include <stdlib.h>
-
-static int
-compare_utf8_string(const char *a, const char *b) noexcept
-{
-	if (a == nullptr)
-		return b == nullptr ? 0 : -1;
-
-	if (b == nullptr)
-		return 1;
+#include <algorithm>
+#include <compare>
+#include <string>
 
-	return IcuCollate(a, b);
-}
+#include <stdlib.h>
 
 /**
- * Compare two string tag values, ignoring case.  Either one may be
- * nullptr.
+ * Precomputed sort criteria of a #Song; comparing two of these gives
+ * the same result as the original per-comparison code (album, then
+ * disc, then track number, then file name), but collation and number
+ * parsing is done only once per song.
  */
-static int
-compare_string_tag_item(const Tag &a, const Tag &b, TagType type) noexcept
-{
-	return compare_utf8_string(a.GetValue(type),
-				   b.GetValue(type));
-}
+struct SongSortKey {
+	/**
+	 * The collation key of the album name; only valid if
+	 * #has_album is set.  A song without album sorts before all
+	 * songs with album.
+	 */
+	std::string album;
 
-/**
- * Compare two tag values which should contain an integer value
- * (e.g. disc or track number).  Either one may be nullptr.
- */
-static int
-compare_number_string(const char *a, const char *b) noexcept
-{
-	long ai = a == nullptr ? 0 : strtol(a, nullptr, 10);
-	long bi = b == nullptr ? 0 : strtol(b, nullptr, 10);
+	bool has_album;
 
-	if (ai <= 0)
-		return bi <= 0 ? 0 : -1;
+	/**
+	 * The parsed disc/track number; 0 if missing or not
+	 * positive, which sorts before all valid numbers.
+	 */
+	unsigned long disc, track;
 
-	if (bi <= 0)
-		return 1;
+	std::string filename;
 
-	return ai - bi;
-}
+	SongSortKey(const Tag &tag, const char *_filename) noexcept;
 
-static int
-compare_tag_item(const Tag &a, const Tag &b, TagType type) noexcept
-{
-	return compare_number_string(a.GetValue(type),
-				     b.GetValue(type));
-}
+	explicit SongSortKey(const Song &song) noexcept
+		:SongSortKey(song.tag, song.filename.c_str()) {}
 
-/* Only used for sorting/searchin a songvec, not general purpose compares */
-[[gnu::pure]]
-static bool
-song_cmp(const Song &a, const Song &b) noexcept
-{
-	int ret;
+	[[gnu::pure]]
+	auto operator<=>(const SongSortKey &other) const noexcept {
+		if (has_album != other.has_album)
+			return has_album <=> other.has_album;
+
+		if (has_album)
+			if (const auto c = album <=> other.album; c != 0)
+				return c;
+
+		if (const auto c = disc <=> other.disc; c != 0)
+			return c;
 
-	/* first sort by album */
-	ret = compare_string_tag_item(a.tag, b.tag, TAG_ALBUM);
-	if (ret != 0)
-		return ret < 0;
+		if (const auto c = track <=> other.track; c != 0)
+			return c;
 
-	/* then sort by disc */
-	ret = compare_tag_item(a.tag, b.tag, TAG_DISC);
-	if (ret != 0)
-		return ret < 0;
+		return filename <=> other.filename;
+	}
+};
 
-	/* then by track number */
-	ret = compare_tag_item(a.tag, b.tag, TAG_TRACK);
-	if (ret != 0)
-		return ret < 0;
+/**
+ * Parse a tag value which should contain an integer value (e.g. disc
+ * or track number).  It may be nullptr.
+ */
+[[gnu::pure]]
+static unsigned long
+ParseNumberTag(const char *s) noexcept
+{
+	const long i = s == nullptr ? 0 : strtol(s, nullptr, 10);
+	return i > 0 ? i : 0;
+}
 
-	/* still no difference?  compare file name */
-	return IcuCollate(a.filename, b.filename) < 0;
+inline
+SongSortKey::SongSortKey(const Tag &tag, const char *_filename) noexcept
+	:has_album(false),
+	 disc(ParseNumberTag(tag.GetValue(TAG_DISC))),
+	 track(ParseNumberTag(tag.GetValue(TAG_TRACK))),
+	 filename(IcuCollateKey(_filename))
+{
+	if (const char *value = tag.GetValue(TAG_ALBUM)) {
+		album = IcuCollateKey(value);
+		has_album = true;
+	}
 }
 
 void
 song_list_sort(IntrusiveList<Song> &songs) noexcept
 {
-	SortList(songs, song_cmp);
+	SortListByKey(songs, [](const Song &song){
+		return SongSortKey{song};
+	});
+}
+
+void
+song_ptr_sort(std::vector<std::pair<const Song *, const Tag *>> &songs) noexcept
+{
+	std::vector<std::pair<SongSortKey, std::size_t>> keys;
+	keys.reserve(songs.size());
+	for (std::size_t i = 0; i < songs.size(); ++i)
+		keys.emplace_back(SongSortKey{*songs[i].second,
+					      songs[i].first->filename.c_str()},
+				  i);
+
+	std::stable_sort(keys.begin(), keys.end(),
+			 [](const auto &a, const auto &b){
+				 return a.first < b.first;
+			 });
+
+	std::vector<std::pair<const Song *, const Tag *>> sorted;
+	sorted.reserve(songs.size());
+	for (const auto &i : keys)
+		sorted.push_back(songs[i.second]);
+
+	songs = std::move(sorted);
 }
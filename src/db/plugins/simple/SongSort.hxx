@@ -6,9 +6,20 @@
 
 #include "util/IntrusiveList.hxx"
 
+#include <utility>
+#include <vector>
+
 struct Song;
+struct Tag;
 
 void
 song_list_sort(IntrusiveList<Song> &songs) noexcept;
 
+/**
+ * Sort songs by the given tags (which may differ from Song::tag), in
+ * the same order as song_list_sort().
+ */
+void
+song_ptr_sort(std::vector<std::pair<const Song *, const Tag *>> &songs) noexcept;
+
 #endif
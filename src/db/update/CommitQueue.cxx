@@ -0,0 +1,37 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#include "CommitQueue.hxx"
+#include "db/DatabaseLock.hxx"
+#include "db/plugins/simple/Directory.hxx"
+#include "db/plugins/simple/Song.hxx"
+
+#include <cassert>
+
+void
+SongCommitQueue::Push(SongPtr song) noexcept
+{
+	assert(song != nullptr);
+
+	songs.push_back(std::move(song));
+
+	if (songs.size() >= MAX_SIZE)
+		Flush();
+}
+
+void
+SongCommitQueue::Flush() noexcept
+{
+	if (songs.empty())
+		return;
+
+	{
+		const ScopeDatabaseLock protect;
+		for (auto &song : songs) {
+			Directory &directory = song->parent;
+			directory.AddSong(std::move(song));
+		}
+	}
+
+	songs.clear();
+}
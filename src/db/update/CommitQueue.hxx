@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#pragma once
+
+#include "db/plugins/simple/Ptr.hxx"
+
+#include <cassert>
+#include <vector>
+
+/**
+ * Collects new songs found by the update walk and adds them to
+ * their parent directories in batches, so the #db_mutex is locked
+ * once per batch instead of once per file.  Until then, the songs
+ * are invisible to database readers and to Directory::FindSong().
+ *
+ * The owner must call Flush() before anything looks at the song
+ * lists of the affected directories or deletes one of them.
+ *
+ * This class is not thread-safe; it is only used by the update
+ * thread.
+ */
+class SongCommitQueue {
+	/**
+	 * Flush automatically when this many songs are queued.
+	 */
+	static constexpr std::size_t MAX_SIZE = 256;
+
+	std::vector<SongPtr> songs;
+
+public:
+	SongCommitQueue() noexcept = default;
+
+	~SongCommitQueue() noexcept {
+		assert(empty());
+	}
+
+	SongCommitQueue(const SongCommitQueue &) = delete;
+	SongCommitQueue &operator=(const SongCommitQueue &) = delete;
+
+	bool empty() const noexcept {
+		return songs.empty();
+	}
+
+	/**
+	 * Queue a song for Directory::AddSong() on its parent.
+	 */
+	void Push(SongPtr song) noexcept;
+
+	/**
+	 * Add all queued songs to their directories.
+	 */
+	void Flush() noexcept;
+};
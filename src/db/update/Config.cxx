@@ -15,7 +15,21 @@ UpdateConfig::UpdateConfig(const ConfigData &config)
 	follow_outside_symlinks =
 		config.GetBool(ConfigOption::FOLLOW_OUTSIDE_SYMLINKS,
 			       DEFAULT_FOLLOW_OUTSIDE_SYMLINKS);
-#else
-	(void)config;
 #endif
+
+	jobs = config.GetPositive(ConfigOption::UPDATE_JOBS, DEFAULT_JOBS);
+	enumerators = config.GetUnsigned(ConfigOption::UPDATE_ENUMERATORS,
+					 enumerators);
+	uring_depth = config.GetUnsigned(ConfigOption::UPDATE_IO_URING_DEPTH,
+					 uring_depth);
+	trust_mtime = config.GetBool(ConfigOption::UPDATE_TRUST_MTIME,
+				     trust_mtime);
+	negative_cache = config.GetPath(ConfigOption::UPDATE_NEGATIVE_CACHE);
+	negative_cache_rebuild =
+		config.GetBool(ConfigOption::UPDATE_NEGATIVE_CACHE_REBUILD,
+			       negative_cache_rebuild);
+	tag_cache = config.GetPath(ConfigOption::UPDATE_TAG_CACHE);
+	journal = config.GetPath(ConfigOption::UPDATE_JOURNAL);
+	resume = config.GetBool(ConfigOption::UPDATE_RESUME, resume);
+	streaming = config.GetBool(ConfigOption::UPDATE_STREAMING, streaming);
 }
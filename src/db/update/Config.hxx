@@ -4,6 +4,8 @@
 #ifndef MPD_UPDATE_CONFIG_HXX
 #define MPD_UPDATE_CONFIG_HXX
 
+#include "fs/AllocatedPath.hxx"
+
 struct ConfigData;
 
 struct UpdateConfig {
@@ -15,6 +17,78 @@ struct UpdateConfig {
 	bool follow_outside_symlinks = DEFAULT_FOLLOW_OUTSIDE_SYMLINKS;
 #endif
 
+	static constexpr unsigned DEFAULT_JOBS = 1;
+
+	/**
+	 * The number of threads which read song tags.  With 1, all
+	 * files are scanned by the update thread itself.
+	 */
+	unsigned jobs = DEFAULT_JOBS;
+
+	/**
+	 * The number of threads which read directory listings ahead
+	 * of the walk.  With 0, the update thread reads each
+	 * directory when it gets there.
+	 */
+	unsigned enumerators = 0;
+
+	/**
+	 * If non-zero, then directory entries are stat()ed with
+	 * io_uring, with up to this number of requests in flight.
+	 * Ignored if MPD was built without io_uring support.
+	 */
+	unsigned uring_depth = 0;
+
+	/**
+	 * Skip listing directories whose mtime has not changed since
+	 * the last update; only their subdirectories are checked.
+	 * This misses files which were modified in place.
+	 */
+	bool trust_mtime = false;
+
+	/**
+	 * If not "null", then files which were not added to the
+	 * database (unrecognized or filtered) are remembered in this
+	 * file and not read again until they are modified (see
+	 * #NegativeCache).
+	 */
+	AllocatedPath negative_cache = nullptr;
+
+	/**
+	 * Do not load the #negative_cache file; replace it with the
+	 * files excluded by this update.
+	 */
+	bool negative_cache_rebuild = false;
+
+	/**
+	 * If not "null", then the tags of all song files are
+	 * remembered in this file by device, inode, size and mtime,
+	 * and are reused for files which were moved or hard-linked
+	 * (see #TagCache).
+	 */
+	AllocatedPath tag_cache = nullptr;
+
+	/**
+	 * If not "null", then the directories completed by a full
+	 * update are appended to this file, so an interrupted update
+	 * can be resumed (see #UpdateJournal).
+	 */
+	AllocatedPath journal = nullptr;
+
+	/**
+	 * Load the #journal of an interrupted update and skip the
+	 * directories in it which have not been modified since.
+	 */
+	bool resume = false;
+
+	/**
+	 * Write a complete update directly to the database file
+	 * while walking the tree, freeing each directory as soon as
+	 * it has been written (see #DatabaseStream), instead of
+	 * saving the whole tree at the end.
+	 */
+	bool streaming = false;
+
 	explicit UpdateConfig(const ConfigData &config);
 };
 
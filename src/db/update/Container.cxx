@@ -63,7 +63,7 @@ UpdateWalk::UpdateContainerFile(Directory &directory,
 
 				FmtNotice(update_domain, "added {}/{}",
 						contdir->GetPath(),
-						song->filename);
+						song->filename.c_str());
 
 				{
 					const ScopeDatabaseLock protect;
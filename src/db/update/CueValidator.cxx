@@ -3,6 +3,8 @@
 // CUE file validation for database creation
 
 #include "CueValidator.hxx"
+#include "DirectoryListing.hxx"
+#include "decoder/DecoderList.hxx"
 #include "playlist/cue/CueParser.hxx"
 #include "util/Domain.hxx"
 #include "storage/StorageInterface.hxx"
@@ -10,11 +12,7 @@
 #include "input/InputStream.hxx"
 #include "input/TextInputStream.hxx"
 #include "input/WaitReady.hxx"
-#include "fs/Path.hxx"
-#include "fs/AllocatedPath.hxx"
-#include "fs/FileSystem.hxx"
-#include "fs/DirectoryReader.hxx"
-#include "util/StringCompare.hxx"
+#include "fs/Traits.hxx"
 #include "thread/Mutex.hxx"
 #include "Log.hxx"
 #include "lib/fmt/ExceptionFormatter.hxx"
@@ -27,53 +25,25 @@
 
 static constexpr Domain cue_validator_domain("cue_validator");
 
+[[gnu::pure]]
 static bool
 IsSupportedMediaFile(const char *filename) noexcept
 {
-	// Check for common audio file extensions
-	static constexpr const char *extensions[] = {
-		".flac", ".wav", ".ape", ".wv", ".dsf", ".dff", 
-		".mp3", ".mp4", ".m4a", ".aac", ".ogg", ".opus"
-	};
-	
-	for (const char *ext : extensions) {
-		if (StringEndsWithIgnoreCase(filename, ext))
-			return true;
-	}
-	
-	return false;
+	const char *suffix = PathTraitsUTF8::GetFilenameSuffix(filename);
+	return suffix != nullptr && decoder_plugins_supports_suffix(suffix);
 }
 
+[[gnu::pure]]
 static unsigned
-CountMediaFilesInDirectory(Storage &storage, const char *directory_path) noexcept
+CountMediaFiles(const DirectoryListing &listing) noexcept
 {
-	unsigned count = 0;
-	
-	try {
-		// Get directory listing
-		auto dir = storage.OpenDirectory(directory_path);
-		if (!dir)
-			return 0;
-			
-		StorageFileInfo info;
-		const char *name;
-		
-		while ((name = dir->Read()) != nullptr) {
-			if (name[0] == '.')
-				continue; // Skip hidden files
-				
-			info = dir->GetInfo(true);
-			if (info.IsRegular() && IsSupportedMediaFile(name)) {
-				count++;
-			}
-		}
-	} catch (...) {
-		FmtError(cue_validator_domain,
-			 "Error counting media files in {}: {}",
-			 directory_path, std::current_exception());
-	}
-	
-	return count;
+	return std::count_if(listing.entries.begin(), listing.entries.end(),
+			     [](const DirectoryListing::Entry &entry){
+				     return entry.name.front() != '.' && // Skip hidden files
+					     !entry.info_error &&
+					     entry.info.IsRegular() &&
+					     IsSupportedMediaFile(entry.name.c_str());
+			     });
 }
 
 static unsigned
@@ -114,7 +84,8 @@ CountTracksInCueFile(Storage &storage, const char *cue_path) noexcept
 
 bool
 ShouldIgnoreCueFile(Storage &storage, const char *directory_path,
-		    const char *cue_filename) noexcept
+		    const char *cue_filename,
+		    const DirectoryListing &listing) noexcept
 {
 	// Build full path to CUE file
 	std::string cue_path = directory_path;
@@ -132,7 +103,7 @@ ShouldIgnoreCueFile(Storage &storage, const char *directory_path,
 	}
 	
 	// Count media files in directory
-	unsigned media_files = CountMediaFilesInDirectory(storage, directory_path);
+	unsigned media_files = CountMediaFiles(listing);
 	
 	FmtDebug(cue_validator_domain,
 		 "CUE file {} has {} tracks, directory has {} media files",
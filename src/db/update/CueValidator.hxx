@@ -5,6 +5,7 @@
 #pragma once
 
 class Storage;
+struct DirectoryListing;
 
 /**
  * Check if a CUE file should be ignored based on our rules:
@@ -15,8 +16,11 @@ class Storage;
  * @param storage The storage interface
  * @param directory_path Path to the directory containing the CUE file
  * @param cue_filename Name of the CUE file
+ * @param listing A snapshot of the directory containing the CUE file,
+ * which is used to count the media files
  * @return true if the CUE file should be ignored, false if it should be used
  */
 bool
 ShouldIgnoreCueFile(Storage &storage, const char *directory_path,
-		    const char *cue_filename) noexcept;
\ No newline at end of file
+		    const char *cue_filename,
+		    const DirectoryListing &listing) noexcept;
\ No newline at end of file
@@ -0,0 +1,213 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#include "DirectoryListing.hxx"
+#include "storage/StorageInterface.hxx"
+#include "decoder/DecoderList.hxx"
+#include "playlist/PlaylistRegistry.hxx"
+#include "fs/FileSystem.hxx"
+#include "fs/Traits.hxx"
+#include "archive/Features.h" // for ENABLE_ARCHIVE
+#include "io/uring/Features.h" // for HAVE_URING
+
+#ifdef ENABLE_ARCHIVE
+#include "archive/ArchiveList.hxx"
+#endif
+
+#ifdef HAVE_URING
+#include "UringStat.hxx"
+#include "io/UniqueFileDescriptor.hxx"
+#include "Log.hxx"
+
+#include <atomic>
+
+#include <fcntl.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+/**
+ * Does the update walk need the #StorageFileInfo of this regular
+ * file?  This must match UpdateWalk::UpdateRegularFile().
+ */
+[[gnu::pure]]
+static bool
+IsSupportedFile(const char *name_utf8) noexcept
+{
+	const char *suffix = PathTraitsUTF8::GetFilenameSuffix(name_utf8);
+	if (suffix == nullptr)
+		return false;
+
+	return decoder_plugins_supports_suffix(suffix) ||
+#ifdef ENABLE_ARCHIVE
+		archive_plugin_from_suffix(suffix) != nullptr ||
+#endif
+		playlist_suffix_supported(suffix);
+}
+
+#ifdef HAVE_URING
+
+/**
+ * Set after io_uring has failed; from then on, entries are
+ * stat()ed one by one.
+ */
+static std::atomic_bool uring_failed;
+
+/**
+ * Fallback for UringStatEntries() if io_uring is not available.
+ */
+static void
+StatEntries(Storage &storage, std::string_view uri_utf8,
+	    std::span<DirectoryListing::Entry *const> entries) noexcept
+{
+	for (auto *entry : entries) {
+		try {
+			entry->info = storage.GetInfo(PathTraitsUTF8::Build(uri_utf8,
+									    entry->name),
+						      true);
+		} catch (...) {
+			entry->info_error = std::current_exception();
+		}
+	}
+}
+
+#endif
+
+void
+DirectoryListing::Read(Storage &storage, std::string_view uri_utf8,
+		       unsigned uring_depth)
+{
+	const auto reader = storage.OpenDirectory(uri_utf8);
+
+#ifdef HAVE_URING
+	/* io_uring works only with local directories; their entries
+	   are stat()ed in one batch after readdir() has finished */
+	AllocatedPath directory_fs = nullptr;
+	UniqueFileDescriptor directory_fd;
+	std::vector<std::size_t> deferred;
+
+	if (uring_depth > 0 && !uring_failed) {
+		directory_fs = storage.MapFS(uri_utf8);
+		if (!directory_fs.IsNull() &&
+		    !directory_fd.Open(directory_fs.c_str(),
+				       O_PATH|O_DIRECTORY))
+			/* fall back to StorageDirectoryReader::GetInfo() */
+			directory_fs = nullptr;
+	}
+#else
+	(void)uring_depth;
+#endif
+
+	const char *name_utf8;
+	while ((name_utf8 = reader->Read()) != nullptr) {
+		/* we don't look at files with newlines in their
+		   name */
+		if (std::strchr(name_utf8, '\n') != nullptr)
+			continue;
+
+		auto &entry = entries.emplace_back(name_utf8);
+
+		/* if readdir() told us the type, this is not a
+		   symlink, and regular files which will be ignored
+		   anyway don't need to be stat()ed */
+		const auto type = reader->GetType();
+		if (type == StorageFileInfo::Type::REGULAR &&
+		    !IsSupportedFile(name_utf8)) {
+			entry.info = StorageFileInfo{*type};
+			continue;
+		}
+
+#ifndef _WIN32
+		if (!type) {
+			const auto path_fs = storage.MapChildFS(uri_utf8,
+								name_utf8);
+			if (!path_fs.IsNull()) {
+				entry.link_target = ReadLink(path_fs);
+				entry.link_error = entry.link_target.IsNull() &&
+					errno != EINVAL;
+			}
+		}
+#endif
+
+#ifdef HAVE_URING
+		if (directory_fd.IsDefined()) {
+			deferred.push_back(entries.size() - 1);
+			continue;
+		}
+#endif
+
+		try {
+			entry.info = reader->GetInfo(true);
+		} catch (...) {
+			entry.info_error = std::current_exception();
+		}
+	}
+
+#ifdef HAVE_URING
+	if (!deferred.empty()) {
+		std::vector<Entry *> pointers;
+		pointers.reserve(deferred.size());
+		for (const auto i : deferred)
+			pointers.push_back(&entries[i]);
+
+		try {
+			UringStatEntries(directory_fd, directory_fs,
+					 pointers, uring_depth);
+		} catch (...) {
+			if (!uring_failed.exchange(true))
+				LogError(std::current_exception(),
+					 "io_uring statx failed, disabling io_uring");
+			StatEntries(storage, uri_utf8, pointers);
+		}
+	}
+#endif
+}
+
+bool
+DirectoryListing::Contains(std::string_view name) const noexcept
+{
+	return std::any_of(entries.begin(), entries.end(),
+			   [name](const Entry &i){
+				   return i.name == name;
+			   });
+}
+
+void
+DirectoryListingJob::Run() noexcept
+{
+	try {
+		listing.Read(storage, uri, uring_depth);
+	} catch (...) {
+		listing.error = std::current_exception();
+	}
+}
+
+DirectoryPrefetcher::~DirectoryPrefetcher() noexcept
+{
+	for (auto &i : jobs)
+		pool.Wait(*i);
+}
+
+void
+DirectoryPrefetcher::Push(std::string_view name)
+{
+	auto &job = *jobs.emplace_back(std::make_unique<DirectoryListingJob>(storage,
+									    PathTraitsUTF8::Build(parent_uri, name),
+									    name,
+									    uring_depth));
+	pool.Push(job);
+}
+
+std::unique_ptr<DirectoryListingJob>
+DirectoryPrefetcher::Take(std::string_view name) noexcept
+{
+	if (jobs.empty() || jobs.front()->name != name)
+		return nullptr;
+
+	auto job = std::move(jobs.front());
+	jobs.pop_front();
+	pool.Wait(*job);
+	return job;
+}
@@ -0,0 +1,149 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#pragma once
+
+#include "storage/FileInfo.hxx"
+#include "fs/AllocatedPath.hxx"
+#include "thread/WorkerPool.hxx"
+
+#include <deque>
+#include <exception>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class Storage;
+
+/**
+ * A snapshot of a storage directory: the names of all entries with
+ * their #StorageFileInfo.  It can be obtained in a worker thread
+ * (see #DirectoryListingJob), which allows reading the next
+ * directory while the update thread is still busy with the current
+ * one.
+ */
+struct DirectoryListing {
+	struct Entry {
+		std::string name;
+
+		StorageFileInfo info;
+
+		/**
+		 * The error thrown by StorageDirectoryReader::GetInfo();
+		 * if set, then #info is undefined.
+		 */
+		std::exception_ptr info_error;
+
+		/**
+		 * The target of the symlink, or nullptr if this is not
+		 * a symlink (or not a local file).
+		 */
+		AllocatedPath link_target = nullptr;
+
+		/**
+		 * Did ReadLink() fail with an error other than
+		 * "not a symlink"?
+		 */
+		bool link_error = false;
+
+		explicit Entry(std::string_view _name) noexcept
+			:name(_name) {}
+	};
+
+	std::vector<Entry> entries;
+
+	/**
+	 * Set by #DirectoryListingJob if the directory could not be
+	 * opened.
+	 */
+	std::exception_ptr error;
+
+	/**
+	 * Read the directory with the given URI.  Names containing a
+	 * newline are omitted.
+	 *
+	 * Throws on error.
+	 *
+	 * @param uring_depth if non-zero, then the entries of local
+	 * directories are stat()ed in one io_uring batch with up to
+	 * this number of requests in flight
+	 */
+	void Read(Storage &storage, std::string_view uri_utf8,
+		  unsigned uring_depth=0);
+
+	[[gnu::pure]]
+	bool Contains(std::string_view name) const noexcept;
+};
+
+/**
+ * Runs DirectoryListing::Read() in a #WorkerPool thread.
+ */
+class DirectoryListingJob final : public WorkerPool::Job {
+	Storage &storage;
+
+	const std::string uri;
+
+	const unsigned uring_depth;
+
+public:
+	const std::string name;
+
+	DirectoryListing listing;
+
+	DirectoryListingJob(Storage &_storage,
+			    std::string_view _uri, std::string_view _name,
+			    unsigned _uring_depth)
+		:storage(_storage), uri(_uri), uring_depth(_uring_depth),
+		 name(_name) {}
+
+	/* virtual methods from class WorkerPool::Job */
+	void Run() noexcept override;
+};
+
+/**
+ * Reads the listings of subdirectories in a #WorkerPool ahead of
+ * the update walk.  Listings must be taken in the order in which
+ * they were pushed.
+ */
+class DirectoryPrefetcher {
+	WorkerPool &pool;
+
+	Storage &storage;
+
+	const std::string_view parent_uri;
+
+	const unsigned uring_depth;
+
+	std::deque<std::unique_ptr<DirectoryListingJob>> jobs;
+
+public:
+	DirectoryPrefetcher(WorkerPool &_pool, Storage &_storage,
+			    std::string_view _parent_uri,
+			    unsigned _uring_depth) noexcept
+		:pool(_pool), storage(_storage), parent_uri(_parent_uri),
+		 uring_depth(_uring_depth) {}
+
+	/**
+	 * Waits for all pending jobs.
+	 */
+	~DirectoryPrefetcher() noexcept;
+
+	DirectoryPrefetcher(const DirectoryPrefetcher &) = delete;
+	DirectoryPrefetcher &operator=(const DirectoryPrefetcher &) = delete;
+
+	std::size_t size() const noexcept {
+		return jobs.size();
+	}
+
+	/**
+	 * Start reading the subdirectory with the given name.
+	 */
+	void Push(std::string_view name);
+
+	/**
+	 * Wait for the oldest job and return it.  Returns nullptr if
+	 * it does not belong to the given name.
+	 */
+	std::unique_ptr<DirectoryListingJob> Take(std::string_view name) noexcept;
+};
@@ -4,15 +4,15 @@
 
 #include "config.h"
 #include "FilteredSongUpdate.hxx"
+#include "db/plugins/simple/Directory.hxx"
 #include "db/plugins/simple/Song.hxx"
 #include "pcm/AudioFormat.hxx"
+#include "tag/Builder.hxx"
+#include "util/StringCompare.hxx"
 
-// External function to get the channel mode
-enum class ChannelMode {
-	STEREO,
-	MULTICHANNEL,
-	ALL
-};
+#include <string>
+
+#include <string.h>
 
 // Weak symbol allows override in DbMain
 extern "C" __attribute__((weak)) ChannelMode GetChannelMode() noexcept {
@@ -22,10 +22,11 @@ extern "C" __attribute__((weak)) ChannelMode GetChannelMode() noexcept {
 
 
 static bool
-ShouldFilterByChannelCount(const AudioFormat &format) noexcept
+ShouldFilterByChannelCount(ChannelMode mode,
+			   const AudioFormat &format) noexcept
 {
-	auto mode = GetChannelMode();
-	if (mode == ChannelMode::ALL || !format.IsDefined())
+	if (mode == ChannelMode::ALL || mode == ChannelMode::SPLIT ||
+	    !format.IsDefined())
 		return false; // Don't filter if ALL mode or format unknown
 	
 	unsigned channels = format.channels;
@@ -44,27 +45,140 @@ ShouldFilterByChannelCount(const AudioFormat &format) noexcept
 }
 
 
+FilteredSongUpdate::DiscArea
+FilteredSongUpdate::GetDiscArea(const Directory &directory,
+				const Song &song) noexcept
+{
+	if (directory.device != DEVICE_CONTAINER)
+		return DiscArea::NONE;
+
+	const char *name = song.filename.c_str();
+
+	// SACD: "2C_AUDIO__TRACK001.iso" / "MC_AUDIO__TRACK001.iso"
+	if (StringStartsWith(name, "2C_AUDIO__TRACK"))
+		return DiscArea::STEREO;
+	if (StringStartsWith(name, "MC_AUDIO__TRACK"))
+		return DiscArea::MULTICHANNEL;
+
+	// DVD-Audio: "AUDIO_TS__TRACK001S.iso" (S/M/D)
+	const char *p = StringAfterPrefix(name, "AUDIO_TS__TRACK");
+	if (p != nullptr && strlen(p) > 3) {
+		switch (p[3]) {
+		case 'S':
+			return DiscArea::STEREO;
+		case 'M':
+			return DiscArea::MULTICHANNEL;
+		case 'D':
+			return DiscArea::DOWNMIX;
+		}
+	}
+
+	return DiscArea::NONE;
+}
+
 bool
 FilteredSongUpdate::ShouldIncludeSong(Song &song) noexcept
 {
 	auto mode = GetChannelMode();
-	if (mode == ChannelMode::ALL)
+	if (mode == ChannelMode::ALL || mode == ChannelMode::SPLIT)
 		return true; // Keep everything
 	
 	// SACD filtering is now handled in the decoder plugin itself
 	// We only need to filter non-SACD files by channel count
 	
 	// Check actual channel count from audio format (for non-SACD files)
-	if (ShouldFilterByChannelCount(song.audio_format))
+	if (ShouldFilterByChannelCount(mode, song.audio_format))
 		return false;
 	
 	return true;
 }
 
+const char *
+FilteredSongUpdate::GetFilterReason() noexcept
+{
+	switch (GetChannelMode()) {
+	case ChannelMode::STEREO:
+		return "filtered-stereo";
+
+	case ChannelMode::MULTICHANNEL:
+		return "filtered-multichannel";
+
+	case ChannelMode::ALL:
+	case ChannelMode::SPLIT:
+		break;
+	}
+
+	return nullptr;
+}
+
 void
 FilteredSongUpdate::ProcessSongTags(Song &song) noexcept
 {
 	// Tag processing for SACD is now handled directly in the SACD decoder plugin
 	// This function is kept for potential future tag cleanup needs
 	(void)song; // Suppress unused parameter warning
-}
\ No newline at end of file
+}
+
+bool
+FilteredSongUpdate::ChannelSaveFilter::IncludeSong(const Directory &directory,
+						   const Song &song) const noexcept
+{
+	// SACD/DVD-A tracks: the decoder plugins' rules
+	switch (GetDiscArea(directory, song)) {
+	case DiscArea::NONE:
+		break;
+
+	case DiscArea::STEREO:
+	case DiscArea::DOWNMIX:
+		return mode != ChannelMode::MULTICHANNEL;
+
+	case DiscArea::MULTICHANNEL:
+		return mode != ChannelMode::STEREO;
+	}
+
+	// Songs from containers, archives and playlists are never
+	// filtered by the scanner
+	if (directory.IsReallyAFile())
+		return true;
+
+	return !ShouldFilterByChannelCount(mode, song.audio_format);
+}
+
+std::optional<Tag>
+FilteredSongUpdate::ChannelSaveFilter::TransformTag(const Directory &directory,
+						    const Song &song) const
+{
+	if (mode != ChannelMode::ALL)
+		return std::nullopt;
+
+	const char *suffix;
+	switch (GetDiscArea(directory, song)) {
+	case DiscArea::NONE:
+		return std::nullopt;
+
+	case DiscArea::STEREO:
+		suffix = " (Stereo)";
+		break;
+
+	case DiscArea::MULTICHANNEL:
+		suffix = " (Multichannel)";
+		break;
+
+	case DiscArea::DOWNMIX:
+		suffix = " (Downmix)";
+		break;
+	}
+
+	const char *album = song.tag.GetValue(TAG_ALBUM);
+	if (album == nullptr)
+		return std::nullopt;
+
+	// Same as the ALL mode of the decoder plugins
+	std::string new_album(album);
+	new_album += suffix;
+
+	TagBuilder builder(song.tag);
+	builder.RemoveType(TAG_ALBUM);
+	builder.AddItem(TAG_ALBUM, new_album);
+	return builder.Commit();
+}
@@ -4,10 +4,58 @@
 
 #pragma once
 
+#include "db/plugins/simple/SaveFilter.hxx"
+
 struct Song;
+struct Directory;
+
+// Channel mode shared with DbMain and the SACD/DVD-A decoder plugins
+enum class ChannelMode {
+	STEREO,
+	MULTICHANNEL,
+	ALL,
+
+	/**
+	 * Keep all songs and don't decorate album names; the filtering
+	 * and the album suffixes of the other modes are applied when
+	 * the databases are saved (see
+	 * FilteredSongUpdate::ChannelSaveFilter).
+	 */
+	SPLIT,
+};
+
+/**
+ * Returns the channel mode of this process; implemented by DbMain,
+ * with a weak fallback returning #ChannelMode::ALL.
+ */
+extern "C" ChannelMode
+GetChannelMode() noexcept;
 
 namespace FilteredSongUpdate {
 
+/**
+ * The area of a SACD or DVD-Audio track, as encoded in the virtual
+ * file name chosen by its decoder plugin.
+ */
+enum class DiscArea {
+	/**
+	 * Not a SACD or DVD-Audio track.
+	 */
+	NONE,
+
+	STEREO,
+	MULTICHANNEL,
+
+	/**
+	 * A stereo downmix of a multichannel DVD-Audio track.
+	 */
+	DOWNMIX,
+};
+
+[[gnu::pure]]
+DiscArea
+GetDiscArea(const Directory &directory, const Song &song) noexcept;
+
 /**
  * Check if a song should be included based on channel filtering rules.
  * Returns true if the song should be included, false if it should be filtered out.
@@ -15,10 +63,40 @@ namespace FilteredSongUpdate {
 bool
 ShouldIncludeSong(Song &song) noexcept;
 
+/**
+ * Returns a token describing the current channel filter, for
+ * recording songs which were filtered out in the #NegativeCache, or
+ * nullptr if songs are not filtered in this mode.
+ */
+[[gnu::pure]]
+const char *
+GetFilterReason() noexcept;
+
 /**
  * Process song tags to clean up SACD-specific formatting.
  */
 void
 ProcessSongTags(Song &song) noexcept;
 
-} // namespace FilteredSongUpdate
\ No newline at end of file
+/**
+ * Applies the rules of one #ChannelMode to a database scanned with
+ * #ChannelMode::SPLIT: it omits the songs which a scan in that mode
+ * would have filtered out, and in #ChannelMode::ALL, it appends the
+ * area to the album names of SACD and DVD-Audio tracks, like the
+ * decoder plugins do.
+ */
+class ChannelSaveFilter final : public DatabaseSaveFilter {
+	const ChannelMode mode;
+
+public:
+	explicit ChannelSaveFilter(ChannelMode _mode) noexcept
+		:mode(_mode) {}
+
+	bool IncludeSong(const Directory &directory,
+			 const Song &song) const noexcept override;
+
+	std::optional<Tag> TransformTag(const Directory &directory,
+					const Song &song) const override;
+};
+
+} // namespace FilteredSongUpdate
@@ -0,0 +1,137 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#include "Journal.hxx"
+#include "db/plugins/simple/Directory.hxx"
+#include "db/plugins/simple/DirectorySave.hxx"
+#include "io/FileLineReader.hxx"
+#include "io/MemoryLineReader.hxx"
+#include "fs/FileSystem.hxx"
+#include "fs/Path.hxx"
+#include "lib/fmt/RuntimeError.hxx"
+#include "util/CNumberParser.hxx"
+#include "util/IterableSplitString.hxx"
+#include "util/StringCompare.hxx"
+
+#include <fmt/format.h>
+
+#define JOURNAL_FORMAT "journal: "
+#define JOURNAL_CHECKPOINT "checkpoint: "
+#define JOURNAL_END "end: "
+
+static constexpr unsigned JOURNAL_VERSION = 1;
+
+UpdateJournal::UpdateJournal(Path path, bool append)
+	:file(path, append
+	      ? FileOutputStream::Mode::APPEND_EXISTING
+	      : FileOutputStream::Mode::CREATE_VISIBLE),
+	 os(file)
+{
+	if (append)
+		/* terminate the last line if it was cut off; Load()
+		   ignores empty lines between records */
+		os.Write('\n');
+	else
+		os.Fmt(JOURNAL_FORMAT "{}\n", JOURNAL_VERSION);
+}
+
+/**
+ * Look up a directory by its URI, creating the missing ones.
+ */
+static Directory &
+MakeDirectory(Directory &root, std::string_view uri)
+{
+	Directory *directory = &root;
+	for (const std::string_view name : IterableSplitString(uri, '/')) {
+		if (name.empty() || directory->IsMount())
+			throw FmtRuntimeError("Bad checkpoint {:?}", uri);
+
+		directory = directory->MakeChild(name);
+	}
+
+	if (directory == &root || directory->IsMount())
+		throw FmtRuntimeError("Bad checkpoint {:?}", uri);
+
+	return *directory;
+}
+
+static void
+LoadRecord(Directory &root, std::string_view uri, std::string &record,
+	   const UpdateJournal::UriSet &loaded)
+{
+	Directory &directory = MakeDirectory(root, uri);
+
+	MemoryLineReader reader{std::span{record}};
+	directory_load_checkpoint(reader, directory);
+
+	/* the records of all subdirectories which still existed
+	   were written before this one */
+	directory.ForEachChildSafe([&loaded](Directory &child){
+		if (!child.IsMount() && !child.IsReallyAFile() &&
+		    !loaded.contains(child.GetPath()))
+			child.Delete();
+	});
+}
+
+UpdateJournal::UriSet
+UpdateJournal::Load(Path path, Directory &root)
+{
+	UriSet loaded;
+
+	if (!FileExists(path))
+		return loaded;
+
+	FileLineReader file{path};
+
+	char *line = file.ReadLine();
+	const char *p;
+	if (line == nullptr ||
+	    (p = StringAfterPrefix(line, JOURNAL_FORMAT)) == nullptr ||
+	    ParseUnsigned(p) != JOURNAL_VERSION)
+		/* unknown format: start from scratch */
+		return loaded;
+
+	std::string uri, record;
+	bool in_record = false;
+
+	while ((line = file.ReadLine()) != nullptr) {
+		if ((p = StringAfterPrefix(line, JOURNAL_CHECKPOINT))) {
+			/* if a record is still open, it was cut off
+			   and this is the first one of the next
+			   update */
+			uri = p;
+			record.clear();
+			in_record = true;
+			continue;
+		}
+
+		if (!in_record)
+			continue;
+
+		record.append(line);
+		record.push_back('\n');
+
+		if ((p = StringAfterPrefix(line, JOURNAL_END)) &&
+		    uri == p) {
+			LoadRecord(root, uri, record, loaded);
+			loaded.emplace(std::move(uri));
+			in_record = false;
+		}
+	}
+
+	return loaded;
+}
+
+void
+UpdateJournal::Add(const Directory &directory)
+{
+	os.Fmt(JOURNAL_CHECKPOINT "{}\n", directory.GetPath());
+	directory_save_checkpoint(os, directory);
+}
+
+void
+UpdateJournal::Close()
+{
+	os.Flush();
+	file.Commit();
+}
@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#pragma once
+
+#include "io/FileOutputStream.hxx"
+#include "io/BufferedOutputStream.hxx"
+
+#include <set>
+#include <string>
+#include <string_view>
+
+struct Directory;
+class Path;
+
+/**
+ * A file next to the database to which an update appends each
+ * directory as soon as it and all of its subdirectories are
+ * complete.  If the update gets interrupted, the next one can load
+ * the journal into the old database and skip these directories
+ * (unless they have been modified since), instead of starting from
+ * scratch.
+ *
+ * Each record is a checkpoint written by
+ * directory_save_checkpoint(): a directory's songs, playlists and
+ * virtual children, but not its real subdirectories, which have
+ * records of their own before it.  A record which was cut off by
+ * the interruption is ignored.
+ *
+ * This class is not thread-safe; it is only used by the update
+ * thread.
+ */
+class UpdateJournal {
+	FileOutputStream file;
+	BufferedOutputStream os;
+
+public:
+	/**
+	 * The URIs of the directories loaded by Load().
+	 */
+	using UriSet = std::set<std::string, std::less<>>;
+
+	/**
+	 * Open the journal for writing.
+	 *
+	 * Throws on error.
+	 *
+	 * @param append keep the existing records (after Load());
+	 * false starts a new journal
+	 */
+	UpdateJournal(Path path, bool append);
+
+	/**
+	 * Load the records of a journal into the given tree,
+	 * replacing the old contents of these directories.  A missing
+	 * file is not an error.
+	 *
+	 * Throws on error.
+	 *
+	 * Caller must lock the #db_mutex.
+	 *
+	 * @return the URIs of the directories which were loaded
+	 */
+	static UriSet Load(Path path, Directory &root);
+
+	/**
+	 * Append a record for the given directory, whose
+	 * subdirectories have all been added already.
+	 *
+	 * Throws on error.
+	 */
+	void Add(const Directory &directory);
+
+	/**
+	 * Write all buffered records to the file and close it; it
+	 * stays on disk for the next update.
+	 *
+	 * Throws on error.
+	 */
+	void Close();
+};
@@ -0,0 +1,168 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#include "NegativeCache.hxx"
+#include "storage/FileInfo.hxx"
+#include "io/FileLineReader.hxx"
+#include "io/FileOutputStream.hxx"
+#include "io/BufferedOutputStream.hxx"
+#include "fs/FileSystem.hxx"
+#include "fs/Path.hxx"
+#include "lib/fmt/RuntimeError.hxx"
+#include "util/CNumberParser.hxx"
+#include "util/StringCompare.hxx"
+
+#include <fmt/format.h>
+
+#include <cstdlib>
+#include <cstring>
+
+#define NEGATIVE_CACHE_FORMAT "negative_cache: "
+#define NEGATIVE_CACHE_DIRECTORY "directory: "
+
+static constexpr unsigned NEGATIVE_CACHE_VERSION = 1;
+
+void
+NegativeCache::Load(Path path)
+{
+	if (!FileExists(path))
+		return;
+
+	FileLineReader file{path};
+
+	char *line = file.ReadLine();
+	const char *p;
+	if (line == nullptr ||
+	    (p = StringAfterPrefix(line, NEGATIVE_CACHE_FORMAT)) == nullptr ||
+	    ParseUnsigned(p) != NEGATIVE_CACHE_VERSION)
+		/* unknown format: start from scratch */
+		return;
+
+	DirectoryEntries *directory = nullptr;
+
+	while ((line = file.ReadLine()) != nullptr) {
+		if ((p = StringAfterPrefix(line, NEGATIVE_CACHE_DIRECTORY))) {
+			directory = &directories[p];
+			continue;
+		}
+
+		if (directory == nullptr)
+			throw FmtRuntimeError("Malformed line: {:?}", line);
+
+		/* "MTIME SIZE REASON NAME" */
+		char *endptr;
+		const auto mtime = std::strtoll(line, &endptr, 10);
+		if (*endptr != ' ')
+			throw FmtRuntimeError("Malformed line: {:?}", line);
+
+		const auto size = ParseUint64(endptr + 1, &endptr);
+		if (*endptr != ' ')
+			throw FmtRuntimeError("Malformed line: {:?}", line);
+
+		char *reason = endptr + 1;
+		char *space = std::strchr(reason, ' ');
+		if (space == nullptr || space == reason || space[1] == 0)
+			throw FmtRuntimeError("Malformed line: {:?}", line);
+
+		*space = 0;
+		const char *name = space + 1;
+
+		auto &entry = directory->files[name];
+		entry.mtime = std::chrono::system_clock::from_time_t(mtime);
+		entry.size = size;
+		entry.reason = reason;
+	}
+}
+
+void
+NegativeCache::Save(Path path, bool prune) const
+{
+	FileOutputStream fos(path);
+	BufferedOutputStream os(fos);
+
+	os.Fmt(NEGATIVE_CACHE_FORMAT "{}\n", NEGATIVE_CACHE_VERSION);
+
+	for (const auto &[uri, directory] : directories) {
+		if (prune && !directory.visited)
+			continue;
+
+		bool empty = true;
+		for (const auto &[name, entry] : directory.files) {
+			if (directory.visited && !entry.seen)
+				continue;
+
+			if (empty) {
+				os.Fmt(NEGATIVE_CACHE_DIRECTORY "{}\n", uri);
+				empty = false;
+			}
+
+			os.Fmt("{} {} {} {}\n",
+			       std::chrono::system_clock::to_time_t(entry.mtime),
+			       entry.size, entry.reason, name);
+		}
+	}
+
+	os.Flush();
+	fos.Commit();
+}
+
+void
+NegativeCache::VisitDirectory(std::string_view directory) noexcept
+{
+	if (auto i = directories.find(directory); i != directories.end())
+		i->second.visited = true;
+}
+
+void
+NegativeCache::KeepDirectory(std::string_view directory) noexcept
+{
+	if (auto i = directories.find(directory); i != directories.end()) {
+		i->second.visited = true;
+		for (auto &[name, entry] : i->second.files)
+			entry.seen = true;
+	}
+}
+
+const char *
+NegativeCache::Lookup(std::string_view directory, std::string_view name,
+		      const StorageFileInfo &info) noexcept
+{
+	auto d = directories.find(directory);
+	if (d == directories.end())
+		return nullptr;
+
+	auto i = d->second.files.find(name);
+	if (i == d->second.files.end())
+		return nullptr;
+
+	auto &entry = i->second;
+	if (entry.mtime != info.mtime || entry.size != info.size)
+		return nullptr;
+
+	entry.seen = true;
+	return entry.reason.c_str();
+}
+
+void
+NegativeCache::Add(std::string_view directory, std::string_view name,
+		   const StorageFileInfo &info, std::string_view reason) noexcept
+{
+	auto d = directories.find(directory);
+	if (d == directories.end()) {
+		d = directories.emplace(directory, DirectoryEntries{}).first;
+
+		/* a new group has not been loaded from the file, so
+		   there is nothing to drop */
+		d->second.visited = true;
+	}
+
+	auto i = d->second.files.find(name);
+	if (i == d->second.files.end())
+		i = d->second.files.emplace(name, Entry{}).first;
+
+	auto &entry = i->second;
+	entry.mtime = info.mtime;
+	entry.size = info.size;
+	entry.reason = reason;
+	entry.seen = true;
+}
@@ -0,0 +1,103 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+
+struct StorageFileInfo;
+class Path;
+
+/**
+ * Remembers files which were seen by the update but not added to the
+ * database (e.g. unrecognized files or songs removed by the channel
+ * filter), so the next update does not have to read them again as
+ * long as their mtime and size are unchanged.
+ *
+ * It is persisted in a sidecar file next to the database; the
+ * database format itself is left alone, because MPD must still be
+ * able to read it.
+ *
+ * This class is not thread-safe; it is only used by the update
+ * thread.
+ */
+class NegativeCache {
+	struct Entry {
+		std::chrono::system_clock::time_point mtime;
+		uint64_t size;
+
+		/**
+		 * Why was this file excluded?  A short token without
+		 * whitespace, chosen by the caller.
+		 */
+		std::string reason;
+
+		/**
+		 * Was this entry looked up or added during the current
+		 * update?
+		 */
+		bool seen = false;
+	};
+
+	struct DirectoryEntries {
+		std::map<std::string, Entry, std::less<>> files;
+
+		/**
+		 * Has this directory been visited during the current
+		 * update?  Only then, the entries which were not
+		 * "seen" are known to be obsolete.
+		 */
+		bool visited = false;
+	};
+
+	/**
+	 * Keyed by the directory's URI.
+	 */
+	std::map<std::string, DirectoryEntries, std::less<>> directories;
+
+public:
+	/**
+	 * Load a file written by Save().  A missing file is not an
+	 * error.
+	 *
+	 * Throws on error.
+	 */
+	void Load(Path path);
+
+	/**
+	 * Throws on error.
+	 *
+	 * @param prune omit the directories which were not visited by
+	 * the current update (because they do not exist anymore);
+	 * only allowed after a complete update of the whole tree
+	 */
+	void Save(Path path, bool prune) const;
+
+	/**
+	 * The given directory is being listed; all entries of it
+	 * which are not looked up or added until Save() will be
+	 * dropped.
+	 */
+	void VisitDirectory(std::string_view directory) noexcept;
+
+	/**
+	 * The given directory is skipped by the update; keep all of
+	 * its entries.
+	 */
+	void KeepDirectory(std::string_view directory) noexcept;
+
+	/**
+	 * Look up a file.  Returns the reason it was excluded, or
+	 * nullptr if it is not known (or was modified since).
+	 */
+	const char *Lookup(std::string_view directory, std::string_view name,
+			   const StorageFileInfo &info) noexcept;
+
+	void Add(std::string_view directory, std::string_view name,
+		 const StorageFileInfo &info, std::string_view reason) noexcept;
+};
@@ -24,6 +24,8 @@
 
 #include <fmt/core.h>
 
+#include <cstring>
+
 inline void
 UpdateWalk::UpdatePlaylistFile(Directory &directory,
 			       SongEnumerator &contents) noexcept
@@ -44,7 +46,7 @@ UpdateWalk::UpdatePlaylistFile(Directory &directory,
 			/* prepend "../" to relative paths to go from
 			   the virtual directory (DEVICE_PLAYLIST) to
 			   the containing directory */
-			: "../" + db_song->filename;
+			: InternedString{fmt::format("../{}", db_song->filename.c_str())};
 		db_song->filename = fmt::format("track{:04}", ++track);
 
 		{
@@ -99,7 +101,8 @@ UpdateWalk::UpdatePlaylistFile(Directory &parent, std::string_view name,
 bool
 UpdateWalk::UpdatePlaylistFile(Directory &directory,
 			       std::string_view name, std::string_view suffix,
-			       const StorageFileInfo &info) noexcept
+			       const StorageFileInfo &info,
+			       const DirectoryListing *parent_listing) noexcept
 {
 	const auto *const plugin = FindPlaylistPluginBySuffix(suffix);
 	if (plugin == nullptr)
@@ -107,8 +110,26 @@ UpdateWalk::UpdatePlaylistFile(Directory &directory,
 
 	// Check if this is a CUE file that should be ignored
 	if (StringIsEqualIgnoreCase(suffix, "cue")) {
-		if (ShouldIgnoreCueFile(storage, directory.GetPath(), 
-					std::string(name).c_str())) {
+		/* the walk passes the listing it already has; only
+		   single-file updates need to read the directory */
+		DirectoryListing local_listing;
+		if (parent_listing == nullptr) {
+			try {
+				local_listing.Read(storage, directory.GetPath(),
+						   config.uring_depth);
+			} catch (...) {
+				FmtError(update_domain,
+					 "Error counting media files in {}: {}",
+					 directory.GetPath(),
+					 std::current_exception());
+			}
+
+			parent_listing = &local_listing;
+		}
+
+		if (ShouldIgnoreCueFile(storage, directory.GetPath(),
+					std::string(name).c_str(),
+					*parent_listing)) {
 			FmtDebug(update_domain,
 				 "Ignoring CUE file {}/{} based on validation rules",
 				 directory.GetPath(), name);
@@ -137,6 +158,38 @@ UpdateWalk::UpdatePlaylistFile(Directory &directory,
 	return true;
 }
 
+void
+UpdateWalk::PurgeDanglingFromPlaylist(Directory &directory,
+				      bool local) noexcept
+{
+	directory.ForEachSongSafe([&](Song &song){
+		if (song.target.empty() ||
+		    PathTraitsUTF8::IsAbsoluteOrHasScheme(song.target.c_str()))
+			return;
+
+		if (local) {
+			const char *name = StringAfterPrefix(song.target.c_str(),
+							     "../");
+			if (name == nullptr || std::strchr(name, '/') != nullptr)
+				/* the target may be in a directory
+				   which has not been scanned yet */
+				return;
+		}
+
+		Song *target = directory.LookupTargetSong(song.target.c_str());
+		if (target == nullptr) {
+			/* the target does not exist: remove the
+			   virtual song */
+			editor.DeleteSong(directory, &song);
+			modified = true;
+		} else {
+			/* the target exists: mark it (for option
+			   "hide_playlist_targets") */
+			target->in_playlist = true;
+		}
+	});
+}
+
 void
 UpdateWalk::PurgeDanglingFromPlaylists(Directory &directory) noexcept
 {
@@ -149,20 +202,13 @@ UpdateWalk::PurgeDanglingFromPlaylists(Directory &directory) noexcept
 		   representing a playlist file */
 		return;
 
-	directory.ForEachSongSafe([&](Song &song){
-		if (!song.target.empty() &&
-		    !PathTraitsUTF8::IsAbsoluteOrHasScheme(song.target.c_str())) {
-			Song *target = directory.LookupTargetSong(song.target.c_str());
-			if (target == nullptr) {
-				/* the target does not exist: remove
-				   the virtual song */
-				editor.DeleteSong(directory, &song);
-				modified = true;
-			} else {
-				/* the target exists: mark it (for
-				   option "hide_playlist_targets") */
-				target->in_playlist = true;
-			}
-		}
-	});
+	PurgeDanglingFromPlaylist(directory, false);
+}
+
+void
+UpdateWalk::PurgeDanglingFromLocalPlaylists(Directory &directory) noexcept
+{
+	for (Directory &child : directory.children)
+		if (child.IsPlaylist())
+			PurgeDanglingFromPlaylist(child, true);
 }
@@ -8,6 +8,7 @@
 #include "db/DatabaseLock.hxx"
 #include "db/plugins/simple/SimpleDatabasePlugin.hxx"
 #include "db/plugins/simple/Directory.hxx"
+#include "db/plugins/simple/DatabaseStream.hxx"
 #include "storage/CompositeStorage.hxx"
 #include "protocol/Ack.hxx"
 #include "Idle.hxx"
@@ -21,6 +22,26 @@
 #endif
 
 #include <cassert>
+#include <memory>
+
+#ifndef NDEBUG
+
+static void
+LogDatabaseLockStats(const DatabaseLockStats &stats) noexcept
+{
+	using std::chrono::duration_cast;
+	using std::chrono::microseconds;
+	using std::chrono::milliseconds;
+
+	FmtDebug(update_domain,
+		 "db_mutex: {} locks, {} ms waiting, {} ms held, longest {} us",
+		 stats.n_locks,
+		 duration_cast<milliseconds>(stats.wait).count(),
+		 duration_cast<milliseconds>(stats.hold).count(),
+		 duration_cast<microseconds>(stats.max_hold).count());
+}
+
+#endif
 
 UpdateService::UpdateService(const ConfigData &_config,
 			     EventLoop &_loop, SimpleDatabase &_db,
@@ -103,23 +124,63 @@ UpdateService::Task() noexcept
 
 	SetThreadIdlePriority();
 
-	modified = walk->Walk(next.db->GetRoot(), next.path_utf8.c_str(),
-			      next.discard);
+#ifndef NDEBUG
+	db_lock_stats = {};
+#endif
 
-	if (modified || !next.db->FileExists()) {
+	/* a complete rescan can write the database file while
+	   walking, instead of keeping the whole tree until Save() */
+	std::unique_ptr<DatabaseStream> stream;
+	if (config.streaming && next.discard && next.path_utf8.empty()) {
+		try {
+			stream = next.db->OpenStream();
+		} catch (...) {
+			LogError(std::current_exception(),
+				 "Failed to create database");
+		}
+	}
+
+	modified = walk->Walk(next.db->GetRoot(), next.path_utf8.c_str(),
+			      next.discard, stream.get());
+
+	if (stream) {
+		/* if the walk was cancelled, the file is incomplete
+		   and gets discarded */
+		if (!walk->IsCancelled() &&
+		    (modified || !next.db->FileExists())) {
+			try {
+				next.db->CommitStream(*stream);
+			} catch (...) {
+				LogError(std::current_exception(),
+					 "Failed to save database");
+			}
+		}
+	} else if (walk->IsResumable()) {
+		/* the walk has purged what it did not get to; keep
+		   the old database file, and let the next update
+		   resume from the journal */
+		LogNotice(update_domain,
+			  "interrupted; the next update can resume");
+	} else if (modified || !next.db->FileExists()) {
 		try {
 			next.db->Save();
+			walk->RemoveJournal();
 		} catch (...) {
 			LogError(std::current_exception(),
 				 "Failed to save database");
 		}
-	}
+	} else
+		walk->RemoveJournal();
 
 	if (!next.path_utf8.empty())
 		FmtDebug(update_domain, "finished: {}", next.path_utf8);
 	else
 		LogDebug(update_domain, "finished");
 
+#ifndef NDEBUG
+	LogDatabaseLockStats(db_lock_stats);
+#endif
+
 	defer.Schedule();
 }
 
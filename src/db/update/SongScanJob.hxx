@@ -0,0 +1,65 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#pragma once
+
+#include "db/plugins/simple/Ptr.hxx"
+#include "storage/FileInfo.hxx"
+#include "thread/WorkerPool.hxx"
+
+#include <exception>
+#include <string>
+#include <string_view>
+
+struct Directory;
+struct Song;
+class Storage;
+class TagCache;
+
+/**
+ * Reads the tags of one song file in a #WorkerPool thread.  The
+ * result is not attached to the database; that is done by the
+ * update thread (see UpdateWalk::CommitScanJob()).
+ */
+class SongScanJob final : public WorkerPool::Job {
+public:
+	Storage &storage;
+
+	Directory &directory;
+
+	const std::string name;
+
+	const StorageFileInfo info;
+
+	/**
+	 * The existing #Song object which shall be updated, or
+	 * nullptr if this is a new file.
+	 */
+	Song *const song;
+
+	/**
+	 * Passed to Song::LoadFile(); may be nullptr.
+	 */
+	TagCache *const tag_cache;
+
+	/**
+	 * The #Song object loaded by Run(), or nullptr if the file
+	 * was not recognized.
+	 */
+	SongPtr result;
+
+	/**
+	 * The error thrown by Song::LoadFile().
+	 */
+	std::exception_ptr error;
+
+	SongScanJob(Storage &_storage, Directory &_directory,
+		    std::string_view _name, const StorageFileInfo &_info,
+		    Song *_song, TagCache *_tag_cache)
+		:storage(_storage), directory(_directory),
+		 name(_name), info(_info), song(_song),
+		 tag_cache(_tag_cache) {}
+
+	/* virtual methods from class WorkerPool::Job */
+	void Run() noexcept override;
+};
@@ -0,0 +1,197 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#include "TagCache.hxx"
+#include "SongSave.hxx"
+#include "TagSave.hxx"
+#include "song/DetachedSong.hxx"
+#include "storage/FileInfo.hxx"
+#include "io/FileLineReader.hxx"
+#include "io/FileOutputStream.hxx"
+#include "io/BufferedOutputStream.hxx"
+#include "fs/FileSystem.hxx"
+#include "fs/Path.hxx"
+#include "lib/fmt/AudioFormatFormatter.hxx"
+#include "lib/fmt/RuntimeError.hxx"
+#include "util/CNumberParser.hxx"
+#include "util/StringCompare.hxx"
+
+#include <fmt/format.h>
+
+#include <cstdlib>
+
+#define TAG_CACHE_FORMAT "tag_cache: "
+#define TAG_CACHE_FILE "file: "
+#define TAG_CACHE_END "song_end"
+
+static constexpr unsigned TAG_CACHE_VERSION = 1;
+
+std::optional<TagCache::Key>
+TagCache::MakeKey(const StorageFileInfo &info) noexcept
+{
+	if (info.device == 0 && info.inode == 0)
+		return std::nullopt;
+
+	return Key{
+		info.device, info.inode, info.size,
+		std::chrono::system_clock::to_time_t(info.mtime),
+	};
+}
+
+void
+TagCache::Load(Path path)
+{
+	if (!FileExists(path))
+		return;
+
+	FileLineReader file{path};
+
+	char *line = file.ReadLine();
+	const char *p;
+	if (line == nullptr ||
+	    (p = StringAfterPrefix(line, TAG_CACHE_FORMAT)) == nullptr ||
+	    ParseUnsigned(p) != TAG_CACHE_VERSION)
+		/* unknown format: start from scratch */
+		return;
+
+	const std::scoped_lock lock{mutex};
+
+	while ((line = file.ReadLine()) != nullptr) {
+		p = StringAfterPrefix(line, TAG_CACHE_FILE);
+		if (p == nullptr)
+			throw FmtRuntimeError("Malformed line: {:?}", line);
+
+		/* "DEVICE INODE SIZE MTIME" */
+		Key key;
+		char *endptr;
+		key.device = ParseUint64(p, &endptr);
+		if (*endptr != ' ')
+			throw FmtRuntimeError("Malformed line: {:?}", line);
+
+		key.inode = ParseUint64(endptr + 1, &endptr);
+		if (*endptr != ' ')
+			throw FmtRuntimeError("Malformed line: {:?}", line);
+
+		key.size = ParseUint64(endptr + 1, &endptr);
+		if (*endptr != ' ')
+			throw FmtRuntimeError("Malformed line: {:?}", line);
+
+		key.mtime = std::strtoll(endptr + 1, &endptr, 10);
+		if (*endptr != 0)
+			throw FmtRuntimeError("Malformed line: {:?}", line);
+
+		/* the rest of the entry has the same syntax as a song
+		   in the database file */
+		auto song = song_load(file, "");
+
+		auto &entry = entries[key];
+		entry.tag = std::move(song.WritableTag());
+		entry.audio_format = song.GetAudioFormat();
+	}
+}
+
+void
+TagCache::Save(Path path, bool prune) const
+{
+	FileOutputStream fos(path);
+	BufferedOutputStream os(fos);
+
+	os.Fmt(TAG_CACHE_FORMAT "{}\n", TAG_CACHE_VERSION);
+
+	const std::scoped_lock lock{mutex};
+
+	prune = prune && !keep_unseen;
+
+	for (const auto &[key, entry] : entries) {
+		if (prune && !entry.seen)
+			continue;
+
+		os.Fmt(TAG_CACHE_FILE "{} {} {} {}\n",
+		       key.device, key.inode, key.size, key.mtime);
+
+		tag_save(os, entry.tag);
+
+		if (entry.audio_format.IsDefined())
+			os.Fmt("Format: {}\n", entry.audio_format);
+
+		os.Write(TAG_CACHE_END "\n");
+	}
+
+	os.Flush();
+	fos.Commit();
+}
+
+std::optional<TagCache::Item>
+TagCache::Lookup(const StorageFileInfo &info,
+		 Reservation &reservation) noexcept
+{
+	const auto key = MakeKey(info);
+	if (!key)
+		return std::nullopt;
+
+	std::unique_lock lock{mutex};
+
+	/* another thread is scanning the same file (a hard link):
+	   wait for its result */
+	cond.wait(lock, [this, &key]{ return !pending.contains(*key); });
+
+	if (auto i = entries.find(*key); i != entries.end()) {
+		i->second.seen = true;
+		return Item{Tag{i->second.tag}, i->second.audio_format};
+	}
+
+	pending.emplace(*key);
+	reservation.cache = this;
+	reservation.key = *key;
+	return std::nullopt;
+}
+
+void
+TagCache::Reservation::Commit(const Tag &tag,
+			      AudioFormat audio_format) noexcept
+{
+	if (cache == nullptr)
+		return;
+
+	{
+		const std::scoped_lock lock{cache->mutex};
+		auto &entry = cache->entries[key];
+		entry.tag = Tag{tag};
+		entry.audio_format = audio_format;
+		entry.seen = true;
+	}
+
+	cache->Release(key);
+	cache = nullptr;
+}
+
+void
+TagCache::Release(const Key &key) noexcept
+{
+	{
+		const std::scoped_lock lock{mutex};
+		pending.erase(key);
+	}
+
+	cond.notify_all();
+}
+
+void
+TagCache::Keep(const StorageFileInfo &info,
+	       const Tag &tag, AudioFormat audio_format) noexcept
+{
+	const auto key = MakeKey(info);
+	if (!key)
+		return;
+
+	const std::scoped_lock lock{mutex};
+
+	auto [i, inserted] = entries.try_emplace(*key);
+	auto &entry = i->second;
+	if (inserted) {
+		entry.tag = Tag{tag};
+		entry.audio_format = audio_format;
+	}
+
+	entry.seen = true;
+}
@@ -0,0 +1,152 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#pragma once
+
+#include "tag/Tag.hxx"
+#include "pcm/AudioFormat.hxx"
+#include "thread/Mutex.hxx"
+#include "thread/Cond.hxx"
+
+#include <compare>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <set>
+
+struct StorageFileInfo;
+class Path;
+
+/**
+ * Remembers the tags of song files by their identity on disk (device,
+ * inode, size and mtime) instead of their name.  This allows reusing
+ * tags of files which were moved or renamed (e.g. a renamed album
+ * directory), and of hard links to a file which was scanned already.
+ *
+ * It is persisted in a sidecar file next to the database.
+ *
+ * This class is thread-safe; it is used by the #SongScanJob threads.
+ * While one thread scans a file, other threads looking up the same
+ * file wait for the result instead of scanning it again.
+ */
+class TagCache {
+	struct Key {
+		uint64_t device, inode, size;
+		int64_t mtime;
+
+		constexpr auto operator<=>(const Key &) const noexcept = default;
+	};
+
+	struct Entry {
+		Tag tag;
+		AudioFormat audio_format;
+
+		/**
+		 * Was this entry looked up or added during the current
+		 * update?
+		 */
+		bool seen = false;
+	};
+
+	mutable Mutex mutex;
+
+	/**
+	 * Signalled whenever an item is removed from #pending.
+	 */
+	Cond cond;
+
+	std::map<Key, Entry> entries;
+
+	/**
+	 * Files which are currently being scanned by a thread which
+	 * holds a #Reservation.
+	 */
+	std::set<Key> pending;
+
+	/**
+	 * If true, then Save() keeps entries which were not seen by
+	 * the current update, because parts of the tree were not
+	 * looked at (see KeepUnseen()).
+	 */
+	bool keep_unseen = false;
+
+public:
+	struct Item {
+		Tag tag;
+		AudioFormat audio_format;
+	};
+
+	/**
+	 * Obtained by Lookup() on a cache miss: the holder is
+	 * expected to scan the file and pass the result to Commit().
+	 * Until then (or until this object is destroyed), other
+	 * lookups of the same file wait.
+	 */
+	class Reservation {
+		friend class TagCache;
+
+		TagCache *cache = nullptr;
+		Key key;
+
+	public:
+		Reservation() noexcept = default;
+
+		~Reservation() noexcept {
+			if (cache != nullptr)
+				cache->Release(key);
+		}
+
+		Reservation(const Reservation &) = delete;
+		Reservation &operator=(const Reservation &) = delete;
+
+		void Commit(const Tag &tag, AudioFormat audio_format) noexcept;
+	};
+
+	/**
+	 * Load a file written by Save().  A missing file is not an
+	 * error.
+	 *
+	 * Throws on error.
+	 */
+	void Load(Path path);
+
+	/**
+	 * Throws on error.
+	 *
+	 * @param prune omit the entries which were not seen by the
+	 * current update; only allowed after a complete update of the
+	 * whole tree
+	 */
+	void Save(Path path, bool prune) const;
+
+	/**
+	 * Some directories were skipped by this update; Save() must
+	 * not prune unseen entries, because they may belong to songs
+	 * in those directories.
+	 */
+	void KeepUnseen() noexcept {
+		const std::scoped_lock lock{mutex};
+		keep_unseen = true;
+	}
+
+	/**
+	 * Look up a file.  On a miss, @p reservation is armed (unless
+	 * the file's identity is unknown, e.g. on a remote storage),
+	 * and the caller shall scan the file.
+	 */
+	std::optional<Item> Lookup(const StorageFileInfo &info,
+				   Reservation &reservation) noexcept;
+
+	/**
+	 * Add or refresh the entry of an unmodified song which was
+	 * not scanned by this update.
+	 */
+	void Keep(const StorageFileInfo &info,
+		  const Tag &tag, AudioFormat audio_format) noexcept;
+
+private:
+	[[gnu::pure]]
+	static std::optional<Key> MakeKey(const StorageFileInfo &info) noexcept;
+
+	void Release(const Key &key) noexcept;
+};
@@ -2,19 +2,233 @@
 // Copyright The Music Player Daemon Project
 
 #include "Walk.hxx"
+#include "SongScanJob.hxx"
 #include "UpdateIO.hxx"
 #include "UpdateDomain.hxx"
 #include "FilteredSongUpdate.hxx"
+#include "TagCache.hxx"
 #include "lib/fmt/ExceptionFormatter.hxx"
 #include "db/DatabaseLock.hxx"
 #include "db/plugins/simple/Directory.hxx"
 #include "db/plugins/simple/Song.hxx"
 #include "decoder/DecoderList.hxx"
+#include "decoder/DecoderPlugin.hxx"
 #include "storage/FileInfo.hxx"
+#include "fs/Traits.hxx"
+#include "thread/WorkerPool.hxx"
 #include "Log.hxx"
 
+#include <cassert>
+
 #include <unistd.h>
 
+void
+SongScanJob::Run() noexcept
+{
+	try {
+		result = Song::LoadFile(storage, name, info, directory,
+					tag_cache);
+	} catch (...) {
+		error = std::current_exception();
+	}
+}
+
+/**
+ * May this file be handled by a container plugin?
+ */
+[[gnu::pure]]
+static bool
+IsContainerSuffix(std::string_view suffix) noexcept
+{
+	for (unsigned i = 0; decoder_plugins[i] != nullptr; ++i)
+		if (decoder_plugins_enabled[i] &&
+		    decoder_plugins[i]->SupportsContainerSuffix(suffix))
+			return true;
+
+	return false;
+}
+
+void
+UpdateWalk::StartWorkers() noexcept
+{
+	assert(!scan_pool);
+	assert(!list_pool);
+	assert(scan_jobs.empty());
+
+	if (config.jobs > 1) {
+		try {
+			scan_pool = std::make_unique<WorkerPool>(config.jobs,
+								 "scan");
+		} catch (...) {
+			FmtError(update_domain,
+				 "failed to start scanner threads: {}",
+				 std::current_exception());
+		}
+	}
+
+	if (config.enumerators > 0) {
+		try {
+			list_pool = std::make_unique<WorkerPool>(config.enumerators,
+								 "list");
+		} catch (...) {
+			FmtError(update_domain,
+				 "failed to start enumerator threads: {}",
+				 std::current_exception());
+		}
+	}
+}
+
+void
+UpdateWalk::StopWorkers() noexcept
+{
+	list_pool.reset();
+
+	if (scan_pool) {
+		CommitScanJobs(true);
+		scan_pool.reset();
+	}
+}
+
+void
+UpdateWalk::SubmitScanJob(Directory &directory, std::string_view name,
+			  const StorageFileInfo &info, Song *song) noexcept
+{
+	assert(scan_pool);
+
+	/* limit the number of pending jobs (and thus the memory
+	   used by finished jobs waiting for a slow one at the head
+	   of the queue) */
+	const std::size_t max_pending = config.jobs * 16;
+	if (scan_jobs.size() >= max_pending)
+		CommitScanJobs(false);
+
+	while (scan_jobs.size() >= max_pending) {
+		scan_pool->Wait(*scan_jobs.front());
+		CommitScanJob(*scan_jobs.front());
+		scan_jobs.pop_front();
+	}
+
+	if (song != nullptr)
+		/* protect it from PurgeDeletedFromDirectory() until
+		   the job has been committed */
+		song->mark = true;
+
+	auto &job = *scan_jobs.emplace_back(std::make_unique<SongScanJob>(storage, directory,
+									 name, info,
+									 song,
+									 tag_cache.get()));
+	scan_pool->Push(job);
+	++n_submitted_jobs;
+}
+
+void
+UpdateWalk::AddUnrecognized(const Directory &directory, std::string_view name,
+			    const StorageFileInfo &info) noexcept
+{
+	/* a container whose tracks were all filtered out looks
+	   unrecognized, too */
+	const char *filter =
+		IsContainerSuffix(PathTraitsUTF8::GetFilenameSuffix(name))
+		? FilteredSongUpdate::GetFilterReason()
+		: nullptr;
+	AddNegativeCache(directory, name, info,
+			 filter != nullptr ? filter : "unrecognized");
+}
+
+void
+UpdateWalk::CommitScanJob(SongScanJob &job) noexcept
+{
+	Directory &directory = job.directory;
+	const std::string_view name = job.name;
+
+	if (job.error) {
+		FmtError(update_domain,
+			 "error reading file {}/{}: {}",
+			 directory.GetPath(), name, job.error);
+		return;
+	}
+
+	Song *song = job.song;
+	if (song == nullptr) {
+		auto &new_song = job.result;
+		if (!new_song) {
+			FmtDebug(update_domain,
+				 "ignoring unrecognized file {}/{}",
+				 directory.GetPath(), name);
+			AddUnrecognized(directory, name, job.info);
+			return;
+		}
+
+		if (!FilteredSongUpdate::ShouldIncludeSong(*new_song)) {
+			FmtNotice(update_domain,
+				 "filtered out {}/{} due to channel mode",
+				 directory.GetPath(), name);
+			AddNegativeCache(directory, name, job.info,
+					 FilteredSongUpdate::GetFilterReason());
+			return;
+		}
+
+		FilteredSongUpdate::ProcessSongTags(*new_song);
+
+		new_song->mark = true;
+		new_song->added = std::chrono::system_clock::now();
+
+		commit_queue.Push(std::move(new_song));
+
+		modified = true;
+		FmtNotice(update_domain, "added {}/{}",
+			  directory.GetPath(), name);
+		return;
+	}
+
+	modified = true;
+
+	if (!job.result) {
+		FmtDebug(update_domain,
+			 "deleting unrecognized file {}/{}",
+			 directory.GetPath(), name);
+		AddUnrecognized(directory, name, job.info);
+		const ScopeDatabaseLock protect;
+		editor.DeleteSong(directory, song);
+		return;
+	}
+
+	{
+		const ScopeDatabaseLock protect;
+		song->tag = std::move(job.result->tag);
+		song->audio_format = job.result->audio_format;
+		song->mtime = job.result->mtime;
+	}
+
+	if (!FilteredSongUpdate::ShouldIncludeSong(*song)) {
+		FmtDebug(update_domain,
+			 "filtered out updated {}/{} due to channel mode",
+			 directory.GetPath(), name);
+		AddNegativeCache(directory, name, job.info,
+				 FilteredSongUpdate::GetFilterReason());
+		const ScopeDatabaseLock protect;
+		editor.DeleteSong(directory, song);
+		return;
+	}
+
+	FilteredSongUpdate::ProcessSongTags(*song);
+}
+
+void
+UpdateWalk::CommitScanJobs(bool wait) noexcept
+{
+	while (!scan_jobs.empty()) {
+		auto &job = *scan_jobs.front();
+		if (wait)
+			scan_pool->Wait(job);
+		else if (!scan_pool->IsFinished(job))
+			break;
+
+		CommitScanJob(job);
+		scan_jobs.pop_front();
+	}
+}
+
 inline void
 UpdateWalk::UpdateSongFile2(Directory &directory,
 			    std::string_view name, std::string_view suffix,
@@ -26,6 +240,9 @@ try {
 		song = directory.FindSong(name);
 	}
 
+	if (song == nullptr && IsNegativeCached(directory, name, info))
+		return;
+
 	if (!directory_child_access(storage, directory, name, R_OK)) {
 		FmtError(update_domain,
 			 "no read permissions on {}/{}",
@@ -38,16 +255,31 @@ try {
 		return;
 	}
 
+	if (scan_pool &&
+	    (song == nullptr || info.mtime != song->mtime || walk_discard)) {
+		if (song == nullptr)
+			FmtDebug(update_domain, "reading {}/{}",
+				 directory.GetPath(), name);
+		else
+			FmtNotice(update_domain, "updating {}/{}",
+				  directory.GetPath(), name);
+
+		SubmitScanJob(directory, name, info, song);
+		return;
+	}
+
 	if (song == nullptr) {
 		FmtDebug(update_domain, "reading {}/{}",
 			 directory.GetPath(), name);
 
 		auto new_song = Song::LoadFile(storage, name, info,
-					       directory);
+					       directory, tag_cache.get());
 		if (!new_song) {
 			FmtDebug(update_domain,
 				 "ignoring unrecognized file {}/{}",
 				 directory.GetPath(), name);
+
+			AddUnrecognized(directory, name, info);
 			return;
 		}
 
@@ -56,6 +288,8 @@ try {
 			FmtNotice(update_domain,
 				 "filtered out {}/{} due to channel mode",
 				 directory.GetPath(), name);
+			AddNegativeCache(directory, name, info,
+					 FilteredSongUpdate::GetFilterReason());
 			return;
 		}
 
@@ -65,10 +299,7 @@ try {
 		new_song->mark = true;
 		new_song->added = std::chrono::system_clock::now();
 
-		{
-			const ScopeDatabaseLock protect;
-			directory.AddSong(std::move(new_song));
-		}
+		commit_queue.Push(std::move(new_song));
 
 		modified = true;
 		FmtNotice(update_domain, "added {}/{}",
@@ -76,12 +307,14 @@ try {
 	} else if (info.mtime != song->mtime || walk_discard) {
 		FmtNotice(update_domain, "updating {}/{}",
 			  directory.GetPath(), name);
-		if (song->UpdateFile(storage, info)) {
+		if (song->UpdateFile(storage, info, tag_cache.get())) {
 			// Apply channel filtering on update
 			if (!FilteredSongUpdate::ShouldIncludeSong(*song)) {
 				FmtDebug(update_domain,
 					 "filtered out updated {}/{} due to channel mode",
 					 directory.GetPath(), name);
+				AddNegativeCache(directory, name, info,
+						 FilteredSongUpdate::GetFilterReason());
 				// Remove the song from database
 				const ScopeDatabaseLock protect;
 				editor.DeleteSong(directory, song);
@@ -91,15 +324,20 @@ try {
 			// Clean up SACD tags
 			FilteredSongUpdate::ProcessSongTags(*song);
 			song->mark = true;
-		} else
+		} else {
 			FmtDebug(update_domain,
 				 "deleting unrecognized file {}/{}",
 				 directory.GetPath(), name);
+			AddUnrecognized(directory, name, info);
+		}
 
 		modified = true;
 	} else {
 		/* not modified */
 		song->mark = true;
+
+		if (tag_cache)
+			tag_cache->Keep(info, song->tag, song->audio_format);
 	}
 } catch (...) {
 	FmtError(update_domain,
@@ -0,0 +1,149 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#include "UringStat.hxx"
+#include "io/uring/Queue.hxx"
+#include "io/uring/Operation.hxx"
+#include "io/FileDescriptor.hxx"
+#include "lib/fmt/PathFormatter.hxx"
+#include "lib/fmt/SystemError.hxx"
+
+#include <cassert>
+#include <memory>
+
+#include <fcntl.h> // for AT_STATX_SYNC_AS_STAT
+#include <sys/stat.h>
+#include <sys/sysmacros.h> // for makedev()
+
+namespace {
+
+/**
+ * A #Uring::Queue which submits only when asked to, so all requests
+ * for one directory go to the kernel with a single system call.
+ */
+class UringStatQueue final : public Uring::Queue {
+public:
+	explicit UringStatQueue(unsigned entries)
+		:Uring::Queue(entries, 0) {}
+
+	void Flush() {
+		Uring::Queue::Submit();
+	}
+
+	// virtual methods from class Uring::Queue
+	void Submit() override {
+		/* deferred until Flush() */
+	}
+};
+
+class StatxOperation final : public Uring::Operation {
+	DirectoryListing::Entry *entry;
+
+	Path directory_path = nullptr;
+
+	AllocatedPath name_fs = nullptr;
+
+	unsigned *n_pending;
+
+	struct statx stx;
+
+public:
+	void Start(UringStatQueue &queue, FileDescriptor directory_fd,
+		   Path _directory_path, DirectoryListing::Entry &_entry,
+		   unsigned &_n_pending) {
+		entry = &_entry;
+		directory_path = _directory_path;
+		name_fs = AllocatedPath::FromUTF8Throw(entry->name);
+		n_pending = &_n_pending;
+
+		auto &s = queue.RequireSubmitEntry();
+		io_uring_prep_statx(&s, directory_fd.Get(),
+				    name_fs.c_str(),
+				    AT_STATX_SYNC_AS_STAT,
+				    STATX_TYPE|STATX_MODE|STATX_SIZE|STATX_MTIME|STATX_INO,
+				    &stx);
+		queue.Push(s, *this);
+		++*n_pending;
+	}
+
+private:
+	void Apply() noexcept {
+		auto &info = entry->info;
+
+		if (S_ISREG(stx.stx_mode))
+			info.type = StorageFileInfo::Type::REGULAR;
+		else if (S_ISDIR(stx.stx_mode))
+			info.type = StorageFileInfo::Type::DIRECTORY;
+		else
+			info.type = StorageFileInfo::Type::OTHER;
+
+		info.size = stx.stx_size;
+		info.mtime = std::chrono::system_clock::from_time_t(stx.stx_mtime.tv_sec);
+		info.device = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+		info.inode = stx.stx_ino;
+	}
+
+	/* virtual methods from class Uring::Operation */
+	void OnUringCompletion(int res) noexcept override {
+		assert(*n_pending > 0);
+		--*n_pending;
+
+		if (res < 0)
+			entry->info_error =
+				std::make_exception_ptr(FmtErrno(-res,
+								 "Failed to access {}",
+								 directory_path / name_fs));
+		else
+			Apply();
+	}
+};
+
+} // anonymous namespace
+
+static UringStatQueue &
+GetThreadQueue(unsigned depth)
+{
+	thread_local std::unique_ptr<UringStatQueue> queue;
+	if (!queue)
+		queue = std::make_unique<UringStatQueue>(depth);
+	return *queue;
+}
+
+void
+UringStatEntries(FileDescriptor directory_fd, Path directory_path,
+		 std::span<DirectoryListing::Entry *const> entries,
+		 unsigned depth)
+{
+	assert(depth > 0);
+
+	auto &queue = GetThreadQueue(depth);
+
+	const auto operations = std::make_unique<StatxOperation[]>(entries.size());
+	unsigned n_pending = 0;
+
+	auto i = entries.begin();
+	auto o = operations.get();
+
+	try {
+		while (i != entries.end() || n_pending > 0) {
+			for (; i != entries.end() && n_pending < depth; ++i, ++o)
+				o->Start(queue, directory_fd, directory_path,
+					 **i, n_pending);
+
+			queue.Flush();
+
+			if (queue.WaitDispatchOneCompletion())
+				queue.DispatchCompletions();
+		}
+	} catch (...) {
+		/* the kernel may still write to the statx buffers;
+		   wait for it before freeing them */
+		try {
+			queue.Flush();
+		} catch (...) {
+		}
+
+		while (n_pending > 0 && queue.WaitDispatchOneCompletion()) {}
+		throw;
+	}
+}
@@ -0,0 +1,26 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#pragma once
+
+#include "DirectoryListing.hxx"
+
+#include <span>
+
+class FileDescriptor;
+
+/**
+ * Obtain the #StorageFileInfo of the given entries with io_uring
+ * statx() requests relative to the given directory, keeping up to
+ * @depth requests in flight.  Errors for single entries are stored
+ * in DirectoryListing::Entry::info_error.
+ *
+ * Each calling thread has its own io_uring instance, which is
+ * created on the first call.
+ *
+ * Throws if io_uring is not available.
+ */
+void
+UringStatEntries(FileDescriptor directory_fd, Path directory_path,
+		 std::span<DirectoryListing::Entry *const> entries,
+		 unsigned depth);
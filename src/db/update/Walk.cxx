@@ -2,15 +2,23 @@
 // Copyright The Music Player Daemon Project
 
 #include "Walk.hxx"
+#include "SongScanJob.hxx"
 #include "UpdateIO.hxx"
 #include "Editor.hxx"
 #include "UpdateDomain.hxx"
+#include "NegativeCache.hxx"
+#include "TagCache.hxx"
+#include "Journal.hxx"
+#include "FilteredSongUpdate.hxx"
 #include "db/DatabaseLock.hxx"
 #include "db/Uri.hxx"
 #include "db/plugins/simple/Directory.hxx"
 #include "db/plugins/simple/Song.hxx"
+#include "db/plugins/simple/DatabaseStream.hxx"
 #include "storage/StorageInterface.hxx"
 #include "ExcludeList.hxx"
+#include "lib/fmt/ExceptionFormatter.hxx"
+#include "lib/fmt/PathFormatter.hxx"
 #include "fs/AllocatedPath.hxx"
 #include "fs/Traits.hxx"
 #include "fs/FileSystem.hxx"
@@ -18,15 +26,20 @@
 #include "input/InputStream.hxx"
 #include "input/Error.hxx"
 #include "input/WaitReady.hxx"
+#include "lib/icu/Collate.hxx"
+#include "thread/WorkerPool.hxx"
 #include "util/StringCompare.hxx"
 #include "util/StringSplit.hxx"
 #include "util/UriExtract.hxx"
 #include "Log.hxx"
 
+#include <algorithm>
 #include <cassert>
 #include <cerrno>
 #include <exception>
 #include <memory>
+#include <optional>
+#include <vector>
 
 #include <string.h>
 #include <stdlib.h>
@@ -40,6 +53,8 @@ UpdateWalk::UpdateWalk(const UpdateConfig &_config,
 {
 }
 
+UpdateWalk::~UpdateWalk() noexcept = default;
+
 static void
 directory_set_stat(Directory &dir, const StorageFileInfo &info)
 {
@@ -182,7 +197,8 @@ FindAncestorLoop(Storage &storage, Directory *parent,
 inline bool
 UpdateWalk::UpdateRegularFile(Directory &directory,
 			      const char *name,
-			      const StorageFileInfo &info) noexcept
+			      const StorageFileInfo &info,
+			      const DirectoryListing *parent_listing) noexcept
 {
 	const char *suffix = PathTraitsUTF8::GetFilenameSuffix(name);
 	if (suffix == nullptr)
@@ -190,18 +206,21 @@ UpdateWalk::UpdateRegularFile(Directory &directory,
 
 	return UpdateSongFile(directory, name, suffix, info) ||
 		UpdateArchiveFile(directory, name, suffix, info) ||
-		UpdatePlaylistFile(directory, name, suffix, info);
+		UpdatePlaylistFile(directory, name, suffix, info,
+				   parent_listing);
 }
 
 void
 UpdateWalk::UpdateDirectoryChild(Directory &directory,
 				 const ExcludeList &exclude_list,
-				 const char *name, const StorageFileInfo &info) noexcept
+				 const char *name, const StorageFileInfo &info,
+				 const DirectoryListing *parent_listing,
+				 DirectoryListing *listing) noexcept
 try {
 	assert(std::strchr(name, '/') == nullptr);
 
 	if (info.IsRegular()) {
-		UpdateRegularFile(directory, name, info);
+		UpdateRegularFile(directory, name, info, parent_listing);
 	} else if (info.IsDirectory()) {
 		if (FindAncestorLoop(storage, &directory,
 					info.inode, info.device))
@@ -215,7 +234,11 @@ try {
 
 		assert(&directory == subdir->parent);
 
-		if (!UpdateDirectory(*subdir, exclude_list, info))
+		if (subdir->IsMount())
+			/* updated with its own storage and database */
+			return;
+
+		if (!UpdateDirectory(*subdir, exclude_list, info, listing))
 			editor.LockDeleteDirectory(subdir);
 	} else {
 		FmtDebug(update_domain,
@@ -225,14 +248,6 @@ try {
 	LogError(std::current_exception());
 }
 
-/* we don't look at files with newlines in their name */
-[[gnu::pure]]
-static bool
-skip_path(const char *name_utf8) noexcept
-{
-	return std::strchr(name_utf8, '\n') != nullptr;
-}
-
 [[gnu::pure]]
 bool
 UpdateWalk::SkipSymlink(const Directory *directory,
@@ -250,6 +265,40 @@ UpdateWalk::SkipSymlink(const Directory *directory,
 		/* don't skip if this is not a symlink */
 		return errno != EINVAL;
 
+	return SkipSymlinkTarget(directory, target);
+#else
+	/* no symlink checking on WIN32 */
+
+	(void)directory;
+	(void)utf8_name;
+
+	return false;
+#endif
+}
+
+bool
+UpdateWalk::SkipSymlink(const Directory *directory,
+			const DirectoryListing::Entry &entry) const noexcept
+{
+#ifndef _WIN32
+	if (entry.link_target.IsNull())
+		return entry.link_error;
+
+	return SkipSymlinkTarget(directory, entry.link_target);
+#else
+	(void)directory;
+	(void)entry;
+
+	return false;
+#endif
+}
+
+#ifndef _WIN32
+
+bool
+UpdateWalk::SkipSymlinkTarget(const Directory *directory,
+			      Path target) const noexcept
+{
 	if (!config.follow_inside_symlinks &&
 	    !config.follow_outside_symlinks) {
 		/* ignore all symlinks */
@@ -297,15 +346,9 @@ UpdateWalk::SkipSymlink(const Directory *directory,
 	   to a song which is already in the database - skip according
 	   to the follow_inside_symlinks param*/
 	return !config.follow_inside_symlinks;
-#else
-	/* no symlink checking on WIN32 */
-
-	(void)directory;
-	(void)utf8_name;
+}
 
-	return false;
 #endif
-}
 
 static void
 LoadExcludeListOrThrow(Storage &storage, const Directory &directory,
@@ -331,36 +374,194 @@ LoadExcludeListOrLog(Storage &storage, const Directory &directory,
 	}
 }
 
+/**
+ * The key by which Directory::Sort() orders a child of the given
+ * directory.
+ */
+static std::string
+ChildSortKey(const Directory &directory, std::string_view name) noexcept
+{
+	return IcuCollateKey(directory.IsRoot()
+			     ? std::string{name}
+			     : PathTraitsUTF8::Build(directory.GetPath(), name));
+}
+
+/**
+ * Sort a directory listing for the #DatabaseStream: files first,
+ * because they become the virtual children which are written
+ * between the subdirectories, then the subdirectories in the order
+ * of the database file.
+ */
+static void
+SortForStream(const Directory &directory,
+	      std::vector<DirectoryListing::Entry *> &children) noexcept
+{
+	const auto subdirs =
+		std::stable_partition(children.begin(), children.end(),
+				      [](const DirectoryListing::Entry *entry){
+					      return !entry->info.IsDirectory();
+				      });
+
+	std::vector<std::pair<std::string, DirectoryListing::Entry *>> keyed;
+	keyed.reserve(children.end() - subdirs);
+	for (auto i = subdirs; i != children.end(); ++i)
+		keyed.emplace_back(ChildSortKey(directory, (*i)->name), *i);
+
+	std::stable_sort(keyed.begin(), keyed.end(),
+			 [](const auto &a, const auto &b){
+				 return a.first < b.first;
+			 });
+
+	std::transform(keyed.begin(), keyed.end(), subdirs,
+		       [](const auto &i){ return i.second; });
+}
+
+bool
+UpdateWalk::IsResumed(const Directory &directory) const noexcept
+{
+	return !resumed.empty() && resumed.contains(directory.GetPath());
+}
+
+inline bool
+UpdateWalk::IsUnmodifiedDirectory(const Directory &directory,
+				  const StorageFileInfo &info) const noexcept
+{
+	if ((!config.trust_mtime || walk_discard) && !IsResumed(directory))
+		return false;
+
+	if (directory.mtime == std::chrono::system_clock::time_point::min() ||
+	    directory.mtime != info.mtime)
+		/* new or modified */
+		return false;
+
+	/* inode and device numbers are not stored in the database
+	   file, so they can only be compared if they have been
+	   obtained during this process's lifetime */
+	return (directory.inode == 0 && directory.device == 0) ||
+		(directory.inode == info.inode &&
+		 directory.device == info.device);
+}
+
+bool
+UpdateWalk::IsUnmodifiedChild(const Directory &parent,
+			      std::string_view name,
+			      const StorageFileInfo &info) const noexcept
+{
+	if ((!config.trust_mtime || walk_discard) && resumed.empty())
+		return false;
+
+	const ScopeDatabaseLock protect;
+	const Directory *child = parent.FindChild(name);
+	return child != nullptr && IsUnmodifiedDirectory(*child, info);
+}
+
+void
+UpdateWalk::UpdateUnmodifiedDirectory(Directory &directory,
+				      const ExcludeList &exclude_list) noexcept
+{
+	FmtDebug(update_domain, "skipping unmodified directory {}",
+		 directory.GetPath());
+
+	if (negative_cache)
+		negative_cache->KeepDirectory(directory.GetPath());
+
+	if (tag_cache)
+		/* the songs of this directory are not looked at */
+		tag_cache->KeepUnseen();
+
+	/* the .mpdignore file may have been edited in place; this
+	   removes the songs and subdirectories which match it now,
+	   and its patterns apply to subdirectories */
+	ExcludeList child_exclude_list(exclude_list);
+	LoadExcludeListOrLog(storage, directory, child_exclude_list);
+
+	if (!child_exclude_list.IsEmpty())
+		RemoveExcludedFromDirectory(directory, child_exclude_list);
+
+	for (auto &i : directory.songs)
+		i.mark = true;
+
+	for (auto &i : directory.playlists)
+		i.mark = true;
+
+	directory.ForEachChildSafe([&](Directory &child){
+		child.mark = true;
+
+		if (cancel || child.IsMount() || child.IsReallyAFile())
+			return;
+
+		StorageFileInfo child_info;
+		if (!GetInfo(storage, child.GetPath(), child_info) ||
+		    !child_info.IsDirectory() ||
+		    !UpdateDirectory(child, child_exclude_list, child_info,
+				     nullptr)) {
+			editor.LockDeleteDirectory(&child);
+			modified = true;
+		}
+	});
+}
+
 bool
 UpdateWalk::UpdateDirectory(Directory &directory,
 			    const ExcludeList &exclude_list,
-			    const StorageFileInfo &info) noexcept
+			    const StorageFileInfo &info,
+			    DirectoryListing *listing) noexcept
 {
 	assert(info.IsDirectory());
 
+	if (IsUnmodifiedDirectory(directory, info)) {
+		directory_set_stat(directory, info);
+		UpdateUnmodifiedDirectory(directory, exclude_list);
+		directory.mark = true;
+
+		if (!cancel)
+			AddCompleted(directory);
+
+		return true;
+	}
+
 	directory_set_stat(directory, info);
 
-	std::unique_ptr<StorageDirectoryReader> reader;
+	if (stream != nullptr)
+		/* the #stream may write the attributes of this
+		   directory before it is complete */
+		directory.mtime = info.mtime;
+
+	DirectoryListing local_listing;
+	if (listing == nullptr) {
+		try {
+			local_listing.Read(storage, directory.GetPath(),
+					   config.uring_depth);
+		} catch (...) {
+			LogError(std::current_exception());
+			return false;
+		}
 
-	try {
-		reader = storage.OpenDirectory(directory.GetPath());
-	} catch (...) {
-		LogError(std::current_exception());
+		listing = &local_listing;
+	} else if (listing->error) {
+		LogError(listing->error);
 		return false;
 	}
 
+	if (negative_cache)
+		negative_cache->VisitDirectory(directory.GetPath());
+
 	ExcludeList child_exclude_list(exclude_list);
-	LoadExcludeListOrLog(storage, directory, child_exclude_list);
+	if (listing->Contains(".mpdignore"))
+		LoadExcludeListOrLog(storage, directory, child_exclude_list);
 
 	if (!child_exclude_list.IsEmpty())
 		RemoveExcludedFromDirectory(directory, child_exclude_list);
 
 	UnmarkAllIn(directory);
 
-	const char *name_utf8;
-	while (!cancel && (name_utf8 = reader->Read()) != nullptr) {
-		if (skip_path(name_utf8))
-			continue;
+	/* filter the listing first, so the subdirectories which will
+	   be visited are known in advance */
+	std::vector<DirectoryListing::Entry *> children;
+	children.reserve(listing->entries.size());
+
+	for (auto &entry : listing->entries) {
+		const char *name_utf8 = entry.name.c_str();
 
 		{
 			const auto name_fs = AllocatedPath::FromUTF8(name_utf8);
@@ -368,25 +569,94 @@ UpdateWalk::UpdateDirectory(Directory &directory,
 				continue;
 		}
 
-		if (SkipSymlink(&directory, name_utf8)) {
+		if (SkipSymlink(&directory, entry)) {
 			modified |= editor.DeleteNameIn(directory, name_utf8);
 			continue;
 		}
 
-		StorageFileInfo info2;
-		if (!GetInfo(*reader, info2)) {
+		if (entry.info_error) {
+			LogError(entry.info_error);
 			modified |= editor.DeleteNameIn(directory, name_utf8);
 			continue;
 		}
 
-		UpdateDirectoryChild(directory, child_exclude_list, name_utf8, info2);
+		children.push_back(&entry);
+	}
+
+	if (stream != nullptr)
+		SortForStream(directory, children);
+
+	std::optional<VirtualChildren> virtual_children;
+
+	/* while this directory is being updated, #list_pool reads
+	   the listings of the next few subdirectories */
+	std::optional<DirectoryPrefetcher> prefetcher;
+	if (list_pool)
+		prefetcher.emplace(*list_pool, storage, directory.GetPath(),
+				   config.uring_depth);
+
+	const std::size_t max_prefetch = config.enumerators * 4;
+	auto next_prefetch = children.begin();
+
+	for (auto *entry : children) {
+		if (cancel)
+			break;
+
+		if (stream != nullptr && entry->info.IsDirectory()) {
+			/* all files have been scanned; the virtual
+			   children which sort before this
+			   subdirectory must be written before it */
+			if (!virtual_children)
+				virtual_children = CollectVirtualChildren(directory);
+
+			const auto key = ChildSortKey(directory, entry->name);
+			AddVirtualChildren(*virtual_children, &key);
+		}
+
+		std::unique_ptr<DirectoryListingJob> child_job;
+
+		if (prefetcher) {
+			for (; next_prefetch != children.end() &&
+				     prefetcher->size() < max_prefetch;
+			     ++next_prefetch)
+				if ((*next_prefetch)->info.IsDirectory() &&
+				    !IsUnmodifiedChild(directory,
+						       (*next_prefetch)->name,
+						       (*next_prefetch)->info))
+					prefetcher->Push((*next_prefetch)->name);
+
+			if (entry->info.IsDirectory())
+				child_job = prefetcher->Take(entry->name);
+		}
+
+		UpdateDirectoryChild(directory, child_exclude_list,
+				     entry->name.c_str(), entry->info,
+				     listing,
+				     child_job ? &child_job->listing : nullptr);
+	}
+
+	prefetcher.reset();
+
+	if (stream != nullptr && !cancel) {
+		if (!virtual_children)
+			virtual_children = CollectVirtualChildren(directory);
+
+		AddVirtualChildren(*virtual_children, nullptr);
 	}
 
 	PurgeDeletedFromDirectory(directory);
 
+	if (scan_pool)
+		CommitScanJobs(false);
+
+	commit_queue.Flush();
+
 	directory.mtime = info.mtime;
 	directory.mark = true;
 
+	if (!cancel)
+		AddCompleted(directory);
+
 	return true;
 }
 
@@ -499,18 +769,321 @@ try {
 	}
 
 	const auto exclude_lists = LoadExcludeLists(storage, *parent);
-	UpdateDirectoryChild(*parent, exclude_lists.front(), name, info);
+	UpdateDirectoryChild(*parent, exclude_lists.front(), name, info,
+			     nullptr, nullptr);
 } catch (...) {
 	LogError(std::current_exception());
 }
 
+inline void
+UpdateWalk::LoadTagCache() noexcept
+{
+	if (config.tag_cache.IsNull())
+		return;
+
+	tag_cache = std::make_unique<TagCache>();
+
+	/* on a full rescan, all files are read again; the cache
+	   still merges hard links and is rebuilt for the next
+	   update */
+	if (walk_discard)
+		return;
+
+	try {
+		tag_cache->Load(config.tag_cache);
+	} catch (...) {
+		FmtError(update_domain, "Failed to load {}: {}",
+			 config.tag_cache, std::current_exception());
+		tag_cache = std::make_unique<TagCache>();
+	}
+}
+
+inline void
+UpdateWalk::SaveTagCache(bool complete) noexcept
+{
+	if (!tag_cache)
+		return;
+
+	try {
+		tag_cache->Save(config.tag_cache, complete && !cancel);
+	} catch (...) {
+		FmtError(update_domain, "Failed to save {}: {}",
+			 config.tag_cache, std::current_exception());
+	}
+
+	tag_cache.reset();
+}
+
+inline void
+UpdateWalk::LoadNegativeCache() noexcept
+{
+	if (config.negative_cache.IsNull())
+		return;
+
+	negative_cache = std::make_unique<NegativeCache>();
+
+	if (config.negative_cache_rebuild)
+		/* start with an empty list; SaveNegativeCache()
+		   replaces the file */
+		return;
+
+	try {
+		negative_cache->Load(config.negative_cache);
+	} catch (...) {
+		FmtError(update_domain, "Failed to load {}: {}",
+			 config.negative_cache, std::current_exception());
+		negative_cache = std::make_unique<NegativeCache>();
+	}
+}
+
+inline void
+UpdateWalk::SaveNegativeCache(bool complete) noexcept
+{
+	if (!negative_cache)
+		return;
+
+	try {
+		negative_cache->Save(config.negative_cache,
+				     complete && !cancel);
+	} catch (...) {
+		FmtError(update_domain, "Failed to save {}: {}",
+			 config.negative_cache, std::current_exception());
+	}
+
+	negative_cache.reset();
+}
+
+inline void
+UpdateWalk::OpenJournal(Directory &root) noexcept
+{
+	if (config.journal.IsNull())
+		return;
+
+	if (config.resume) {
+		/* the tree is modified even if loading fails
+		   halfway */
+		modified = true;
+
+		try {
+			const ScopeDatabaseLock protect;
+			resumed = UpdateJournal::Load(config.journal, root);
+		} catch (...) {
+			FmtError(update_domain, "Failed to load {}: {}",
+				 config.journal, std::current_exception());
+			resumed.clear();
+		}
+
+		if (!resumed.empty())
+			FmtNotice(update_domain,
+				  "resuming with {} completed directories",
+				  resumed.size());
+	}
+
+	try {
+		journal = std::make_unique<UpdateJournal>(config.journal,
+							  !resumed.empty());
+	} catch (...) {
+		FmtError(update_domain, "Failed to create {}: {}",
+			 config.journal, std::current_exception());
+	}
+}
+
+inline void
+UpdateWalk::CloseJournal() noexcept
+{
+	resumed.clear();
+
+	if (!journal)
+		return;
+
+	try {
+		journal->Close();
+
+		if (cancel)
+			journal_resumable = true;
+		else
+			journal_obsolete = true;
+	} catch (...) {
+		FmtError(update_domain, "Failed to save {}: {}",
+			 config.journal, std::current_exception());
+	}
+
+	journal.reset();
+}
+
+void
+UpdateWalk::RemoveJournal() noexcept
+{
+	if (!journal_obsolete)
+		return;
+
+	journal_obsolete = false;
+
+	try {
+		RemoveFile(config.journal);
+	} catch (...) {
+		FmtError(update_domain, "Failed to delete {}: {}",
+			 config.journal, std::current_exception());
+	}
+}
+
+void
+UpdateWalk::AddCompleted(Directory &directory) noexcept
+{
+	if ((!journal && stream == nullptr) || directory.IsRoot())
+		return;
+
+	completed.push_back({&directory, n_submitted_jobs});
+	FlushCompleted();
+}
+
+void
+UpdateWalk::FlushCompleted() noexcept
+{
+	/* the directories must be complete before they are
+	   written */
+	commit_queue.Flush();
+
+	/* jobs are committed in the order they were submitted */
+	const std::size_t n_committed = n_submitted_jobs - scan_jobs.size();
+
+	while (!completed.empty() &&
+	       completed.front().n_jobs <= n_committed) {
+		Directory &directory = *completed.front().directory;
+		completed.pop_front();
+
+		if (journal) {
+			try {
+				journal->Add(directory);
+			} catch (...) {
+				FmtError(update_domain,
+					 "Failed to write {}: {}",
+					 config.journal,
+					 std::current_exception());
+				journal.reset();
+			}
+		}
+
+		if (stream != nullptr) {
+			try {
+				/* this frees the directory */
+				stream->Add(directory);
+			} catch (...) {
+				LogError(std::current_exception(),
+					 "Failed to write database");
+
+				/* the file is incomplete; give up */
+				stream = nullptr;
+				cancel = true;
+			}
+		}
+	}
+}
+
+UpdateWalk::VirtualChildren
+UpdateWalk::CollectVirtualChildren(Directory &directory) noexcept
+{
+	VirtualChildren children;
+	bool playlists = false;
+
+	{
+		const ScopeDatabaseLock protect;
+
+		for (auto &child : directory.children) {
+			if (!child.IsReallyAFile() || child.IsMount())
+				continue;
+
+			children.emplace_back(IcuCollateKey(child.GetPath()),
+					      &child);
+			playlists |= child.IsPlaylist();
+		}
+	}
+
+	if (playlists) {
+		/* the songs which the playlists point to may still be
+		   in the #scan_pool */
+		if (scan_pool)
+			CommitScanJobs(true);
+
+		commit_queue.Flush();
+
+		const ScopeDatabaseLock protect;
+		PurgeDanglingFromLocalPlaylists(directory);
+	}
+
+	std::stable_sort(children.begin(), children.end(),
+			 [](const auto &a, const auto &b){
+				 return a.first < b.first;
+			 });
+
+	return children;
+}
+
+void
+UpdateWalk::AddVirtualChildren(VirtualChildren &children,
+			       const std::string *key) noexcept
+{
+	/* on a tie, the virtual child goes first, because it was
+	   created first */
+	while (!children.empty() &&
+	       (key == nullptr || children.front().first <= *key)) {
+		AddCompleted(*children.front().second);
+		children.pop_front();
+	}
+}
+
+bool
+UpdateWalk::IsNegativeCached(const Directory &directory,
+			     std::string_view name,
+			     const StorageFileInfo &info) noexcept
+{
+	if (!negative_cache || walk_discard)
+		return false;
+
+	const char *reason = negative_cache->Lookup(directory.GetPath(),
+						    name, info);
+	if (reason == nullptr)
+		return false;
+
+	/* a song filtered by a different channel mode may be wanted
+	   now */
+	if (!StringIsEqual(reason, "unrecognized")) {
+		const char *filter = FilteredSongUpdate::GetFilterReason();
+		if (filter == nullptr || !StringIsEqual(reason, filter))
+			return false;
+	}
+
+	FmtDebug(update_domain, "skipping {} file {}/{}",
+		 reason, directory.GetPath(), name);
+	return true;
+}
+
+void
+UpdateWalk::AddNegativeCache(const Directory &directory,
+			     std::string_view name,
+			     const StorageFileInfo &info,
+			     const char *reason) noexcept
+{
+	if (negative_cache && reason != nullptr)
+		negative_cache->Add(directory.GetPath(), name, info, reason);
+}
+
 bool
-UpdateWalk::Walk(Directory &root, const char *path, bool discard) noexcept
+UpdateWalk::Walk(Directory &root, const char *path, bool discard,
+		 DatabaseStream *_stream) noexcept
 {
 	walk_discard = discard;
 	modified = false;
+	stream = _stream;
+
+	LoadNegativeCache();
+	LoadTagCache();
 
-	if (path != nullptr && !isRootDirectory(path)) {
+	const bool complete = path == nullptr || isRootDirectory(path);
+	assert(stream == nullptr || (complete && discard));
+
+	if (!complete) {
+		StartWorkers();
 		UpdateUri(root, path);
 	} else {
 		StorageFileInfo info;
@@ -525,14 +1098,33 @@ UpdateWalk::Walk(Directory &root, const char *path, bool discard) noexcept
 
 		ExcludeList exclude_list;
 
-		UpdateDirectory(root, exclude_list, info);
+		/* the journal would need the tree which the stream
+		   frees */
+		if (stream == nullptr)
+			OpenJournal(root);
+
+		StartWorkers();
+		UpdateDirectory(root, exclude_list, info, nullptr);
 	}
 
-	{
+	StopWorkers();
+
+	/* all songs have been committed now */
+	FlushCompleted();
+	assert(completed.empty());
+
+	CloseJournal();
+
+	SaveNegativeCache(complete);
+	SaveTagCache(complete);
+
+	if (_stream == nullptr) {
 		const ScopeDatabaseLock protect;
 		root.ClearInPlaylist();
 		PurgeDanglingFromPlaylists(root);
 	}
 
+	stream = nullptr;
+
 	return modified;
 }
@@ -4,11 +4,18 @@
 #pragma once
 
 #include "Config.hxx"
+#include "CommitQueue.hxx"
 #include "Editor.hxx"
+#include "DirectoryListing.hxx"
 #include "archive/Features.h" // for ENABLE_ARCHIVE
 
 #include <atomic>
+#include <deque>
+#include <memory>
+#include <set>
+#include <string>
 #include <string_view>
+#include <utility>
 
 struct StorageFileInfo;
 struct Directory;
@@ -18,6 +25,11 @@ class SongEnumerator;
 class ArchiveFile;
 class Storage;
 class ExcludeList;
+class SongScanJob;
+class NegativeCache;
+class TagCache;
+class UpdateJournal;
+class DatabaseStream;
 
 class UpdateWalk final {
 #ifdef ENABLE_ARCHIVE
@@ -40,11 +52,112 @@ class UpdateWalk final {
 
 	DatabaseEditor editor;
 
+	/**
+	 * Tags of song files by their identity on disk; only exists
+	 * during Walk() if #UpdateConfig::tag_cache is set.  Declared
+	 * before #scan_jobs, because the jobs use it.
+	 */
+	std::unique_ptr<TagCache> tag_cache;
+
+	/**
+	 * Song files which have been submitted to #scan_pool, in the
+	 * order in which they were found.  They are committed to the
+	 * database in this order, so the resulting database does not
+	 * depend on the number of threads.
+	 */
+	std::deque<std::unique_ptr<SongScanJob>> scan_jobs;
+
+	/**
+	 * The threads which read song tags; only exists during
+	 * Walk() if #UpdateConfig::jobs is larger than 1.  Declared
+	 * after #scan_jobs so it gets destroyed first.
+	 */
+	std::unique_ptr<WorkerPool> scan_pool;
+
+	/**
+	 * New songs which have not yet been added to their
+	 * directories.
+	 */
+	SongCommitQueue commit_queue;
+
+	/**
+	 * The threads which read directory listings ahead of the
+	 * walk; only exists during Walk() if
+	 * #UpdateConfig::enumerators is non-zero.
+	 */
+	std::unique_ptr<WorkerPool> list_pool;
+
+	/**
+	 * Files which were not added to the database by previous
+	 * updates; only exists during Walk() if
+	 * #UpdateConfig::negative_cache is set.
+	 */
+	std::unique_ptr<NegativeCache> negative_cache;
+
+	/**
+	 * Receives the completed directories; only exists during
+	 * Walk() if #UpdateConfig::journal is set and the whole tree
+	 * is being updated.
+	 */
+	std::unique_ptr<UpdateJournal> journal;
+
+	/**
+	 * The directories which were loaded from the #journal of an
+	 * interrupted update.  They are skipped if they have not been
+	 * modified since, even without #UpdateConfig::trust_mtime.
+	 */
+	std::set<std::string, std::less<>> resumed;
+
+	/**
+	 * Receives the completed directories, which it writes to the
+	 * database file and frees; only set during Walk() if the
+	 * caller passed one.
+	 */
+	DatabaseStream *stream = nullptr;
+
+	struct CompletedDirectory {
+		Directory *directory;
+
+		/**
+		 * The value of #n_submitted_jobs when the directory
+		 * was completed.
+		 */
+		std::size_t n_jobs;
+	};
+
+	/**
+	 * Completed directories which will be added to the #journal
+	 * and the #stream as soon as all scan jobs which were
+	 * submitted before have been committed.
+	 */
+	std::deque<CompletedDirectory> completed;
+
+	/**
+	 * The virtual children of a directory (see
+	 * Directory::IsReallyAFile()) by their sort key; see
+	 * CollectVirtualChildren().
+	 */
+	using VirtualChildren = std::deque<std::pair<std::string, Directory *>>;
+
+	/**
+	 * The number of SubmitScanJob() calls.
+	 */
+	std::size_t n_submitted_jobs = 0;
+
+	/**
+	 * Shall the next update resume from the #journal (because
+	 * this one was cancelled), or can the journal be deleted
+	 * after the database has been saved?
+	 */
+	bool journal_resumable = false, journal_obsolete = false;
+
 public:
 	UpdateWalk(const UpdateConfig &_config,
 		   EventLoop &_loop, DatabaseListener &_listener,
 		   Storage &_storage) noexcept;
 
+	~UpdateWalk() noexcept;
+
 	/**
 	 * Cancel the current update and quit the Walk() method as
 	 * soon as possible.
@@ -53,16 +166,56 @@ public:
 		cancel = true;
 	}
 
+	/**
+	 * Was the last Walk() cancelled (or did it fail to write the
+	 * #DatabaseStream)?
+	 */
+	bool IsCancelled() const noexcept {
+		return cancel;
+	}
+
 	/**
 	 * Returns true if the database was modified.
+	 *
+	 * @param stream if not nullptr, then each directory is
+	 * written to this stream and freed as soon as it is complete;
+	 * this requires a complete update with @discard, and the
+	 * subdirectories are visited in the order of the database
+	 * file
 	 */
-	bool Walk(Directory &root, const char *path, bool discard) noexcept;
+	bool Walk(Directory &root, const char *path, bool discard,
+		  DatabaseStream *stream=nullptr) noexcept;
+
+	/**
+	 * Was the last Walk() cancelled, leaving a journal from which
+	 * the next update can resume?  Then the database should not
+	 * be saved, because parts of it have been purged.
+	 */
+	bool IsResumable() const noexcept {
+		return journal_resumable;
+	}
+
+	/**
+	 * Delete the journal of a Walk() which has completed; call
+	 * this after the database has been saved.
+	 */
+	void RemoveJournal() noexcept;
 
 private:
 	[[gnu::pure]]
 	bool SkipSymlink(const Directory *directory,
 			 std::string_view utf8_name) const noexcept;
 
+	[[gnu::pure]]
+	bool SkipSymlink(const Directory *directory,
+			 const DirectoryListing::Entry &entry) const noexcept;
+
+#ifndef _WIN32
+	[[gnu::pure]]
+	bool SkipSymlinkTarget(const Directory *directory,
+			       Path target) const noexcept;
+#endif
+
 	void RemoveExcludedFromDirectory(Directory &directory,
 					 const ExcludeList &exclude_list) noexcept;
 
@@ -77,6 +230,120 @@ private:
 	 */
 	void PurgeDanglingFromPlaylists(Directory &directory) noexcept;
 
+	/**
+	 * Like PurgeDanglingFromPlaylists(), but only for the
+	 * playlists in this directory (not recursively), and only for
+	 * targets in this directory.  This is used with a
+	 * #DatabaseStream, which does not keep the rest of the tree.
+	 */
+	void PurgeDanglingFromLocalPlaylists(Directory &directory) noexcept;
+
+	/**
+	 * @param local only check targets in the directory containing
+	 * the playlist file
+	 */
+	void PurgeDanglingFromPlaylist(Directory &playlist,
+				       bool local) noexcept;
+
+	void StartWorkers() noexcept;
+	void StopWorkers() noexcept;
+
+	void LoadTagCache() noexcept;
+	void SaveTagCache(bool complete) noexcept;
+
+	void LoadNegativeCache() noexcept;
+	void SaveNegativeCache(bool complete) noexcept;
+
+	/**
+	 * Open the #journal, after loading the old one into the tree
+	 * if #UpdateConfig::resume is set.
+	 */
+	void OpenJournal(Directory &root) noexcept;
+	void CloseJournal() noexcept;
+
+	[[gnu::pure]]
+	bool IsResumed(const Directory &directory) const noexcept;
+
+	/**
+	 * This directory and all of its subdirectories have been
+	 * updated; add it to the #journal and the #stream once its
+	 * songs have been committed.
+	 */
+	void AddCompleted(Directory &directory) noexcept;
+
+	/**
+	 * Add the completed directories whose songs have been
+	 * committed to the #journal and the #stream.
+	 */
+	void FlushCompleted() noexcept;
+
+	/**
+	 * Called by UpdateDirectory() with a #stream after all files
+	 * of the directory have been scanned: purge its playlists
+	 * (see PurgeDanglingFromLocalPlaylists()) and collect its
+	 * virtual children, which are complete already, sorted like
+	 * Directory::Sort().
+	 */
+	VirtualChildren CollectVirtualChildren(Directory &directory) noexcept;
+
+	/**
+	 * Pass the virtual children which sort before the given
+	 * subdirectory (or all of them if @key is nullptr) to
+	 * AddCompleted().
+	 */
+	void AddVirtualChildren(VirtualChildren &children,
+				const std::string *key) noexcept;
+
+	/**
+	 * Was this new file rejected by a previous update, and has it
+	 * not been modified since?
+	 */
+	bool IsNegativeCached(const Directory &directory,
+			      std::string_view name,
+			      const StorageFileInfo &info) noexcept;
+
+	/**
+	 * Remember that this file was not added to the database.
+	 *
+	 * @param reason a token without whitespace, e.g.
+	 * "unrecognized"; nullptr is ignored
+	 */
+	void AddNegativeCache(const Directory &directory,
+			      std::string_view name,
+			      const StorageFileInfo &info,
+			      const char *reason) noexcept;
+
+	/**
+	 * No decoder plugin recognized this file.  Remember it as
+	 * "unrecognized", or a container with the channel filter's
+	 * reason.  I/O errors are thrown by Song::LoadFile() instead,
+	 * and such files are read again by the next update.
+	 */
+	void AddUnrecognized(const Directory &directory,
+			     std::string_view name,
+			     const StorageFileInfo &info) noexcept;
+
+	/**
+	 * Submit a song file to #scan_pool.
+	 *
+	 * @param song the existing #Song object or nullptr if this is
+	 * a new file
+	 */
+	void SubmitScanJob(Directory &directory, std::string_view name,
+			   const StorageFileInfo &info, Song *song) noexcept;
+
+	/**
+	 * Attach the result of a finished #SongScanJob to the
+	 * database.  New songs go to the #commit_queue.
+	 */
+	void CommitScanJob(SongScanJob &job) noexcept;
+
+	/**
+	 * Commit all finished jobs at the head of #scan_jobs.  If
+	 * @wait is true, then wait for all pending jobs.
+	 */
+	void CommitScanJobs(bool wait) noexcept;
+
 	void UpdateSongFile2(Directory &directory,
 			     std::string_view name, std::string_view suffix,
 			     const StorageFileInfo &info) noexcept;
@@ -119,21 +386,62 @@ private:
 				const StorageFileInfo &info,
 				const PlaylistPlugin &plugin) noexcept;
 
+	/**
+	 * @param parent_listing the listing of the directory
+	 * containing the file, which is needed to validate CUE
+	 * sheets; nullptr to read it on demand
+	 */
 	bool UpdatePlaylistFile(Directory &directory,
 				std::string_view name, std::string_view suffix,
-				const StorageFileInfo &info) noexcept;
+				const StorageFileInfo &info,
+				const DirectoryListing *parent_listing) noexcept;
 
 	bool UpdateRegularFile(Directory &directory,
-			       const char *name, const StorageFileInfo &info) noexcept;
+			       const char *name, const StorageFileInfo &info,
+			       const DirectoryListing *parent_listing) noexcept;
 
+	/**
+	 * @param parent_listing the listing of #directory if
+	 * available (see UpdatePlaylistFile())
+	 * @param listing the listing of this child if it is a
+	 * directory and the listing has been read already; nullptr
+	 * to read it now
+	 */
 	void UpdateDirectoryChild(Directory &directory,
 				  const ExcludeList &exclude_list,
 				  const char *name,
-				  const StorageFileInfo &info) noexcept;
+				  const StorageFileInfo &info,
+				  const DirectoryListing *parent_listing,
+				  DirectoryListing *listing) noexcept;
 
 	bool UpdateDirectory(Directory &directory,
 			     const ExcludeList &exclude_list,
-			     const StorageFileInfo &info) noexcept;
+			     const StorageFileInfo &info,
+			     DirectoryListing *listing) noexcept;
+
+	/**
+	 * Does #UpdateConfig::trust_mtime allow skipping the listing
+	 * of this directory?
+	 */
+	[[gnu::pure]]
+	bool IsUnmodifiedDirectory(const Directory &directory,
+				   const StorageFileInfo &info) const noexcept;
+
+	/**
+	 * Like IsUnmodifiedDirectory(), but look up the child of the
+	 * given directory by its name.
+	 */
+	bool IsUnmodifiedChild(const Directory &parent,
+			       std::string_view name,
+			       const StorageFileInfo &info) const noexcept;
+
+	/**
+	 * Update a directory which was found unmodified by
+	 * IsUnmodifiedDirectory(): keep all of its songs and
+	 * playlists, and recurse into its subdirectories.
+	 */
+	void UpdateUnmodifiedDirectory(Directory &directory,
+				       const ExcludeList &exclude_list) noexcept;
 
 	/**
 	 * Create the specified directory object if it does not exist
@@ -0,0 +1,117 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#pragma once
+
+#include "fs/AllocatedPath.hxx"
+#include "thread/Mutex.hxx"
+
+#include <algorithm>
+#include <list>
+#include <memory>
+#include <mutex>
+
+/**
+ * Exclusive access to an opened disc image.  The disc stays alive
+ * (even if it gets evicted from the #DiscCache meanwhile) and locked
+ * until this object is destroyed.
+ */
+template<typename Disc>
+class DiscLease {
+	std::shared_ptr<Disc> disc;
+	std::unique_lock<Mutex> lock;
+
+public:
+	DiscLease() noexcept = default;
+
+	DiscLease(std::shared_ptr<Disc> &&_disc,
+		  std::unique_lock<Mutex> &&_lock) noexcept
+		:disc(std::move(_disc)), lock(std::move(_lock)) {}
+
+	operator bool() const noexcept {
+		return static_cast<bool>(disc);
+	}
+
+	Disc *operator->() const noexcept {
+		return disc.get();
+	}
+
+	Disc &operator*() const noexcept {
+		return *disc;
+	}
+};
+
+/**
+ * A cache of opened disc images, keyed by path, which allows several
+ * threads to scan different discs concurrently without reopening an
+ * image for each of its tracks.  The least recently used disc is
+ * evicted first.
+ *
+ * The #Disc type must be constructible from a path and provide the
+ * attributes "path", "mutex" (serializing the use of the disc),
+ * "opened" and "reader" and the method Open(), which is called with
+ * the disc's mutex locked.
+ */
+template<typename Disc>
+class DiscCache {
+	Mutex mutex;
+
+	/**
+	 * Most recently used first.
+	 */
+	std::list<std::shared_ptr<Disc>> discs;
+
+public:
+	/**
+	 * Look up (or open) the given disc and lock it.  Returns an
+	 * empty #DiscLease if the disc cannot be opened.
+	 *
+	 * @param max_size keep at most this many discs open
+	 */
+	DiscLease<Disc> Get(const AllocatedPath &path,
+			    unsigned max_size) noexcept {
+		std::shared_ptr<Disc> disc;
+
+		{
+			const std::scoped_lock protect{mutex};
+			auto i = std::find_if(discs.begin(), discs.end(), [&path](const auto &d){
+				return d->path == path;
+			});
+			if (i != discs.end()) {
+				discs.splice(discs.begin(), discs, i);
+				disc = *i;
+			} else {
+				disc = std::make_shared<Disc>(path);
+				discs.push_front(disc);
+				while (discs.size() > std::max(max_size, 1u))
+					discs.pop_back();
+			}
+		}
+
+		/* open the disc outside of the cache lock, so other
+		   discs can be opened meanwhile; concurrent users of
+		   this disc wait on its own mutex */
+		std::unique_lock lock{disc->mutex};
+		if (!disc->opened && !disc->Open())
+			/* don't cache the failure; the next call will
+			   retry */
+			Remove(*disc);
+
+		if (!disc->reader)
+			return {};
+
+		return {std::move(disc), std::move(lock)};
+	}
+
+	void Remove(const Disc &disc) noexcept {
+		const std::scoped_lock protect{mutex};
+		discs.remove_if([&disc](const auto &i){
+			return i.get() == &disc;
+		});
+	}
+
+	void Clear() noexcept {
+		const std::scoped_lock protect{mutex};
+		discs.clear();
+	}
+};
@@ -25,6 +25,7 @@
 #include <dvda_disc.h>
 #include <dvda_metabase.h>
 #include "DvdaIsoDecoderPlugin.hxx"
+#include "DiscCache.hxx"
 #include "../DecoderAPI.hxx"
 #include "input/InputStream.hxx"
 #include "pcm/CheckAudioFormat.hxx"
@@ -62,11 +63,91 @@ chmode_e    param_playable_area;
 std::string param_tags_path;
 bool        param_tags_with_iso;
 bool        param_use_stdio;
+unsigned    param_disc_cache_size;
 
-AllocatedPath                      dvda_path{ nullptr };
-std::unique_ptr<dvda_media_t>      dvda_media;
-std::unique_ptr<dvda_reader_t>     dvda_reader;
-std::unique_ptr<dvda_metabase_t>   dvda_metabase;
+/**
+ * An opened DVD-Audio image with its parsed UDF filesystem and IFOs.
+ * The reader keeps state (the selected track), therefore only one
+ * thread may use it at a time; see #DiscLease.
+ */
+struct Disc {
+	const AllocatedPath path;
+
+	/**
+	 * Protects all of the following fields and serializes the use
+	 * of the reader.
+	 */
+	Mutex mutex;
+
+	std::unique_ptr<dvda_media_t>    media;
+	std::unique_ptr<dvda_reader_t>   reader;
+	std::unique_ptr<dvda_metabase_t> metabase;
+
+	/**
+	 * Has Open() been called already?
+	 */
+	bool opened = false;
+
+	explicit Disc(Path _path) noexcept
+		:path(_path) {}
+
+	~Disc() noexcept {
+		if (reader) {
+			reader->close();
+		}
+		if (media) {
+			media->close();
+		}
+	}
+
+	Disc(const Disc &) = delete;
+	Disc &operator=(const Disc &) = delete;
+
+	bool Open() noexcept;
+};
+
+bool
+Disc::Open() noexcept {
+	opened = true;
+	if (param_use_stdio) {
+		media = std::make_unique<dvda_media_file_t>();
+	}
+	else {
+		media = std::make_unique<dvda_media_stream_t>();
+	}
+	reader = std::make_unique<dvda_disc_t>();
+	if (!media->open(path.c_str())) {
+		FmtWarning(dvdaiso_domain, "dvda_media->open('{}') failed", path.c_str());
+		reader.reset();
+		return false;
+	}
+	if (!reader->open(media.get())) {
+		//LogWarning(dvdaiso_domain, "dvda_reader->open(...) failed");
+		reader.reset();
+		return false;
+	}
+	if (!param_tags_path.empty() || param_tags_with_iso) {
+		std::string tags_file;
+		if (param_tags_with_iso) {
+			tags_file = path.c_str();
+			tags_file.resize(tags_file.rfind('.') + 1);
+			tags_file.append("xml");
+		}
+		metabase = std::make_unique<dvda_metabase_t>(static_cast<dvda_disc_t*>(reader.get()), param_tags_path.empty() ? nullptr : param_tags_path.c_str(), tags_file.empty() ? nullptr : tags_file.c_str());
+	}
+	return true;
+}
+
+static DiscCache<Disc> disc_cache;
+
+static DiscLease<Disc>
+open_disc(Path path_fs) noexcept {
+	AllocatedPath disc_path{path_fs};
+	if (!FileExists(disc_path)) {
+		return {};
+	}
+	return disc_cache.Get(disc_path, param_disc_cache_size);
+}
 
 static bool
 get_subsong(Path path_fs, unsigned& index, bool& downmix) {
@@ -79,68 +160,18 @@ get_subsong(Path path_fs, unsigned& index, bool& downmix) {
 	return params == 3;
 }
 
-static bool
-container_update(Path path_fs) {
-	auto curr_path = AllocatedPath(path_fs);
-	if (dvda_path == curr_path) {
-		return true;
-	}
-	if (dvda_reader) {
-		dvda_reader->close();
-		dvda_reader.reset();
-	}
-	if (dvda_media) {
-		dvda_media->close();
-		dvda_media.reset();
-	}
-	dvda_metabase.reset();
-	dvda_path.SetNull();
-	if (FileExists(curr_path)) {
-		if (param_use_stdio) {
-			dvda_media = std::make_unique<dvda_media_file_t>();
-		}
-		else {
-			dvda_media = std::make_unique<dvda_media_stream_t>();
-		}
-		dvda_reader = std::make_unique<dvda_disc_t>();
-		if (!dvda_media->open(curr_path.c_str())) {
-			std::string err;
-			err  = "dvda_media->open('";
-			err += curr_path.c_str();
-			err += "') failed";
-			LogWarning(dvdaiso_domain, err.c_str());
-			return false;
-		}
-		if (!dvda_reader->open(dvda_media.get())) {
-			//LogWarning(dvdaiso_domain, "dvda_reader->open(...) failed");
-			return false;
-		}
-		if (!param_tags_path.empty() || param_tags_with_iso) {
-			std::string tags_file;
-			if (param_tags_with_iso) {
-				tags_file = curr_path.c_str();
-				tags_file.resize(tags_file.rfind('.') + 1);
-				tags_file.append("xml");
-			}
-			dvda_metabase = std::make_unique<dvda_metabase_t>(static_cast<dvda_disc_t*>(dvda_reader.get()), param_tags_path.empty() ? nullptr : param_tags_path.c_str(), tags_file.empty() ? nullptr : tags_file.c_str());
-		}
-		dvda_path = curr_path;
-	}
-	return static_cast<bool>(dvda_reader);
-}
-
 static void
-scan_info(unsigned track_index, bool downmix, TagHandler& handler) {
+scan_info(Disc &disc, unsigned track_index, bool downmix, TagHandler& handler) {
 	auto tag_value = std::to_string(track_index + 1);
 	handler.OnTag(TAG_TRACK, tag_value.c_str());
-	handler.OnDuration(SongTime::FromS(dvda_reader->get_duration(track_index)));
-	if (!dvda_metabase || (dvda_metabase && !dvda_metabase->get_track_info(track_index + 1, downmix, handler))) {
-		dvda_reader->get_info(track_index, downmix, handler);
+	handler.OnDuration(SongTime::FromS(disc.reader->get_duration(track_index)));
+	if (!disc.metabase || (disc.metabase && !disc.metabase->get_track_info(track_index + 1, downmix, handler))) {
+		disc.reader->get_info(track_index, downmix, handler);
 	}
 	if (handler.WantPicture()) {
 		auto has_albumart{ false };
-		if (dvda_metabase) {
-			has_albumart = dvda_metabase->get_albumart(handler);
+		if (disc.metabase) {
+			has_albumart = disc.metabase->get_albumart(handler);
 		}
 		if (!has_albumart) {
 			static constexpr auto art_names = std::array {
@@ -149,7 +180,7 @@ scan_info(unsigned track_index, bool downmix, TagHandler& handler) {
 				"cover.webp",
 			};
 			for (const auto art_name : art_names) {
-				auto art_file = AllocatedPath::Build(dvda_path.GetDirectoryName(), art_name);
+				auto art_file = AllocatedPath::Build(disc.path.GetDirectoryName(), art_name);
 				try {
 					Mutex mutex;
 					auto is = InputStream::OpenReady(art_file.c_str(), mutex);
@@ -188,12 +219,13 @@ init(const ConfigBlock& block) {
 	param_tags_path = block.GetBlockValue("tags_path", "");
 	param_tags_with_iso = block.GetBlockValue("tags_with_iso", false);
 	param_use_stdio = block.GetBlockValue("use_stdio", true);
+	param_disc_cache_size = block.GetBlockValue("disc_cache_size", 4U);
 	return true;
 }
 
 static void
 finish() noexcept {
-	container_update(nullptr);
+	disc_cache.Clear();
 	my_av_log_set_default_callback();
 }
 
@@ -201,7 +233,8 @@ finish() noexcept {
 enum class ChannelMode {
 	STEREO,
 	MULTICHANNEL,
-	ALL
+	ALL,
+	SPLIT // everything, without album suffixes
 };
 extern "C" __attribute__((weak)) ChannelMode GetChannelMode() noexcept {
 	return ChannelMode::ALL; // Default for normal MPD
@@ -210,9 +243,11 @@ extern "C" __attribute__((weak)) ChannelMode GetChannelMode() noexcept {
 static std::forward_list<DetachedSong>
 container_scan(Path path_fs) {
 	std::forward_list<DetachedSong> list;
-	if (!container_update(path_fs)) {
+	const auto disc = open_disc(path_fs);
+	if (!disc) {
 		return list;
 	}
+	auto &reader = *disc->reader;
 	TagBuilder tag_builder;
 	auto tail = list.before_begin();
 	auto suffix = path_fs.GetExtension();
@@ -221,16 +256,17 @@ container_scan(Path path_fs) {
 	auto channel_mode = GetChannelMode();
 	FmtDebug(dvdaiso_domain, "container_scan: GetChannelMode returned {}",
 		(channel_mode == ChannelMode::STEREO ? "STEREO" :
-		 channel_mode == ChannelMode::MULTICHANNEL ? "MULTICHANNEL" : "ALL"));
+		 channel_mode == ChannelMode::MULTICHANNEL ? "MULTICHANNEL" :
+		 channel_mode == ChannelMode::SPLIT ? "SPLIT" : "ALL"));
 	
-	for (auto track_index = 0u; track_index < dvda_reader->get_tracks(); track_index++) {
-		if (dvda_reader->select_track(track_index)) {
-			auto duration = dvda_reader->get_duration();
+	for (auto track_index = 0u; track_index < reader.get_tracks(); track_index++) {
+		if (reader.select_track(track_index)) {
+			auto duration = reader.get_duration();
 			if (param_no_short_tracks && duration < SHORT_TRACK_SEC) {
 				continue;
 			}
 			
-			auto channels = dvda_reader->get_channels();
+			auto channels = reader.get_channels();
 			bool is_multichannel = channels > 2;
 			
 			// Filter based on channel mode
@@ -242,7 +278,7 @@ container_scan(Path path_fs) {
 				// Only process stereo tracks or downmixes of multichannel
 				if (!is_multichannel) {
 					process_track = true;
-				} else if (!param_no_downmixes && dvda_reader->can_downmix()) {
+				} else if (!param_no_downmixes && reader.can_downmix()) {
 					process_downmix = true;
 				}
 			} else if (channel_mode == ChannelMode::MULTICHANNEL) {
@@ -250,6 +286,13 @@ container_scan(Path path_fs) {
 				if (is_multichannel) {
 					process_track = true;
 				}
+			} else if (channel_mode == ChannelMode::SPLIT) {
+				// Process everything; the databases are
+				// filtered when they are saved
+				process_track = true;
+				if (!param_no_downmixes && reader.can_downmix()) {
+					process_downmix = true;
+				}
 			} else { // ChannelMode::ALL
 				// Process everything based on param_playable_area
 				switch (param_playable_area) {
@@ -262,13 +305,13 @@ container_scan(Path path_fs) {
 					if (!is_multichannel) {
 						process_track = true;
 					}
-					if (!param_no_downmixes && dvda_reader->can_downmix()) {
+					if (!param_no_downmixes && reader.can_downmix()) {
 						process_downmix = true;
 					}
 					break;
 				default:
 					process_track = true;
-					if (!param_no_downmixes && dvda_reader->can_downmix()) {
+					if (!param_no_downmixes && reader.can_downmix()) {
 						process_downmix = true;
 					}
 					break;
@@ -280,7 +323,7 @@ container_scan(Path path_fs) {
 			if (process_track) {
 				AddTagHandler h(tag_builder);
 				area = is_multichannel ? 'M' : 'S';
-				scan_info(track_index, false, h);
+				scan_info(*disc, track_index, false, h);
 				
 				// Add channel indicator to album title in ALL mode
 				if (channel_mode == ChannelMode::ALL) {
@@ -312,7 +355,7 @@ container_scan(Path path_fs) {
 			if (process_downmix) {
 				AddTagHandler h(tag_builder);
 				area = 'D';
-				scan_info(track_index, true, h);
+				scan_info(*disc, track_index, true, h);
 				
 				// Add channel indicator to album title in ALL mode for downmixes
 				if (channel_mode == ChannelMode::ALL) {
@@ -351,9 +394,18 @@ container_scan(Path path_fs) {
 
 static void
 file_decode(DecoderClient &client, Path path_fs) {
-	if (!container_update(path_fs.GetDirectoryName())) {
+	const auto disc_path = path_fs.GetDirectoryName();
+	if (!FileExists(disc_path)) {
+		return;
+	}
+
+	/* playback uses a private instance, so it neither pins a pool
+	   slot nor disturbs the reader state of a scanner */
+	Disc disc{disc_path};
+	if (!disc.Open()) {
 		return;
 	}
+	auto &reader = *disc.reader;
 	unsigned track;
 	bool downmix;
 	if (!get_subsong(path_fs, track, downmix)) {
@@ -362,28 +414,28 @@ file_decode(DecoderClient &client, Path path_fs) {
 	}
 
 	// initialize reader
-	if (!dvda_reader->select_track(track)) {
+	if (!reader.select_track(track)) {
 		LogError(dvdaiso_domain, "cannot select track");
 		return;
 	}
-	if (!dvda_reader->set_downmix(downmix)) {
+	if (!reader.set_downmix(downmix)) {
 		LogError(dvdaiso_domain, "cannot downmix track");
 		return;
 	}
-	auto samplerate = dvda_reader->get_samplerate();
-	auto channels = dvda_reader->get_downmix() ? 2u : dvda_reader->get_channels();
+	auto samplerate = reader.get_samplerate();
+	auto channels = reader.get_downmix() ? 2u : reader.get_channels();
 	std::vector<uint8_t> pcm_data(192000);
 
 	// initialize decoder
 	auto audio_format = CheckAudioFormat(samplerate, SampleFormat::S32, channels);
-	auto songtime = SongTime::FromS(dvda_reader->get_duration(track));
+	auto songtime = SongTime::FromS(reader.get_duration(track));
 	client.Ready(audio_format, true, songtime);
 
 	// play
 	auto cmd = client.GetCommand();
 	for (;;) {
 		auto pcm_size = pcm_data.size();
-		if (dvda_reader->read_frame(pcm_data.data(), &pcm_size)) {
+		if (reader.read_frame(pcm_data.data(), &pcm_size)) {
 			if (pcm_size > 0) {
 				auto kbit_rate = 24 * channels * samplerate / 1000;
 				cmd = client.SubmitAudio(nullptr, std::span{ pcm_data.data(), pcm_size }, kbit_rate);
@@ -392,7 +444,7 @@ file_decode(DecoderClient &client, Path path_fs) {
 				}
 				if (cmd == DecoderCommand::SEEK) {
 					auto seconds = client.GetSeekTime().ToDoubleS();
-					if (dvda_reader->seek(seconds)) {
+					if (reader.seek(seconds)) {
 						client.CommandFinished();
 					}
 					else {
@@ -410,9 +462,11 @@ file_decode(DecoderClient &client, Path path_fs) {
 
 static bool
 scan_file(Path path_fs, TagHandler& handler) noexcept {
-	if (!container_update(path_fs.GetDirectoryName())) {
+	const auto disc = open_disc(path_fs.GetDirectoryName());
+	if (!disc) {
 		return false;
 	}
+	auto &reader = *disc->reader;
 	unsigned track_index;
 	bool downmix;
 	if (!get_subsong(path_fs, track_index, downmix)) {
@@ -424,12 +478,12 @@ scan_file(Path path_fs, TagHandler& handler) noexcept {
 	auto channel_mode = GetChannelMode();
 	
 	// Select the track to get channel info
-	if (!dvda_reader->select_track(track_index)) {
+	if (!reader.select_track(track_index)) {
 		LogError(dvdaiso_domain, "cannot select track for scan");
 		return false;
 	}
 	
-	auto channels = dvda_reader->get_channels();
+	auto channels = reader.get_channels();
 	bool is_multichannel = channels > 2;
 	
 	// Filter based on channel mode
@@ -444,9 +498,9 @@ scan_file(Path path_fs, TagHandler& handler) noexcept {
 			return false;
 		}
 	}
-	// For ChannelMode::ALL, scan everything
+	// For ChannelMode::ALL and SPLIT, scan everything
 	
-	scan_info(track_index, downmix, handler);
+	scan_info(*disc, track_index, downmix, handler);
 	return true;
 }
 
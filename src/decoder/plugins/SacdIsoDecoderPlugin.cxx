@@ -25,6 +25,7 @@
 #include <sacd_dsdiff.h>
 #include <dst_decoder.h>
 #include "SacdIsoDecoderPlugin.hxx"
+#include "DiscCache.hxx"
 #include "../DecoderAPI.hxx"
 #include "input/InputStream.hxx"
 #include "pcm/CheckAudioFormat.hxx"
@@ -61,111 +62,149 @@ area_id_e   param_playable_area;
 std::string param_tags_path;
 bool        param_tags_with_iso;
 bool        param_use_stdio;
+unsigned    param_disc_cache_size;
 
-AllocatedPath                    sacd_path{ nullptr };
-std::unique_ptr<sacd_media_t>    sacd_media;
-std::unique_ptr<sacd_reader_t>   sacd_reader;
-std::unique_ptr<sacd_metabase_t> sacd_metabase;
+/**
+ * An opened SACD image (or DSDIFF file).  The reader keeps state
+ * (the selected area and track), therefore only one thread may use it
+ * at a time; see #DiscLease.
+ */
+struct Disc {
+	const AllocatedPath path;
+
+	/**
+	 * Protects all of the following fields and serializes the use
+	 * of the reader.
+	 */
+	Mutex mutex;
+
+	std::unique_ptr<sacd_media_t>    media;
+	std::unique_ptr<sacd_reader_t>   reader;
+	std::unique_ptr<sacd_metabase_t> metabase;
+
+	/**
+	 * Has Open() been called already?
+	 */
+	bool opened = false;
+
+	explicit Disc(Path _path) noexcept
+		:path(_path) {}
+
+	~Disc() noexcept {
+		if (reader) {
+			reader->close();
+		}
+		if (media) {
+			media->close();
+		}
+	}
+
+	Disc(const Disc &) = delete;
+	Disc &operator=(const Disc &) = delete;
+
+	bool Open() noexcept;
+};
+
+bool
+Disc::Open() noexcept {
+	opened = true;
+	if (param_use_stdio) {
+		media = std::make_unique<sacd_media_file_t>();
+	}
+	else {
+		media = std::make_unique<sacd_media_stream_t>();
+	}
+	auto suffix = path.GetExtension();
+	auto is_iso = StringIsEqualIgnoreCase(suffix, "dat") || StringIsEqualIgnoreCase(suffix, "iso");
+	auto is_dff = StringIsEqualIgnoreCase(suffix, "dff");
+	if (is_iso) {
+		reader = std::make_unique<sacd_disc_t>();
+	}
+	if (is_dff) {
+		reader = std::make_unique<sacd_dsdiff_t>();
+	}
+	if (!reader) {
+		LogError(sacdiso_domain, "new sacd_disc_t() failed");
+		return false;
+	}
+	if (!media->open(path.c_str())) {
+		FmtWarning(sacdiso_domain, "sacd_media->open('{}') failed", path.c_str());
+		reader.reset();
+		return false;
+	}
+	if (!reader->open(media.get(), param_single_track ? MODE_SINGLE_TRACK : MODE_MULTI_TRACK)) {
+		//LogWarning(sacdiso_domain, "sacd_reader->open(...) failed");
+		reader.reset();
+		return false;
+	}
+	if (is_iso) {
+		if (!param_tags_path.empty() || param_tags_with_iso) {
+			std::string tags_file;
+			if (param_tags_with_iso) {
+				tags_file = path.c_str();
+				tags_file.resize(tags_file.rfind('.') + 1);
+				tags_file.append("xml");
+			}
+			metabase = std::make_unique<sacd_metabase_t>(reinterpret_cast<sacd_disc_t*>(reader.get()), param_tags_path.empty() ? nullptr : param_tags_path.c_str(), tags_file.empty() ? nullptr : tags_file.c_str());
+		}
+	}
+	return true;
+}
+
+static DiscCache<Disc> disc_cache;
 
 static unsigned
-get_subsong(Path path_fs) {
+get_subsong(sacd_reader_t &reader, Path path_fs) {
 	auto ptr = path_fs.GetBase().c_str();
 	char area = '\0';
 	unsigned index = 0;
 	char suffix[4];
 	auto params = std::sscanf(ptr, SACD_TRACKXXX_FMT, &area, &index, suffix);
 	if (area == 'M') {
-		index += sacd_reader->get_tracks(AREA_TWOCH);
+		index += reader.get_tracks(AREA_TWOCH);
 	}
 	index--;
 	return (params == 3) ? index : 0;
 }
 
-static bool
-container_update(Path path_fs) {
+/**
+ * Determine the image file which contains the given (container or
+ * virtual track) path.
+ */
+static AllocatedPath
+get_disc_path(Path path_fs) {
 	auto curr_path = AllocatedPath(path_fs);
 	if (!FileExists(curr_path)) {
 		curr_path = path_fs.GetDirectoryName();
 	}
-	if (sacd_path == curr_path) {
-		return true;
-	}
-	if (sacd_reader) {
-		sacd_reader->close();
-		sacd_reader.reset();
-	}
-	if (sacd_media) {
-		sacd_media->close();
-		sacd_media.reset();
+	if (!FileExists(curr_path)) {
+		curr_path.SetNull();
 	}
-	sacd_metabase.reset();
-	sacd_path.SetNull();
-	if (FileExists(curr_path)) {
-		if (param_use_stdio) {
-			sacd_media = std::make_unique<sacd_media_file_t>();
-		}
-		else {
-			sacd_media = std::make_unique<sacd_media_stream_t>();
-		}
-		if (!sacd_media) {
-			LogError(sacdiso_domain, "new sacd_media_t() failed");
-			return false;
-		}
-		\
-		auto suffix = curr_path.GetExtension();
-		auto is_iso = StringIsEqualIgnoreCase(suffix, "dat") || StringIsEqualIgnoreCase(suffix, "iso");
-		auto is_dff = StringIsEqualIgnoreCase(suffix, "dff");
-		if (is_iso) {
-			sacd_reader = std::make_unique<sacd_disc_t>();
-		}
-		if (is_dff) {
-			sacd_reader = std::make_unique<sacd_dsdiff_t>();
-		}
-		if (!sacd_reader) {
-			LogError(sacdiso_domain, "new sacd_disc_t() failed");
-			return false;
-		}
-		if (!sacd_media->open(curr_path.c_str())) {
-			std::string err;
-			err  = "sacd_media->open('";
-			err += curr_path.c_str();
-			err += "') failed";
-			LogWarning(sacdiso_domain, err.c_str());
-			return false;
-		}
-		if (!sacd_reader->open(sacd_media.get(), param_single_track ? MODE_SINGLE_TRACK : MODE_MULTI_TRACK)) {
-			//LogWarning(sacdiso_domain, "sacd_reader->open(...) failed");
-			return false;
-		}
-		if (is_iso) {
-			if (!param_tags_path.empty() || param_tags_with_iso) {
-				std::string tags_file;
-				if (param_tags_with_iso) {
-					tags_file = curr_path.c_str();
-					tags_file.resize(tags_file.rfind('.') + 1);
-					tags_file.append("xml");
-				}
-				sacd_metabase = std::make_unique<sacd_metabase_t>(reinterpret_cast<sacd_disc_t*>(sacd_reader.get()), param_tags_path.empty() ? nullptr : param_tags_path.c_str(), tags_file.empty() ? nullptr : tags_file.c_str());
-			}
-		}
-		sacd_path = curr_path;
+	return curr_path;
+}
+
+static DiscLease<Disc>
+open_disc(Path path_fs) noexcept {
+	const auto disc_path = get_disc_path(path_fs);
+	if (disc_path.IsNull()) {
+		return {};
 	}
-	return static_cast<bool>(sacd_reader);
+	return disc_cache.Get(disc_path, param_disc_cache_size);
 }
 
 static void
-scan_info(unsigned track, unsigned track_index, TagHandler& handler) {
+scan_info(Disc &disc, unsigned track, unsigned track_index, TagHandler& handler) {
 	auto tag_value = std::to_string(track + 1);
 	handler.OnTag(TAG_TRACK, tag_value.c_str());
-	handler.OnDuration(SongTime::FromS(sacd_reader->get_duration(track)));
-	if (sacd_metabase) {
-		sacd_metabase->get_track_info(track_index + 1, handler);
+	handler.OnDuration(SongTime::FromS(disc.reader->get_duration(track)));
+	if (disc.metabase) {
+		disc.metabase->get_track_info(track_index + 1, handler);
 	}
-	sacd_reader->get_info(track, handler);
+	disc.reader->get_info(track, handler);
 	if (handler.WantPicture()) {
 		auto has_albumart{ false };
-		if (sacd_metabase) {
-			has_albumart = sacd_metabase->get_albumart(handler);
+		if (disc.metabase) {
+			has_albumart = disc.metabase->get_albumart(handler);
 		}
 		if (!has_albumart) {
 			static constexpr auto art_names = std::array {
@@ -174,7 +213,7 @@ scan_info(unsigned track, unsigned track_index, TagHandler& handler) {
 				"cover.webp",
 			};
 			for (const auto art_name : art_names) {
-				auto art_file = AllocatedPath::Build(sacd_path.GetDirectoryName(), art_name);
+				auto art_file = AllocatedPath::Build(disc.path.GetDirectoryName(), art_name);
 				try {
 					Mutex mutex;
 					auto is = InputStream::OpenReady(art_file.c_str(), mutex);
@@ -212,19 +251,21 @@ init(const ConfigBlock& block) {
 	param_tags_path = block.GetBlockValue("tags_path", "");
 	param_tags_with_iso = block.GetBlockValue("tags_with_iso", false);
 	param_use_stdio = block.GetBlockValue("use_stdio", true);
+	param_disc_cache_size = block.GetBlockValue("disc_cache_size", 4U);
 	return true;
 }
 
 static void
 finish() noexcept {
-	container_update(nullptr);
+	disc_cache.Clear();
 }
 
 // External function to get channel mode for database creation
 enum class ChannelMode {
 	STEREO,
 	MULTICHANNEL,
-	ALL
+	ALL,
+	SPLIT // everything, without album suffixes
 };
 extern "C" __attribute__((weak)) ChannelMode GetChannelMode() noexcept {
 	return ChannelMode::ALL; // Default for normal MPD
@@ -233,28 +274,31 @@ extern "C" __attribute__((weak)) ChannelMode GetChannelMode() noexcept {
 static std::forward_list<DetachedSong>
 container_scan(Path path_fs) {
 	std::forward_list<DetachedSong> list;
-	if (!container_update(path_fs)) {
+	const auto disc = open_disc(path_fs);
+	if (!disc) {
 		return list;
 	}
+	auto &reader = *disc->reader;
 	TagBuilder tag_builder;
 	auto tail = list.before_begin();
 	auto suffix = path_fs.GetExtension();
-	auto twoch_count = sacd_reader->get_tracks(AREA_TWOCH);
-	auto mulch_count = sacd_reader->get_tracks(AREA_MULCH);
+	auto twoch_count = reader.get_tracks(AREA_TWOCH);
+	auto mulch_count = reader.get_tracks(AREA_MULCH);
 	
 	// Check our channel mode for database creation
 	auto channel_mode = GetChannelMode();
 	FmtDebug(sacdiso_domain, "container_scan: GetChannelMode returned {}",
 		(channel_mode == ChannelMode::STEREO ? "STEREO" :
-		 channel_mode == ChannelMode::MULTICHANNEL ? "MULTICHANNEL" : "ALL"));
+		 channel_mode == ChannelMode::MULTICHANNEL ? "MULTICHANNEL" :
+		 channel_mode == ChannelMode::SPLIT ? "SPLIT" : "ALL"));
 	bool process_stereo = (channel_mode != ChannelMode::MULTICHANNEL);
 	bool process_multichannel = (channel_mode != ChannelMode::STEREO);
 	
 	if (twoch_count > 0 && param_playable_area != AREA_MULCH && process_stereo) {
-		sacd_reader->select_area(AREA_TWOCH);
+		reader.select_area(AREA_TWOCH);
 		for (auto track = 0u; track < twoch_count; track++) {
 			AddTagHandler handler(tag_builder);
-			scan_info(track, track, handler);
+			scan_info(*disc, track, track, handler);
 			
 			// Add channel indicator to album title in ALL mode
 			if (channel_mode == ChannelMode::ALL) {
@@ -287,10 +331,10 @@ container_scan(Path path_fs) {
 		}
 	}
 	if (mulch_count > 0 && param_playable_area != AREA_TWOCH && process_multichannel) {
-		sacd_reader->select_area(AREA_MULCH);
+		reader.select_area(AREA_MULCH);
 		for (auto track = 0u; track < mulch_count; track++) {
 			AddTagHandler handler(tag_builder);
-			scan_info(track, track + twoch_count, handler);
+			scan_info(*disc, track, track + twoch_count, handler);
 			
 			// Add channel indicator to album title in ALL mode
 			if (channel_mode == ChannelMode::ALL) {
@@ -334,19 +378,28 @@ bit_reverse_buffer(uint8_t* p, uint8_t* end) {
 
 static void
 file_decode(DecoderClient &client, Path path_fs) {
-	if (!container_update(path_fs.GetDirectoryName())) {
+	const auto disc_path = get_disc_path(path_fs.GetDirectoryName());
+	if (disc_path.IsNull()) {
+		return;
+	}
+
+	/* playback uses a private instance, so it neither pins a
+	   cache slot nor disturbs the reader state of a scanner */
+	Disc disc{disc_path};
+	if (!disc.Open()) {
 		return;
 	}
+	auto &reader = *disc.reader;
 
-	auto track = get_subsong(path_fs);
+	auto track = get_subsong(reader, path_fs);
 
 	// initialize reader
-	sacd_reader->set_emaster(param_edited_master);
-	auto twoch_count = sacd_reader->get_tracks(AREA_TWOCH);
-	auto mulch_count = sacd_reader->get_tracks(AREA_MULCH);
+	reader.set_emaster(param_edited_master);
+	auto twoch_count = reader.get_tracks(AREA_TWOCH);
+	auto mulch_count = reader.get_tracks(AREA_MULCH);
 	if (track < twoch_count) {
-		sacd_reader->select_area(AREA_TWOCH);
-		if (!sacd_reader->select_track(track, AREA_TWOCH)) {
+		reader.select_area(AREA_TWOCH);
+		if (!reader.select_track(track, AREA_TWOCH)) {
 			LogError(sacdiso_domain, "cannot select track in stereo area");
 			return;
 		}
@@ -354,21 +407,21 @@ file_decode(DecoderClient &client, Path path_fs) {
 	else {
 		track -= twoch_count;
 		if (track < mulch_count) {
-			sacd_reader->select_area(AREA_MULCH);
-			if (!sacd_reader->select_track(track, AREA_MULCH)) {
+			reader.select_area(AREA_MULCH);
+			if (!reader.select_track(track, AREA_MULCH)) {
 				LogError(sacdiso_domain, "cannot select track in multichannel area");
 				return;
 			}
 		}
 	}
-	auto dsd_channels = sacd_reader->get_channels();
-	auto dsd_samplerate = sacd_reader->get_samplerate();
-	auto dsd_framerate = sacd_reader->get_framerate();
+	auto dsd_channels = reader.get_channels();
+	auto dsd_samplerate = reader.get_samplerate();
+	auto dsd_framerate = reader.get_framerate();
 	std::vector<uint8_t> dsx_buf;
 
 	// initialize decoder
 	AudioFormat audio_format = CheckAudioFormat(dsd_samplerate / 8, SampleFormat::DSD, dsd_channels);
-	SongTime songtime = SongTime::FromS(sacd_reader->get_duration(track));
+	SongTime songtime = SongTime::FromS(reader.get_duration(track));
 	client.Ready(audio_format, true, songtime);
 
 	// play
@@ -379,7 +432,7 @@ file_decode(DecoderClient &client, Path path_fs) {
 		dsx_buf.resize(dsd_samplerate / 8 / dsd_framerate * dsd_channels);
 		auto frame_size = dsx_buf.size();
 		auto frame_type = FRAME_INVALID;
-		frame_read = frame_read && sacd_reader->read_frame(dsx_buf.data(), &frame_size, &frame_type);
+		frame_read = frame_read && reader.read_frame(dsx_buf.data(), &frame_size, &frame_type);
 		if (frame_read) {
 			dsx_buf.resize(frame_size);
 			switch (frame_type) {
@@ -419,7 +472,7 @@ file_decode(DecoderClient &client, Path path_fs) {
 			auto cmd = client.SubmitAudio(nullptr, std::span{ dsx_buf.data(), dsx_buf.size() }, kbit_rate);
 			if (cmd == DecoderCommand::SEEK) {
 				auto seconds = client.GetSeekTime().ToDoubleS();
-				if (sacd_reader->seek(seconds)) {
+				if (reader.seek(seconds)) {
 					client.CommandFinished();
 				}
 				else {
@@ -436,13 +489,15 @@ file_decode(DecoderClient &client, Path path_fs) {
 
 static bool
 scan_file(Path path_fs, TagHandler& handler) noexcept {
-	if (!container_update(path_fs.GetDirectoryName())) {
+	const auto disc = open_disc(path_fs.GetDirectoryName());
+	if (!disc) {
 		return false;
 	}
-	auto track_index = get_subsong(path_fs);
+	auto &reader = *disc->reader;
+	auto track_index = get_subsong(reader, path_fs);
 	auto track = track_index;
-	auto twoch_count = sacd_reader->get_tracks(AREA_TWOCH);
-	auto mulch_count = sacd_reader->get_tracks(AREA_MULCH);
+	auto twoch_count = reader.get_tracks(AREA_TWOCH);
+	auto mulch_count = reader.get_tracks(AREA_MULCH);
 	
 	// Check our channel mode for database creation
 	auto channel_mode = GetChannelMode();
@@ -453,7 +508,7 @@ scan_file(Path path_fs, TagHandler& handler) noexcept {
 			// Skip stereo tracks in multichannel mode
 			return false;
 		}
-		sacd_reader->select_area(AREA_TWOCH);
+		reader.select_area(AREA_TWOCH);
 	}
 	else {
 		track -= twoch_count;
@@ -463,14 +518,14 @@ scan_file(Path path_fs, TagHandler& handler) noexcept {
 				// Skip multichannel tracks in stereo mode
 				return false;
 			}
-			sacd_reader->select_area(AREA_MULCH);
+			reader.select_area(AREA_MULCH);
 		}
 		else {
 			LogError(sacdiso_domain, "subsong index is out of range");
 			return false;
 		}
 	}
-	scan_info(track, track_index, handler);
+	scan_info(*disc, track, track_index, handler);
 	return true;
 }
 
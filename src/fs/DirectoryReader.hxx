@@ -130,6 +130,28 @@ public:
 		assert(HasEntry());
 		return Path::FromFS(ent->d_name);
 	}
+
+	/**
+	 * Returns the DT_* type of the entry previously read by
+	 * #ReadEntry, or DT_UNKNOWN if the filesystem does not
+	 * provide it.
+	 */
+	unsigned char GetEntryType() const noexcept {
+		assert(HasEntry());
+#ifdef _DIRENT_HAVE_D_TYPE
+		return ent->d_type;
+#else
+		return DT_UNKNOWN;
+#endif
+	}
+
+	/**
+	 * Returns the file descriptor of the directory, to be used
+	 * with fstatat() and friends.
+	 */
+	int GetFD() const noexcept {
+		return dirfd(dirp);
+	}
 };
 
 #endif
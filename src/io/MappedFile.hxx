@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <span>
+
+class Path;
+
+/**
+ * A read-only view of a whole file.  On POSIX systems, the file is
+ * mapped with mmap(); elsewhere, it is read into a heap buffer.
+ */
+class MappedFile {
+	std::span<const std::byte> data;
+
+#ifdef _WIN32
+	std::unique_ptr<std::byte[]> buffer;
+#endif
+
+public:
+	/**
+	 * Throws on error.
+	 */
+	explicit MappedFile(Path path);
+
+	~MappedFile() noexcept;
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	std::span<const std::byte> get() const noexcept {
+		return data;
+	}
+
+	std::size_t size() const noexcept {
+		return data.size();
+	}
+};
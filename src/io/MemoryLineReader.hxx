@@ -0,0 +1,44 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#pragma once
+
+#include "LineReader.hxx"
+
+#include <cstring>
+#include <span>
+
+/**
+ * Reads lines from a buffer in memory.  The buffer is modified:
+ * line endings are replaced with null bytes.  The last line must be
+ * terminated with a newline character; anything after it is
+ * ignored.
+ */
+class MemoryLineReader final : public LineReader {
+	char *position, *const end;
+
+public:
+	explicit MemoryLineReader(std::span<char> buffer) noexcept
+		:position(buffer.data()), end(buffer.data() + buffer.size()) {}
+
+	/* virtual methods from class LineReader */
+	char *ReadLine() noexcept override {
+		if (position == end)
+			return nullptr;
+
+		char *newline = static_cast<char *>(std::memchr(position, '\n',
+								end - position));
+		if (newline == nullptr) {
+			position = end;
+			return nullptr;
+		}
+
+		char *line = position;
+		position = newline + 1;
+
+		if (newline > line && newline[-1] == '\r')
+			--newline;
+		*newline = 0;
+		return line;
+	}
+};
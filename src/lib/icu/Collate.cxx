@@ -10,6 +10,7 @@
 #include "Util.hxx"
 
 #include <unicode/ucol.h>
+#include <unicode/uiter.h>
 #include <unicode/ustring.h>
 #else
 #include <algorithm>
@@ -109,3 +110,73 @@ IcuCollate(std::string_view a, std::string_view b) noexcept
 	return strcoll(std::string(a).c_str(), std::string(b).c_str());
 #endif
 }
+
+std::string
+IcuCollateKey(std::string_view s) noexcept
+{
+#ifdef HAVE_ICU
+	assert(collator != nullptr);
+
+	/* iterate over the UTF-8 string directly, just like
+	   ucol_strcollUTF8() in IcuCollate() does */
+	UCharIterator iter;
+	uiter_setUTF8(&iter, s.data(), s.size());
+
+	uint32_t state[2]{};
+	std::string key;
+
+	while (true) {
+		uint8_t buffer[256];
+		UErrorCode code = U_ZERO_ERROR;
+		const int32_t n = ucol_nextSortKeyPart(collator, &iter, state,
+						       buffer, sizeof(buffer),
+						       &code);
+		if (U_FAILURE(code) || n <= 0)
+			break;
+
+		key.append((const char *)buffer, n);
+		if (std::size_t(n) < sizeof(buffer))
+			break;
+	}
+
+	return key;
+
+#elif defined(_WIN32)
+	BasicAllocatedString<wchar_t> w;
+	try {
+		w = MultiByteToWideChar(CP_UTF8, s);
+	} catch (...) {
+		return {};
+	}
+
+	/* same flags as CompareStringEx() in IcuCollate() */
+	const int size = LCMapStringEx(LOCALE_NAME_INVARIANT,
+				       LCMAP_SORTKEY|NORM_IGNORECASE,
+				       w.c_str(), -1, nullptr, 0,
+				       nullptr, nullptr, 0);
+	if (size <= 0)
+		return {};
+
+	std::string key(size, '\0');
+	LCMapStringEx(LOCALE_NAME_INVARIANT,
+		      LCMAP_SORTKEY|NORM_IGNORECASE,
+		      w.c_str(), -1, (LPWSTR)key.data(), size,
+		      nullptr, nullptr, 0);
+
+	/* strip the null terminator */
+	key.pop_back();
+	return key;
+#else
+	const std::string src(s);
+	std::string key(src.size() * 2 + 1, '\0');
+
+	std::size_t n = strxfrm(key.data(), src.c_str(), key.size());
+	if (n >= key.size()) {
+		key.resize(n + 1);
+		n = strxfrm(key.data(), src.c_str(), key.size());
+	}
+
+	key.resize(n);
+	return key;
+#endif
+}
@@ -4,6 +4,7 @@
 #ifndef MPD_ICU_COLLATE_HXX
 #define MPD_ICU_COLLATE_HXX
 
+#include <string>
 #include <string_view>
 
 /**
@@ -19,4 +20,13 @@ IcuCollateFinish() noexcept;
 int
 IcuCollate(std::string_view a, std::string_view b) noexcept;
 
+/**
+ * Calculate a sort key for the given string.  Comparing two sort keys
+ * with std::string::compare() (i.e. memcmp()) gives the same order as
+ * IcuCollate() on the original strings, which is much cheaper if each
+ * string is compared many times.
+ */
+std::string
+IcuCollateKey(std::string_view s) noexcept;
+
 #endif
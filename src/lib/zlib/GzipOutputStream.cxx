@@ -4,7 +4,7 @@
 #include "GzipOutputStream.hxx"
 #include "Error.hxx"
 
-GzipOutputStream::GzipOutputStream(OutputStream &_next)
+GzipOutputStream::GzipOutputStream(OutputStream &_next, int level)
 	:next(_next)
 {
 	z.next_in = nullptr;
@@ -16,7 +16,7 @@ GzipOutputStream::GzipOutputStream(OutputStream &_next)
 	constexpr int windowBits = MAX_WBITS;
 	constexpr int gzip_encoding = 16;
 
-	int result = deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+	int result = deflateInit2(&z, level, Z_DEFLATED,
 				  windowBits | gzip_encoding,
 				  8, Z_DEFAULT_STRATEGY);
 	if (result != Z_OK)
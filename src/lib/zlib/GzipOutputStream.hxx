@@ -24,8 +24,11 @@ public:
 	 * Construct the filter.
 	 *
 	 * Throws #ZlibError on error.
+	 *
+	 * @param level the zlib compression level
 	 */
-	explicit GzipOutputStream(OutputStream &_next);
+	explicit GzipOutputStream(OutputStream &_next,
+				  int level=Z_DEFAULT_COMPRESSION);
 	~GzipOutputStream() noexcept;
 
 	/**
@@ -0,0 +1,206 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#include "ParallelGzipOutputStream.hxx"
+#include "Error.hxx"
+#include "util/ScopeExit.hxx"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+
+/**
+ * The size of the deflate window; this much of the previous block is
+ * used as dictionary for the next one.
+ */
+static constexpr std::size_t GZIP_DICTIONARY_SIZE = 32768;
+
+void
+ParallelGzipOutputStream::Block::Run() noexcept
+{
+	try {
+		Deflate();
+	} catch (...) {
+		error = std::current_exception();
+	}
+}
+
+void
+ParallelGzipOutputStream::Block::Deflate()
+{
+	crc = crc32(0, reinterpret_cast<const Bytef *>(input.data()),
+		    input.size());
+
+	z_stream z{};
+
+	/* raw deflate; the gzip header and trailer are written by
+	   ParallelGzipOutputStream */
+	int result = deflateInit2(&z, level, Z_DEFLATED, -MAX_WBITS,
+				  8, Z_DEFAULT_STRATEGY);
+	if (result != Z_OK)
+		throw MakeZlibError(result, "deflateInit2() failed");
+
+	AtScopeExit(&z) { deflateEnd(&z); };
+
+	if (!dictionary.empty()) {
+		result = deflateSetDictionary(&z,
+					      reinterpret_cast<const Bytef *>(dictionary.data()),
+					      dictionary.size());
+		if (result != Z_OK)
+			throw MakeZlibError(result, "deflateSetDictionary() failed");
+	}
+
+	/* zlib's API requires non-const input pointer */
+	z.next_in = reinterpret_cast<Bytef *>(input.data());
+	z.avail_in = input.size();
+
+	output.resize(deflateBound(&z, input.size()) + 16);
+	z.next_out = output.data();
+	z.avail_out = output.size();
+
+	/* the sync flush leaves the stream at a byte boundary without
+	   setting the "final" bit, so the next block can be appended */
+	const int flush = last ? Z_FINISH : Z_SYNC_FLUSH;
+
+	while (true) {
+		result = deflate(&z, flush);
+		if (result == Z_STREAM_END ||
+		    (flush == Z_SYNC_FLUSH && result == Z_OK && z.avail_out > 0))
+			break;
+		else if (result != Z_OK && result != Z_BUF_ERROR)
+			throw MakeZlibError(result, "deflate() failed");
+
+		/* deflateBound() does not account for the flush
+		   marker; grow the buffer */
+		const std::size_t position = z.next_out - output.data();
+		output.resize(output.size() * 2);
+		z.next_out = output.data() + position;
+		z.avail_out = output.size() - position;
+	}
+
+	output.resize(z.next_out - output.data());
+}
+
+ParallelGzipOutputStream::ParallelGzipOutputStream(OutputStream &_next,
+						   int _level,
+						   unsigned n_threads,
+						   std::size_t _block_size)
+	:next(_next), level(_level), block_size(_block_size),
+	 pool(n_threads, "gzip"),
+	 /* keep each thread busy with one block while the next
+	    one is being filled */
+	 queue(pool, std::max(pool.GetThreadCount(), 1U) + 1),
+	 crc(crc32(0, Z_NULL, 0))
+{
+	assert(level == Z_DEFAULT_COMPRESSION || (level >= 0 && level <= 9));
+	assert(block_size >= GZIP_DICTIONARY_SIZE);
+
+	current = NewBlock();
+
+	/* the gzip header (RFC 1952): no file name, no mtime, OS
+	   "Unix" like zlib's own gzip encoder */
+	static constexpr std::array<std::byte, 10> header{
+		std::byte{0x1f}, std::byte{0x8b}, std::byte{Z_DEFLATED},
+		std::byte{0},
+		std::byte{0}, std::byte{0}, std::byte{0}, std::byte{0},
+		std::byte{0}, std::byte{3},
+	};
+
+	next.Write(header);
+}
+
+std::unique_ptr<ParallelGzipOutputStream::Block>
+ParallelGzipOutputStream::NewBlock() noexcept
+{
+	std::unique_ptr<Block> block;
+	if (spare.empty()) {
+		block = std::make_unique<Block>(level);
+	} else {
+		block = std::move(spare.back());
+		spare.pop_back();
+		block->error = {};
+	}
+
+	block->input.clear();
+	block->input.reserve(block_size);
+	return block;
+}
+
+void
+ParallelGzipOutputStream::Submit()
+{
+	auto &block = *current;
+
+	block.dictionary.clear();
+	if (previous_input != nullptr) {
+		const std::size_t n = std::min(previous_input->size(),
+					       GZIP_DICTIONARY_SIZE);
+		block.dictionary.assign(previous_input->end() - n,
+					previous_input->end());
+	}
+
+	previous_input = &block.input;
+
+	if (queue.IsFull())
+		WriteOldest();
+
+	queue.Push(std::move(current));
+
+	if (!block.last)
+		current = NewBlock();
+}
+
+void
+ParallelGzipOutputStream::WriteOldest()
+{
+	auto block = queue.Pop();
+
+	next.Write(std::as_bytes(std::span{block->output}));
+
+	crc = crc32_combine(crc, block->crc, block->input.size());
+	total_size += block->input.size();
+
+	if (previous_input == &block->input)
+		previous_input = nullptr;
+
+	spare.emplace_back(std::move(block));
+}
+
+void
+ParallelGzipOutputStream::Finish()
+{
+	assert(current != nullptr);
+
+	current->last = true;
+	Submit();
+
+	while (!queue.IsEmpty())
+		WriteOldest();
+
+	/* the gzip trailer: CRC32 and the input size (modulo 2^32),
+	   both little-endian */
+	std::array<std::byte, 8> trailer;
+	for (unsigned i = 0; i < 4; ++i) {
+		trailer[i] = std::byte(crc >> (8 * i));
+		trailer[4 + i] = std::byte(total_size >> (8 * i));
+	}
+
+	next.Write(trailer);
+}
+
+void
+ParallelGzipOutputStream::Write(std::span<const std::byte> src)
+{
+	assert(current != nullptr);
+
+	while (!src.empty()) {
+		auto &input = current->input;
+		const std::size_t n = std::min(src.size(),
+					       block_size - input.size());
+		input.insert(input.end(), src.begin(), src.begin() + n);
+		src = src.subspan(n);
+
+		if (input.size() >= block_size)
+			Submit();
+	}
+}
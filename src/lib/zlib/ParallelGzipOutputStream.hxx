@@ -0,0 +1,125 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#ifndef MPD_PARALLEL_GZIP_OUTPUT_STREAM_HXX
+#define MPD_PARALLEL_GZIP_OUTPUT_STREAM_HXX
+
+#include "io/OutputStream.hxx"
+#include "thread/OrderedJobQueue.hxx"
+
+#include <zlib.h>
+
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <vector>
+
+/**
+ * Like #GzipOutputStream, but the input is split into blocks which
+ * are deflated concurrently by a #WorkerPool (the same technique as
+ * "pigz").  Each block is primed with the last 32 kB of the previous
+ * block as preset dictionary and ends with a sync flush, so the
+ * compressed blocks can simply be concatenated; the result is a
+ * single standard gzip member.
+ *
+ * Don't forget to call Finish() before destructing this object.
+ */
+class ParallelGzipOutputStream final : public OutputStream {
+	class Block final : public WorkerPool::Job {
+	public:
+		const int level;
+
+		std::vector<std::byte> dictionary, input;
+		std::vector<Bytef> output;
+
+		uLong crc;
+
+		std::exception_ptr error;
+
+		/**
+		 * Is this the last block of the stream?
+		 */
+		bool last = false;
+
+		explicit Block(int _level) noexcept
+			:level(_level) {}
+
+		/* virtual methods from class WorkerPool::Job */
+		void Run() noexcept override;
+
+	private:
+		void Deflate();
+	};
+
+	OutputStream &next;
+
+	const int level;
+
+	const std::size_t block_size;
+
+	WorkerPool pool;
+
+	/**
+	 * The block which is currently being filled by Write().
+	 */
+	std::unique_ptr<Block> current;
+
+	/**
+	 * Blocks submitted to the #pool, in stream order.
+	 */
+	OrderedJobQueue<Block> queue;
+
+	/**
+	 * Finished blocks whose buffers can be reused.
+	 */
+	std::vector<std::unique_ptr<Block>> spare;
+
+	/**
+	 * The input of the block which was submitted last; its tail
+	 * is the dictionary of the next block.
+	 */
+	const std::vector<std::byte> *previous_input = nullptr;
+
+	uLong crc;
+	uLong total_size = 0;
+
+public:
+	/**
+	 * Throws on error.
+	 *
+	 * @param _level the zlib compression level
+	 * (#Z_DEFAULT_COMPRESSION or 0..9)
+	 * @param n_threads the number of worker threads; 0 deflates
+	 * all blocks in the calling thread
+	 * @param _block_size the amount of input per block
+	 */
+	ParallelGzipOutputStream(OutputStream &_next, int _level,
+				 unsigned n_threads,
+				 std::size_t _block_size=128 * 1024);
+
+	/**
+	 * Deflate the remaining data and write the gzip trailer.
+	 *
+	 * Throws on error.
+	 */
+	void Finish();
+
+	/* virtual methods from class OutputStream */
+	void Write(std::span<const std::byte> src) override;
+
+private:
+	std::unique_ptr<Block> NewBlock() noexcept;
+
+	/**
+	 * Submit #current to the pool.  If too many blocks are in
+	 * flight, the oldest one is written first.
+	 */
+	void Submit();
+
+	/**
+	 * Wait for the oldest submitted block and write its output.
+	 */
+	void WriteOldest();
+};
+
+#endif
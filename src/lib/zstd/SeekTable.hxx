@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#ifndef MPD_ZSTD_SEEK_TABLE_HXX
+#define MPD_ZSTD_SEEK_TABLE_HXX
+
+#include "util/PackedLittleEndian.hxx"
+
+#include <cstdint>
+
+/*
+ * The seek table of the zstd "seekable format" (see
+ * contrib/seekable_format in the zstd sources): a skippable frame at
+ * the end of the file which lists the compressed and decompressed
+ * size of each frame.  Decoders which do not know it skip it.
+ */
+
+static constexpr uint32_t ZSTD_FRAME_MAGIC = 0xfd2fb528;
+static constexpr uint32_t ZSTD_SEEK_TABLE_MAGIC = 0x184d2a5e;
+static constexpr uint32_t ZSTD_SEEKABLE_MAGIC = 0x8f92eab1;
+
+/**
+ * Bit in ZstdSeekTableFooter::descriptor: each entry is followed by
+ * a 32 bit checksum.
+ */
+static constexpr uint8_t ZSTD_SEEK_TABLE_CHECKSUM_FLAG = 0x80;
+
+struct ZstdSkippableHeader {
+	PackedLE32 magic;
+
+	/**
+	 * The size of the frame after this header.
+	 */
+	PackedLE32 size;
+};
+
+struct ZstdSeekTableEntry {
+	PackedLE32 compressed_size;
+	PackedLE32 decompressed_size;
+};
+
+struct ZstdSeekTableFooter {
+	PackedLE32 n_frames;
+	uint8_t descriptor;
+	PackedLE32 magic;
+};
+
+static_assert(sizeof(ZstdSkippableHeader) == 8);
+static_assert(sizeof(ZstdSeekTableEntry) == 8);
+static_assert(sizeof(ZstdSeekTableFooter) == 9);
+
+#endif
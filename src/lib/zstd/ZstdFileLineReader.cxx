@@ -0,0 +1,215 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#include "ZstdFileLineReader.hxx"
+#include "SeekTable.hxx"
+#include "io/FileReader.hxx"
+#include "fs/Path.hxx"
+#include "lib/fmt/RuntimeError.hxx"
+#include "util/ScopeExit.hxx"
+
+#include <zstd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+bool
+IsZstdFile(Path path) noexcept
+try {
+	FileReader reader{path};
+
+	PackedLE32 magic;
+	return reader.Read(std::as_writable_bytes(std::span{&magic, 1})) == sizeof(magic) &&
+		magic == ZSTD_FRAME_MAGIC;
+} catch (...) {
+	return false;
+}
+
+void
+ZstdFileLineReader::Frame::Run() noexcept
+{
+	try {
+		Decompress();
+	} catch (...) {
+		error = std::current_exception();
+	}
+}
+
+void
+ZstdFileLineReader::Frame::Decompress()
+{
+	ZSTD_DCtx *const dctx = ZSTD_createDCtx();
+	if (dctx == nullptr)
+		throw std::bad_alloc{};
+
+	AtScopeExit(dctx) { ZSTD_freeDCtx(dctx); };
+
+	/* one more byte than expected, so the loop below sees that
+	   the output buffer was not filled completely */
+	output.resize(size_hint > 0
+		      ? size_hint + 1
+		      : std::max<std::size_t>(input.size() * 4, 65536));
+
+	ZSTD_inBuffer in{input.data(), input.size(), 0};
+	std::size_t position = 0, result;
+
+	while (true) {
+		if (position == output.size())
+			output.resize(output.size() * 2);
+
+		ZSTD_outBuffer out{output.data(), output.size(), position};
+		result = ZSTD_decompressStream(dctx, &out, &in);
+		if (ZSTD_isError(result))
+			throw FmtRuntimeError("ZSTD_decompressStream() failed: {}",
+					      ZSTD_getErrorName(result));
+
+		position = out.pos;
+		if (in.pos == in.size && out.pos < out.size)
+			break;
+	}
+
+	if (result != 0)
+		throw std::runtime_error("Truncated zstd frame");
+
+	output.resize(position);
+}
+
+ZstdFileLineReader::ZstdFileLineReader(Path path_fs, unsigned n_threads)
+	:pool(n_threads, "unzstd"),
+	 /* keep all threads busy with frames ahead of the reader */
+	 queue(pool, std::max(pool.GetThreadCount(), 1U))
+{
+	FileReader reader{path_fs};
+
+	file.resize(reader.GetSize());
+	std::size_t fill = 0;
+	while (fill < file.size()) {
+		const std::size_t nbytes = reader.Read(std::span{file}.subspan(fill));
+		if (nbytes == 0)
+			throw std::runtime_error("Unexpected end of file");
+
+		fill += nbytes;
+	}
+
+	if (!LoadSeekTable()) {
+		/* no seek table: decompress all frames in one job */
+		auto &frame = *frames.emplace_back(std::make_unique<Frame>());
+		frame.input = file;
+	}
+}
+
+bool
+ZstdFileLineReader::LoadSeekTable() noexcept
+{
+	const std::span<const std::byte> src{file};
+	if (src.size() < sizeof(ZstdSkippableHeader) + sizeof(ZstdSeekTableFooter))
+		return false;
+
+	ZstdSeekTableFooter footer;
+	std::memcpy(&footer, src.data() + src.size() - sizeof(footer),
+		    sizeof(footer));
+	if (footer.magic != ZSTD_SEEKABLE_MAGIC)
+		return false;
+
+	const std::size_t entry_size = sizeof(ZstdSeekTableEntry) +
+		((footer.descriptor & ZSTD_SEEK_TABLE_CHECKSUM_FLAG) ? 4 : 0);
+	const std::size_t n_frames = footer.n_frames;
+	const std::size_t table_size = n_frames * entry_size + sizeof(footer);
+	if (src.size() < sizeof(ZstdSkippableHeader) + table_size)
+		return false;
+
+	const std::size_t table_offset = src.size() - table_size;
+
+	ZstdSkippableHeader header;
+	std::memcpy(&header, src.data() + table_offset - sizeof(header),
+		    sizeof(header));
+	if (header.magic != ZSTD_SEEK_TABLE_MAGIC || header.size != table_size)
+		return false;
+
+	const std::size_t data_size = table_offset - sizeof(header);
+
+	std::vector<std::unique_ptr<Frame>> result;
+	result.reserve(n_frames);
+
+	std::size_t offset = 0;
+	for (std::size_t i = 0; i < n_frames; ++i) {
+		ZstdSeekTableEntry entry;
+		std::memcpy(&entry, src.data() + table_offset + i * entry_size,
+			    sizeof(entry));
+
+		const std::size_t size = entry.compressed_size;
+		if (size > data_size - offset)
+			return false;
+
+		auto &frame = *result.emplace_back(std::make_unique<Frame>());
+		frame.input = src.subspan(offset, size);
+		frame.size_hint = entry.decompressed_size;
+		offset += size;
+	}
+
+	if (offset != data_size)
+		return false;
+
+	frames = std::move(result);
+	return true;
+}
+
+bool
+ZstdFileLineReader::NextFrame()
+{
+	while (next_submit < frames.size() && !queue.IsFull())
+		queue.Push(std::move(frames[next_submit++]));
+
+	if (queue.IsEmpty())
+		return false;
+
+	const auto frame = queue.Pop();
+
+	if (position == end) {
+		buffer = std::move(frame->output);
+	} else {
+		/* a line continues in this frame */
+		std::vector<char> joined(position, end);
+		joined.insert(joined.end(),
+			      frame->output.begin(), frame->output.end());
+		buffer = std::move(joined);
+	}
+
+	buffer.push_back('\0');
+	position = buffer.data();
+	end = position + buffer.size() - 1;
+	return true;
+}
+
+char *
+ZstdFileLineReader::ReadLine()
+{
+	while (true) {
+		char *newline = position != end
+			? static_cast<char *>(std::memchr(position, '\n',
+							  end - position))
+			: nullptr;
+		if (newline != nullptr) {
+			char *line = position;
+			position = newline + 1;
+
+			if (newline > line && newline[-1] == '\r')
+				--newline;
+			*newline = 0;
+			return line;
+		}
+
+		if (!NextFrame())
+			break;
+	}
+
+	if (position == end)
+		return nullptr;
+
+	/* the last line is not terminated; #buffer has a null byte
+	   after it */
+	char *line = position;
+	position = end;
+	return line;
+}
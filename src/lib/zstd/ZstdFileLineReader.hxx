@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#ifndef MPD_ZSTD_FILE_LINE_READER_HXX
+#define MPD_ZSTD_FILE_LINE_READER_HXX
+
+#include "io/LineReader.hxx"
+#include "thread/OrderedJobQueue.hxx"
+
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <span>
+#include <vector>
+
+class Path;
+
+/**
+ * Does the file start with a zstd frame?
+ */
+[[gnu::pure]]
+bool
+IsZstdFile(Path path) noexcept;
+
+/**
+ * Reads lines from a zstd-compressed file.  If the file has a seek
+ * table (see #ZstdOutputStream), the frames are decompressed by a
+ * #WorkerPool a few frames ahead of the caller; otherwise, the whole
+ * file is decompressed at once.
+ */
+class ZstdFileLineReader final : public LineReader {
+	class Frame final : public WorkerPool::Job {
+	public:
+		std::span<const std::byte> input;
+
+		/**
+		 * The decompressed size according to the seek table,
+		 * or 0 if unknown.
+		 */
+		std::size_t size_hint = 0;
+
+		std::vector<char> output;
+
+		std::exception_ptr error;
+
+		/* virtual methods from class WorkerPool::Job */
+		void Run() noexcept override;
+
+	private:
+		void Decompress();
+	};
+
+	std::vector<std::byte> file;
+
+	WorkerPool pool;
+
+	/**
+	 * All frames of the file; they are moved to #queue when they
+	 * are submitted.
+	 */
+	std::vector<std::unique_ptr<Frame>> frames;
+
+	/**
+	 * The index of the next frame to be submitted to the #pool.
+	 */
+	std::size_t next_submit = 0;
+
+	/**
+	 * Frames being decompressed ahead of the reader.
+	 */
+	OrderedJobQueue<Frame> queue;
+
+	/**
+	 * The decompressed data being read, terminated with a null
+	 * byte.
+	 */
+	std::vector<char> buffer;
+
+	char *position = nullptr, *end = nullptr;
+
+public:
+	/**
+	 * Throws on error.
+	 *
+	 * @param n_threads the number of decompression threads
+	 */
+	ZstdFileLineReader(Path path_fs, unsigned n_threads);
+
+	ZstdFileLineReader(const ZstdFileLineReader &) = delete;
+	ZstdFileLineReader &operator=(const ZstdFileLineReader &) = delete;
+
+	/* virtual methods from class LineReader */
+	char *ReadLine() override;
+
+private:
+	/**
+	 * Parse the seek table and create a #Frame for each frame.
+	 * Returns false if there is no (valid) seek table.
+	 */
+	bool LoadSeekTable() noexcept;
+
+	/**
+	 * Move the next decompressed frame into #buffer, after the
+	 * unread rest of the previous one.  Returns false at the end
+	 * of the file.
+	 *
+	 * Throws on error.
+	 */
+	bool NextFrame();
+};
+
+#endif
@@ -0,0 +1,137 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#include "ZstdOutputStream.hxx"
+#include "SeekTable.hxx"
+#include "lib/fmt/RuntimeError.hxx"
+
+#include <algorithm>
+#include <cassert>
+#include <new>
+
+/**
+ * The seek table stores 32 bit sizes; longer frames are split.
+ */
+static constexpr uint64_t MAX_FRAME_SIZE = 1024 * 1024 * 1024;
+
+[[noreturn]]
+static void
+ThrowZstdError(std::size_t code, const char *msg)
+{
+	throw FmtRuntimeError("{}: {}", msg, ZSTD_getErrorName(code));
+}
+
+ZstdOutputStream::ZstdOutputStream(OutputStream &_next, int level,
+				   unsigned n_threads,
+				   std::size_t _min_frame_size)
+	:next(_next), cctx(ZSTD_createCCtx()),
+	 min_frame_size(_min_frame_size)
+{
+	if (cctx == nullptr)
+		throw std::bad_alloc{};
+
+	std::size_t result = ZSTD_CCtx_setParameter(cctx,
+						    ZSTD_c_compressionLevel,
+						    level);
+	if (ZSTD_isError(result)) {
+		ZSTD_freeCCtx(cctx);
+		ThrowZstdError(result, "Invalid zstd compression level");
+	}
+
+	/* this fails if libzstd was built without multi-threading;
+	   compress in this thread then */
+	if (n_threads > 1)
+		ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, n_threads);
+}
+
+ZstdOutputStream::~ZstdOutputStream() noexcept
+{
+	ZSTD_freeCCtx(cctx);
+}
+
+void
+ZstdOutputStream::Compress(std::span<const std::byte> src,
+			   ZSTD_EndDirective mode)
+{
+	ZSTD_inBuffer in{src.data(), src.size(), 0};
+
+	while (true) {
+		std::byte output[65536];
+		ZSTD_outBuffer out{output, sizeof(output), 0};
+
+		const std::size_t remaining =
+			ZSTD_compressStream2(cctx, &out, &in, mode);
+		if (ZSTD_isError(remaining))
+			ThrowZstdError(remaining, "ZSTD_compressStream2() failed");
+
+		if (out.pos > 0) {
+			next.Write(std::span{output}.first(out.pos));
+			frame_output += out.pos;
+		}
+
+		if (mode == ZSTD_e_continue
+		    ? in.pos == in.size
+		    : remaining == 0)
+			break;
+	}
+
+	frame_input += src.size();
+}
+
+void
+ZstdOutputStream::EndFrame()
+{
+	if (frame_input == 0)
+		return;
+
+	Compress({}, ZSTD_e_end);
+
+	assert(frame_output <= UINT32_MAX);
+	frames.push_back({uint32_t(frame_output), uint32_t(frame_input)});
+	frame_input = frame_output = 0;
+}
+
+void
+ZstdOutputStream::FrameBoundary()
+{
+	if (frame_input >= min_frame_size)
+		EndFrame();
+}
+
+void
+ZstdOutputStream::Finish()
+{
+	EndFrame();
+
+	std::vector<ZstdSeekTableEntry> entries;
+	entries.reserve(frames.size());
+	for (const auto &i : frames)
+		entries.push_back({i.compressed, i.decompressed});
+
+	const ZstdSeekTableFooter footer{
+		uint32_t(frames.size()), 0, ZSTD_SEEKABLE_MAGIC,
+	};
+
+	const ZstdSkippableHeader header{
+		ZSTD_SEEK_TABLE_MAGIC,
+		uint32_t(entries.size() * sizeof(entries.front()) + sizeof(footer)),
+	};
+
+	next.Write(std::as_bytes(std::span{&header, 1}));
+	next.Write(std::as_bytes(std::span{entries}));
+	next.Write(std::as_bytes(std::span{&footer, 1}));
+}
+
+void
+ZstdOutputStream::Write(std::span<const std::byte> src)
+{
+	while (!src.empty()) {
+		const std::size_t n = std::min<uint64_t>(src.size(),
+							 MAX_FRAME_SIZE - frame_input);
+		Compress(src.first(n), ZSTD_e_continue);
+		src = src.subspan(n);
+
+		if (frame_input >= MAX_FRAME_SIZE)
+			EndFrame();
+	}
+}
@@ -0,0 +1,90 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#ifndef MPD_ZSTD_OUTPUT_STREAM_HXX
+#define MPD_ZSTD_OUTPUT_STREAM_HXX
+
+#include "io/OutputStream.hxx"
+
+#include <zstd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * A filter that compresses data written to it using zstd.  The
+ * output consists of independent frames and ends with a seek table
+ * (the zstd "seekable format"), which allows a reader to decompress
+ * the frames in parallel.  The file can still be decompressed by any
+ * zstd decoder.
+ *
+ * Don't forget to call Finish() before destructing this object.
+ */
+class ZstdOutputStream final : public OutputStream {
+	OutputStream &next;
+
+	ZSTD_CCtx *const cctx;
+
+	/**
+	 * FrameBoundary() ends the current frame only if it has at
+	 * least this many bytes of input.
+	 */
+	const std::size_t min_frame_size;
+
+	/**
+	 * The number of input and output bytes of the current frame.
+	 */
+	uint64_t frame_input = 0, frame_output = 0;
+
+	struct FrameSize {
+		uint32_t compressed, decompressed;
+	};
+
+	std::vector<FrameSize> frames;
+
+public:
+	/**
+	 * Throws on error.
+	 *
+	 * @param level the zstd compression level
+	 * @param n_threads the number of zstd worker threads (if
+	 * libzstd supports multi-threading); 0 or 1 compresses in the
+	 * calling thread
+	 * @param _min_frame_size see FrameBoundary()
+	 */
+	ZstdOutputStream(OutputStream &_next, int level, unsigned n_threads,
+			 std::size_t _min_frame_size=1024 * 1024);
+
+	~ZstdOutputStream() noexcept;
+
+	ZstdOutputStream(const ZstdOutputStream &) = delete;
+	ZstdOutputStream &operator=(const ZstdOutputStream &) = delete;
+
+	/**
+	 * The caller has finished a logical record (e.g. a
+	 * directory); end the current frame here unless it is still
+	 * small.  Frames which span several small records compress
+	 * better.
+	 *
+	 * Throws on error.
+	 */
+	void FrameBoundary();
+
+	/**
+	 * Finish the last frame and write the seek table.
+	 *
+	 * Throws on error.
+	 */
+	void Finish();
+
+	/* virtual methods from class OutputStream */
+	void Write(std::span<const std::byte> src) override;
+
+private:
+	void Compress(std::span<const std::byte> src, ZSTD_EndDirective mode);
+
+	void EndFrame();
+};
+
+#endif
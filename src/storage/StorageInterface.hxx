@@ -3,14 +3,15 @@
 
 #pragma once
 
+#include "FileInfo.hxx"
 #include "input/Ptr.hxx"
 #include "thread/Mutex.hxx"
 
 #include <memory>
+#include <optional>
 #include <string>
 #include <string_view>
 
-struct StorageFileInfo;
 class AllocatedPath;
 
 class StorageDirectoryReader {
@@ -27,6 +28,17 @@ public:
 	 */
 	[[nodiscard]]
 	virtual StorageFileInfo GetInfo(bool follow) = 0;
+
+	/**
+	 * Returns the type of the current entry if it is known
+	 * without calling GetInfo(), e.g. from readdir().  Returns
+	 * std::nullopt if the type is unknown or if the entry is a
+	 * symlink.
+	 */
+	[[nodiscard]]
+	virtual std::optional<StorageFileInfo::Type> GetType() noexcept {
+		return std::nullopt;
+	}
 };
 
 class Storage {
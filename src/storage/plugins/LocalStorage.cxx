@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 // Copyright The Music Player Daemon Project
 
+#include "config.h"
 #include "LocalStorage.hxx"
 #include "storage/StoragePlugin.hxx"
 #include "storage/StorageInterface.hxx"
@@ -10,10 +11,18 @@
 #include "fs/FileInfo.hxx"
 #include "fs/AllocatedPath.hxx"
 #include "fs/DirectoryReader.hxx"
+#include "lib/fmt/PathFormatter.hxx"
+#include "lib/fmt/SystemError.hxx"
 #include "util/StringCompare.hxx"
 
 #include <string>
 
+#ifndef _WIN32
+#include <fcntl.h> // for AT_SYMLINK_NOFOLLOW
+#include <sys/stat.h>
+#include <sys/sysmacros.h> // for makedev()
+#endif
+
 class LocalDirectoryReader final : public StorageDirectoryReader {
 	AllocatedPath base_fs;
 
@@ -28,6 +37,7 @@ public:
 	/* virtual methods from class StorageDirectoryReader */
 	const char *Read() noexcept override;
 	StorageFileInfo GetInfo(bool follow) override;
+	std::optional<StorageFileInfo::Type> GetType() noexcept override;
 };
 
 class LocalStorage final : public Storage {
@@ -82,6 +92,63 @@ Stat(Path path, bool follow)
 	return info;
 }
 
+#ifndef _WIN32
+
+static constexpr StorageFileInfo::Type
+ModeToType(unsigned mode) noexcept
+{
+	if (S_ISREG(mode))
+		return StorageFileInfo::Type::REGULAR;
+	else if (S_ISDIR(mode))
+		return StorageFileInfo::Type::DIRECTORY;
+	else
+		return StorageFileInfo::Type::OTHER;
+}
+
+/**
+ * Like Stat(), but look up the name relative to an open directory,
+ * which saves the kernel from walking the whole path again.
+ *
+ * @param directory_path the path of the directory; only used for
+ * error messages
+ */
+static StorageFileInfo
+StatAt(int directory_fd, Path directory_path, Path name, bool follow)
+{
+	const int flags = follow ? 0 : AT_SYMLINK_NOFOLLOW;
+	StorageFileInfo info;
+
+#ifdef HAVE_STATX
+	/* request only the fields we need; this may save the
+	   filesystem (e.g. NFS) some work */
+	struct statx stx;
+	if (statx(directory_fd, name.c_str(), flags,
+		  STATX_TYPE|STATX_MODE|STATX_SIZE|STATX_MTIME|STATX_INO,
+		  &stx) < 0)
+		throw FmtErrno("Failed to access {}", directory_path / name);
+
+	info.type = ModeToType(stx.stx_mode);
+	info.size = stx.stx_size;
+	info.mtime = std::chrono::system_clock::from_time_t(stx.stx_mtime.tv_sec);
+	info.device = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+	info.inode = stx.stx_ino;
+#else
+	struct stat st;
+	if (fstatat(directory_fd, name.c_str(), &st, flags) < 0)
+		throw FmtErrno("Failed to access {}", directory_path / name);
+
+	info.type = ModeToType(st.st_mode);
+	info.size = st.st_size;
+	info.mtime = std::chrono::system_clock::from_time_t(st.st_mtime);
+	info.device = st.st_dev;
+	info.inode = st.st_ino;
+#endif
+
+	return info;
+}
+
+#endif
+
 std::string
 LocalStorage::MapUTF8(std::string_view uri_utf8) const noexcept
 {
@@ -159,7 +226,34 @@ LocalDirectoryReader::Read() noexcept
 StorageFileInfo
 LocalDirectoryReader::GetInfo(bool follow)
 {
+#ifdef _WIN32
 	return Stat(base_fs / reader.GetEntry(), follow);
+#else
+	return StatAt(reader.GetFD(), base_fs, reader.GetEntry(), follow);
+#endif
+}
+
+std::optional<StorageFileInfo::Type>
+LocalDirectoryReader::GetType() noexcept
+{
+#ifdef _WIN32
+	return std::nullopt;
+#else
+	switch (reader.GetEntryType()) {
+	case DT_REG:
+		return StorageFileInfo::Type::REGULAR;
+
+	case DT_DIR:
+		return StorageFileInfo::Type::DIRECTORY;
+
+	case DT_UNKNOWN:
+	case DT_LNK:
+		return std::nullopt;
+
+	default:
+		return StorageFileInfo::Type::OTHER;
+	}
+#endif
 }
 
 std::unique_ptr<Storage>
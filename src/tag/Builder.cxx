@@ -20,9 +20,8 @@ TagBuilder::TagBuilder(const Tag &other) noexcept
 	const std::size_t n = other.num_items;
 	if (n > 0) {
 		items.reserve(other.num_items);
-		const std::scoped_lock protect{tag_pool_lock};
 		for (std::size_t i = 0; i != n; ++i)
-			items.push_back(tag_pool_dup_item(other.items[i]));
+			items.push_back(tag_pool_dup_item(other.GetItems()[i]));
 	}
 }
 
@@ -33,12 +32,11 @@ TagBuilder::TagBuilder(Tag &&other) noexcept
 	   need to contact the tag pool, because all we do is move
 	   references */
 	items.reserve(other.num_items);
-	std::copy_n(other.items, other.num_items, std::back_inserter(items));
+	std::copy_n(other.GetItems(), other.num_items,
+		    std::back_inserter(items));
 
 	/* discard the pointers from the Tag object */
-	other.num_items = 0;
-	delete[] other.items;
-	other.items = nullptr;
+	other.FreeItems();
 }
 
 TagBuilder &
@@ -54,7 +52,6 @@ TagBuilder::operator=(const TagBuilder &other) noexcept
 		items = other.items;
 
 		/* increment the tag pool refcounters */
-		const std::scoped_lock protect{tag_pool_lock};
 		for (auto &i : items)
 			i = tag_pool_dup_item(i);
 	}
@@ -88,12 +85,11 @@ TagBuilder::operator=(Tag &&other) noexcept
 	   references */
 	RemoveAll();
 	items.reserve(other.num_items);
-	std::copy_n(other.items, other.num_items, std::back_inserter(items));
+	std::copy_n(other.GetItems(), other.num_items,
+		    std::back_inserter(items));
 
 	/* discard the pointers from the Tag object */
-	other.num_items = 0;
-	delete[] other.items;
-	other.items = nullptr;
+	other.FreeItems();
 
 	return *this;
 }
@@ -119,9 +115,7 @@ TagBuilder::Commit(Tag &tag) noexcept
 	   vector::clear() call is important to detach them from this
 	   object */
 	const unsigned n_items = items.size();
-	tag.num_items = n_items;
-	tag.items = new TagItem *[n_items];
-	std::copy_n(items.begin(), n_items, tag.items);
+	std::copy_n(items.begin(), n_items, tag.AllocItems(n_items));
 	items.clear();
 
 	/* now ensure that this object is fresh (will not delete any
@@ -170,9 +164,8 @@ TagBuilder::Complement(const Tag &other) noexcept
 
 		items.reserve(items.size() + n);
 
-		const std::scoped_lock protect{tag_pool_lock};
 		for (std::size_t i = 0; i != n; ++i) {
-			TagItem *item = other.items[i];
+			TagItem *item = other.GetItems()[i];
 			if (!present[item->type])
 				items.push_back(tag_pool_dup_item(item));
 		}
@@ -182,14 +175,7 @@ TagBuilder::Complement(const Tag &other) noexcept
 void
 TagBuilder::AddItemUnchecked(TagType type, std::string_view value) noexcept
 {
-	TagItem *i;
-
-	{
-		const std::scoped_lock protect{tag_pool_lock};
-		i = tag_pool_get_item(type, value);
-	}
-
-	items.push_back(i);
+	items.push_back(tag_pool_get_item(type, value));
 }
 
 inline void
@@ -222,16 +208,8 @@ TagBuilder::AddEmptyItem(TagType type) noexcept
 void
 TagBuilder::RemoveAll() noexcept
 {
-	if (items.empty())
-		/* don't acquire the tag_pool_lock if we're not going
-		   to call tag_pool_put_item() anyway */
-		return;
-
-	{
-		const std::scoped_lock protect{tag_pool_lock};
-		for (auto i : items)
-			tag_pool_put_item(i);
-	}
+	for (auto i : items)
+		tag_pool_put_item(i);
 
 	items.clear();
 }
@@ -239,14 +217,8 @@ TagBuilder::RemoveAll() noexcept
 void
 TagBuilder::RemoveType(TagType type) noexcept
 {
-	if (items.empty())
-		/* don't acquire the tag_pool_lock if we're not going
-		   to call tag_pool_put_item() anyway */
-		return;
-
 	const auto begin = items.begin(), end = items.end();
 
-	const std::scoped_lock protect{tag_pool_lock};
 	items.erase(std::remove_if(begin, end,
 				   [type](TagItem *item) {
 					   if (item->type != type)
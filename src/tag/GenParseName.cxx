@@ -3,63 +3,123 @@
 
 #include "Names.hxx"
 
+#include <cstdint>
 #include <cstdlib>
-#include <map>
 #include <string_view>
+#include <vector>
 
 #include <stdio.h>
 
 /*
 
-  This program generates an optimized parser for tag names, by doign
-  switch() on the first character.  This reduces the number of
-  strcmp() calls.
+  This program generates an optimized parser for tag names: a
+  perfect hash table, so each lookup needs only one string
+  comparison.  The hash seed and the table size are chosen here
+  such that no two tag names collide.
 
  */
 
+static constexpr uint_least32_t
+Hash(std::string_view name, uint_least32_t seed) noexcept
+{
+	uint_least32_t hash = seed;
+	for (const char ch : name)
+		hash = ((hash ^ static_cast<unsigned char>(ch)) * 0x01000193) & 0xffffffff;
+	return hash;
+}
+
+static bool
+IsPerfect(uint_least32_t seed, std::size_t size) noexcept
+{
+	std::vector<bool> used(size);
+	for (const char *name : tag_item_names) {
+		const std::size_t i = (Hash(name, seed) >> 16) % size;
+		if (used[i])
+			return false;
+
+		used[i] = true;
+	}
+
+	return true;
+}
+
 int
 main(int argc, [[maybe_unused]] char **argv)
 {
 	if (argc != 1)
 		return EXIT_FAILURE;
 
-	std::map<std::string_view, TagType> names;
+	uint_least32_t seed;
+	std::size_t size = 64;
+	while (true) {
+		bool found = false;
+		for (seed = 0x811c9dc5; seed < 0x811c9dc5 + 100000; ++seed) {
+			if (IsPerfect(seed, size)) {
+				found = true;
+				break;
+			}
+		}
+
+		if (found)
+			break;
+
+		size *= 2;
+	}
+
+	std::vector<int> table(size, -1);
 	for (unsigned i = 0; i < unsigned(TAG_NUM_OF_ITEM_TYPES); ++i)
-		names[tag_item_names[i]] = TagType(i);
+		table[(Hash(tag_item_names[i], seed) >> 16) % size] = i;
 
 	printf("#include \"ParseName.hxx\"\n"
 	       "#include \"Type.hxx\"\n"
 	       "\n"
 	       "#include <assert.h>\n"
-	       "#include <string.h>\n"
+	       "#include <stdint.h>\n"
 	       "\n"
-	       "TagType\n"
-	       "tag_name_parse(const char *name) noexcept\n"
-	       "{\n"
-	       "  assert(name != nullptr);\n"
+	       "using std::string_view_literals::operator\"\"sv;\n"
 	       "\n"
-	       "  switch (*name++) {\n");
-
-	char first = 0;
-
-	for (const auto &[name, tag] : names) {
-		if (name.front() != first) {
-			if (first != 0)
-				printf("    break;\n\n");
-			first = name.front();
-			printf("  case '%c':\n", first);
-		}
+	       "static constexpr std::string_view tag_name_table[%zu] = {\n",
+	       size);
 
-		printf("    if (strcmp(name, ((const char *)\"%.*s\") + 1) == 0) return TagType(%u);\n",
-		       int(name.size()), name.data(), unsigned(tag));
+	for (const int i : table) {
+		if (i < 0)
+			printf("  {},\n");
+		else
+			printf("  \"%s\"sv,\n", tag_item_names[i]);
 	}
 
-	printf("    break;\n\n");
+	printf("};\n"
+	       "\n"
+	       "static constexpr uint8_t tag_type_table[%zu] = {\n",
+	       size);
+
+	for (const int i : table)
+		printf("  %u,\n", i < 0 ? unsigned(TAG_NUM_OF_ITEM_TYPES) : unsigned(i));
 
-	printf("  }\n"
+	printf("};\n"
+	       "\n"
+	       "TagType\n"
+	       "tag_name_parse(std::string_view name) noexcept\n"
+	       "{\n"
+	       "  uint_least32_t hash = %uU;\n"
+	       "  for (const char ch : name)\n"
+	       "    hash = ((hash ^ static_cast<unsigned char>(ch)) * 0x01000193) & 0xffffffff;\n"
+	       "\n"
+	       "  const auto i = (hash >> 16) %% %zu;\n"
+	       "  if (name != tag_name_table[i] || name.empty())\n"
+	       "    return TAG_NUM_OF_ITEM_TYPES;\n"
+	       "\n"
+	       "  return TagType(tag_type_table[i]);\n"
+	       "}\n"
+	       "\n"
+	       "TagType\n"
+	       "tag_name_parse(const char *name) noexcept\n"
+	       "{\n"
+	       "  assert(name != nullptr);\n"
 	       "\n"
-	       "  return TAG_NUM_OF_ITEM_TYPES;\n"
-	       "}\n");
+	       "  return tag_name_parse(std::string_view{name});\n"
+	       "}\n",
+	       unsigned(seed), size);
 
 	return EXIT_SUCCESS;
 }
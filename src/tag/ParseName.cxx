@@ -10,19 +10,6 @@
 
 #include <string.h>
 
-TagType
-tag_name_parse(std::string_view name) noexcept
-{
-	for (unsigned i = 0; i < TAG_NUM_OF_ITEM_TYPES; ++i) {
-		assert(tag_item_names[i] != nullptr);
-
-		if (name == tag_item_names[i])
-			return (TagType)i;
-	}
-
-	return TAG_NUM_OF_ITEM_TYPES;
-}
-
 TagType
 tag_name_parse_i(const char *name) noexcept
 {
@@ -3,40 +3,51 @@
 
 #include "Pool.hxx"
 #include "Item.hxx"
+#include "thread/Mutex.hxx"
 #include "util/Cast.hxx"
-#include "util/djb_hash.hxx"
-#include "util/IntrusiveHashSet.hxx"
-#include "util/SpanCast.hxx"
 #include "util/VarSize.hxx"
 
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <cstdint>
+#include <functional>
 #include <limits>
-
-Mutex tag_pool_lock;
-
-struct TagPoolKey {
-	std::string_view value;
-	TagType type;
-
-	friend constexpr auto operator<=>(const TagPoolKey &,
-					  const TagPoolKey &) noexcept = default;
-
-	struct Hash {
-		[[gnu::pure]]
-		std::size_t operator()(const TagPoolKey &key) const noexcept {
-			return djb_hash(AsBytes(key.value)) ^ key.type;
-		}
-	};
-};
+#include <memory>
+
+/**
+ * The pool is split into this many shards, each with its own lock
+ * and hash table, so threads adding tags with different values
+ * rarely wait for each other.
+ */
+static constexpr std::size_t N_SHARDS = 64;
+
+[[gnu::pure]]
+static std::size_t
+HashTag(TagType type, std::string_view value) noexcept
+{
+	/* std::hash consumes a word at a time, which is a lot
+	   faster than djb_hash() for longer values */
+	return std::hash<std::string_view>{}(value) ^ type;
+}
 
 struct TagPoolItem {
-	IntrusiveHashSetHook<IntrusiveHookMode::NORMAL> hash_set_hook;
-	uint8_t ref = 1;
+	/**
+	 * The next item in the same hash bucket.
+	 */
+	TagPoolItem *next = nullptr;
+
+	/**
+	 * The reference counter.  It is modified without holding the
+	 * shard lock, except when it drops to zero; an item whose
+	 * counter is zero is about to be deleted and must not be
+	 * referenced again.
+	 */
+	std::atomic<uint8_t> ref = 1;
+
 	TagItem item;
 
-	static constexpr unsigned MAX_REF = std::numeric_limits<decltype(ref)>::max();
+	static constexpr unsigned MAX_REF = std::numeric_limits<uint8_t>::max();
 
 	TagPoolItem(TagType type,
 		    std::string_view value) noexcept {
@@ -47,23 +58,31 @@ struct TagPoolItem {
 	static TagPoolItem *Create(TagType type,
 				   std::string_view value) noexcept;
 
-	struct GetKey {
-		[[gnu::pure]]
-		constexpr TagPoolKey operator()(const TagItem &i) const noexcept {
-			return { i.value, i.type };
-		}
+	[[gnu::pure]]
+	std::size_t GetHash() const noexcept {
+		return HashTag(item.type, item.value);
+	}
 
-		[[gnu::pure]]
-		constexpr TagPoolKey operator()(const TagPoolItem &i) const noexcept {
-			return operator()(i.item);
-		}
-	};
+	[[gnu::pure]]
+	bool Equals(TagType type, std::string_view value) const noexcept {
+		return item.type == type && value == item.value;
+	}
 
-	struct CanIncrementRef {
-		constexpr bool operator()(const TagPoolItem &i) const noexcept {
-			return i.ref < MAX_REF;
-		}
-	};
+	/**
+	 * Obtain another reference unless the counter is already at
+	 * #MAX_REF or at zero.
+	 *
+	 * @return true on success
+	 */
+	bool TryRef() noexcept {
+		uint8_t old = ref.load(std::memory_order_relaxed);
+		do {
+			if (old == 0 || old == MAX_REF)
+				return false;
+		} while (!ref.compare_exchange_weak(old, old + 1,
+						    std::memory_order_relaxed));
+		return true;
+	}
 };
 
 TagPoolItem *
@@ -77,12 +96,102 @@ TagPoolItem::Create(TagType type,
 				       value);
 }
 
-static IntrusiveHashSet<TagPoolItem, 16384,
-	IntrusiveHashSetOperators<TagPoolItem, TagPoolItem::GetKey,
-				  TagPoolKey::Hash,
-				  std::equal_to<TagPoolKey>>,
-	IntrusiveHashSetMemberHookTraits<&TagPoolItem::hash_set_hook>,
-	IntrusiveHashSetOptions{.zero_initialized = true}> tag_pool;
+/**
+ * One shard of the tag pool: a chained hash table which starts
+ * small and doubles its size whenever it has more items than
+ * buckets.
+ */
+class alignas(64) TagPoolShard {
+	static constexpr std::size_t INITIAL_BUCKETS = 64;
+
+	Mutex mutex;
+
+	/**
+	 * An array of #n_buckets singly linked lists; #n_buckets is
+	 * zero or a power of two.
+	 */
+	std::unique_ptr<TagPoolItem *[]> buckets;
+
+	std::size_t n_buckets = 0, n_items = 0;
+
+public:
+	/**
+	 * Obtain a reference to an existing item or create a new
+	 * one.
+	 */
+	TagItem *Get(std::size_t hash,
+		     TagType type, std::string_view value) noexcept {
+		const std::scoped_lock protect{mutex};
+
+		if (n_buckets > 0)
+			for (auto *i = buckets[GetBucket(hash, n_buckets)];
+			     i != nullptr; i = i->next)
+				if (i->Equals(type, value) && i->TryRef())
+					return &i->item;
+
+		if (n_items >= n_buckets)
+			Grow();
+
+		auto *pool_item = TagPoolItem::Create(type, value);
+		auto &bucket = buckets[GetBucket(hash, n_buckets)];
+		pool_item->next = bucket;
+		bucket = pool_item;
+		++n_items;
+		return &pool_item->item;
+	}
+
+	/**
+	 * Remove an item whose reference counter has dropped to zero
+	 * and delete it.
+	 */
+	void Delete(std::size_t hash, TagPoolItem &pool_item) noexcept {
+		assert(pool_item.ref == 0);
+
+		{
+			const std::scoped_lock protect{mutex};
+
+			TagPoolItem **p = &buckets[GetBucket(hash, n_buckets)];
+			while (*p != &pool_item) {
+				assert(*p != nullptr);
+				p = &(*p)->next;
+			}
+
+			*p = pool_item.next;
+			--n_items;
+		}
+
+		DeleteVarSize(&pool_item);
+	}
+
+private:
+	static constexpr std::size_t GetBucket(std::size_t hash,
+					       std::size_t size) noexcept {
+		/* the lower bits have selected the shard already */
+		return hash / N_SHARDS & (size - 1);
+	}
+
+	void Grow() noexcept {
+		const std::size_t new_size = n_buckets > 0
+			? n_buckets * 2
+			: INITIAL_BUCKETS;
+		auto new_buckets = std::make_unique<TagPoolItem *[]>(new_size);
+
+		for (std::size_t b = 0; b < n_buckets; ++b) {
+			for (auto *i = buckets[b]; i != nullptr;) {
+				auto *next = i->next;
+				auto &bucket = new_buckets[GetBucket(i->GetHash(), new_size)];
+				i->next = bucket;
+				bucket = i;
+				i = next;
+			}
+		}
+
+		buckets = std::move(new_buckets);
+		n_buckets = new_size;
+	}
+};
+
+static constinit std::array<TagPoolShard, N_SHARDS> tag_pool;
 
 static constexpr TagPoolItem *
 TagItemToPoolItem(TagItem *item) noexcept
@@ -93,18 +202,8 @@ TagItemToPoolItem(TagItem *item) noexcept
 TagItem *
 tag_pool_get_item(TagType type, std::string_view value) noexcept
 {
-	const auto [position, inserted] =
-		tag_pool.insert_check_if(TagPoolKey{value, type},
-					 TagPoolItem::CanIncrementRef{});
-
-	if (inserted) {
-		auto *pool_item = TagPoolItem::Create(type, value);
-		tag_pool.insert_commit(position, *pool_item);
-		return &pool_item->item;
-	} else {
-		++position->ref;
-		return &position->item;
-	}
+	const std::size_t hash = HashTag(type, value);
+	return tag_pool[hash % N_SHARDS].Get(hash, type, value);
 }
 
 TagItem *
@@ -114,8 +213,7 @@ tag_pool_dup_item(TagItem *item) noexcept
 
 	assert(pool_item->ref > 0);
 
-	if (pool_item->ref < TagPoolItem::MAX_REF) {
-		++pool_item->ref;
+	if (pool_item->TryRef()) {
 		return item;
 	} else {
 		/* the reference counter overflows above MAX_REF;
@@ -130,11 +228,12 @@ tag_pool_put_item(TagItem *item) noexcept
 {
 	TagPoolItem *const pool_item = TagItemToPoolItem(item);
 	assert(pool_item->ref > 0);
-	--pool_item->ref;
 
-	if (pool_item->ref > 0)
+	if (pool_item->ref.fetch_sub(1, std::memory_order_acq_rel) > 1)
 		return;
 
-	tag_pool.erase(tag_pool.iterator_to(*pool_item));
-	DeleteVarSize(pool_item);
+	/* this was the last reference; nobody can obtain a new one
+	   because TryRef() refuses zero */
+	const std::size_t hash = pool_item->GetHash();
+	tag_pool[hash % N_SHARDS].Delete(hash, *pool_item);
 }
@@ -4,17 +4,20 @@
 #ifndef MPD_TAG_POOL_HXX
 #define MPD_TAG_POOL_HXX
 
-#include "thread/Mutex.hxx"
-
 #include <cstdint>
 #include <string_view>
 
 enum TagType : uint8_t;
 
-extern Mutex tag_pool_lock;
-
 struct TagItem;
 
+/*
+ * The tag pool shares one #TagItem among all tags with the same
+ * type and value.  All functions are thread-safe; references are
+ * counted without a lock, and only looking up a value and deleting
+ * its last reference lock one shard of the pool.
+ */
+
 [[nodiscard]]
 TagItem *
 tag_pool_get_item(TagType type, std::string_view value) noexcept;
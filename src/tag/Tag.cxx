@@ -23,27 +23,24 @@ Tag::Clear() noexcept
 	has_playlist = false;
 
 	if (num_items > 0) {
-		assert(items != nullptr);
-		const std::scoped_lock protect{tag_pool_lock};
+		TagItem *const*const p = GetItems();
+		assert(p != nullptr);
 		for (unsigned i = 0; i < num_items; ++i)
-			tag_pool_put_item(items[i]);
-		num_items = 0;
+			tag_pool_put_item(p[i]);
 	}
 
-	delete[] items;
-	items = nullptr;
+	FreeItems();
 }
 
 Tag::Tag(const Tag &other) noexcept
-	:duration(other.duration), has_playlist(other.has_playlist),
-	 num_items(other.num_items)
+	:duration(other.duration), has_playlist(other.has_playlist)
 {
-	if (num_items > 0) {
-		items = new TagItem *[num_items];
+	if (other.num_items > 0) {
+		TagItem **const p = AllocItems(other.num_items);
+		TagItem *const*const src = other.GetItems();
 
-		const std::scoped_lock protect{tag_pool_lock};
 		for (unsigned i = 0; i < num_items; i++)
-			items[i] = tag_pool_dup_item(other.items[i]);
+			p[i] = tag_pool_dup_item(src[i]);
 	}
 }
 
@@ -32,8 +32,18 @@ struct Tag {
 	/** the total number of tag items in the #items array */
 	unsigned short num_items = 0;
 
-	/** an array of tag items */
-	TagItem **items = nullptr;
+	/**
+	 * The tag items; use GetItems() to access them.  A single
+	 * item is stored inline, which saves an allocation for tags
+	 * with just a title or the like.
+	 */
+	union {
+		/** a separately allocated array, unless #num_items is 1 */
+		TagItem **array;
+
+		/** the only item if #num_items is 1 */
+		TagItem *single;
+	} items{nullptr};
 
 	/**
 	 * Create an empty tag.
@@ -45,7 +55,7 @@ struct Tag {
 	Tag(Tag &&other) noexcept
 		:duration(other.duration), has_playlist(other.has_playlist),
 		 num_items(other.num_items), items(other.items) {
-		other.items = nullptr;
+		other.items.array = nullptr;
 		other.num_items = 0;
 	}
 
@@ -76,6 +86,40 @@ struct Tag {
 		std::swap(num_items, other.num_items);
 	}
 
+	/**
+	 * Returns the array of #num_items tag item pointers.
+	 */
+	TagItem *const*GetItems() const noexcept {
+		return num_items == 1 ? &items.single : items.array;
+	}
+
+	TagItem **GetItems() noexcept {
+		return num_items == 1 ? &items.single : items.array;
+	}
+
+	/**
+	 * Set the number of items and allocate the array if needed.
+	 * There must not be any items yet.  The caller fills the
+	 * returned array with item references.
+	 */
+	TagItem **AllocItems(unsigned short n) noexcept {
+		num_items = n;
+		if (n > 1)
+			items.array = new TagItem *[n];
+		return GetItems();
+	}
+
+	/**
+	 * Free the item array without releasing the item references,
+	 * e.g. after they have been moved to a #TagBuilder.
+	 */
+	void FreeItems() noexcept {
+		if (num_items != 1)
+			delete[] items.array;
+		items.array = nullptr;
+		num_items = 0;
+	}
+
 	/**
 	 * Returns true if the tag contains no items.  This ignores
 	 * the "duration" attribute.
@@ -153,11 +197,11 @@ struct Tag {
 						   const TagItem>;
 
 	const_iterator begin() const noexcept {
-		return const_iterator{items};
+		return const_iterator{GetItems()};
 	}
 
 	const_iterator end() const noexcept {
-		return const_iterator{items + num_items};
+		return const_iterator{GetItems() + num_items};
 	}
 };
 
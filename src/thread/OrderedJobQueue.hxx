@@ -0,0 +1,101 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#ifndef MPD_THREAD_ORDERED_JOB_QUEUE_HXX
+#define MPD_THREAD_ORDERED_JOB_QUEUE_HXX
+
+#include "WorkerPool.hxx"
+
+#include <cassert>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+
+/**
+ * Jobs which run concurrently in a #WorkerPool, but whose results are
+ * consumed in the order they were submitted.  The caller limits the
+ * number of jobs in flight (and thus the memory used by their
+ * buffers) by calling Pop() whenever IsFull() returns true.
+ *
+ * The #T type must derive from #WorkerPool::Job and catch all errors
+ * in its Run() method, storing them in an attribute
+ * "std::exception_ptr error".
+ */
+template<typename T>
+class OrderedJobQueue {
+	WorkerPool &pool;
+
+	const std::size_t max_jobs;
+
+	std::deque<std::unique_ptr<T>> jobs;
+
+public:
+	/**
+	 * @param _max_jobs the number of jobs in flight which makes
+	 * IsFull() return true
+	 */
+	OrderedJobQueue(WorkerPool &_pool, std::size_t _max_jobs) noexcept
+		:pool(_pool), max_jobs(_max_jobs) {
+		assert(max_jobs > 0);
+	}
+
+	/**
+	 * Waits for all jobs which are still in flight, because
+	 * they must not be freed while the pool may still run them.
+	 */
+	~OrderedJobQueue() noexcept {
+		for (auto &job : jobs)
+			pool.Wait(*job);
+	}
+
+	OrderedJobQueue(const OrderedJobQueue &) = delete;
+	OrderedJobQueue &operator=(const OrderedJobQueue &) = delete;
+
+	bool IsEmpty() const noexcept {
+		return jobs.empty();
+	}
+
+	bool IsFull() const noexcept {
+		return jobs.size() >= max_jobs;
+	}
+
+	/**
+	 * Returns the job which was submitted last.  The caller may
+	 * modify attributes which its Run() method does not use.
+	 */
+	T &GetNewest() noexcept {
+		assert(!IsEmpty());
+
+		return *jobs.back();
+	}
+
+	/**
+	 * Submit a job to the #WorkerPool.
+	 */
+	T &Push(std::unique_ptr<T> &&job) noexcept {
+		auto &result = *jobs.emplace_back(std::move(job));
+		pool.Push(result);
+		return result;
+	}
+
+	/**
+	 * Wait for the oldest job and return it.
+	 *
+	 * Throws the error of the job.
+	 */
+	std::unique_ptr<T> Pop() {
+		assert(!IsEmpty());
+
+		auto job = std::move(jobs.front());
+		jobs.pop_front();
+
+		pool.Wait(*job);
+		if (job->error)
+			std::rethrow_exception(job->error);
+
+		return job;
+	}
+};
+
+#endif
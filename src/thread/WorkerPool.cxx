@@ -0,0 +1,104 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#include "WorkerPool.hxx"
+#include "Name.hxx"
+
+#include <cassert>
+
+WorkerPool::WorkerPool(unsigned n_threads, const char *_name)
+	:name(_name)
+{
+	try {
+		for (unsigned i = 0; i < n_threads; ++i)
+			threads.emplace_back(BIND_THIS_METHOD(Run)).Start();
+	} catch (...) {
+		StopThreads();
+		throw;
+	}
+}
+
+WorkerPool::~WorkerPool() noexcept
+{
+	StopThreads();
+}
+
+void
+WorkerPool::StopThreads() noexcept
+{
+	{
+		const std::scoped_lock lock{mutex};
+		quit = true;
+		queue.clear();
+	}
+
+	cond.notify_all();
+
+	for (auto &i : threads)
+		if (i.IsDefined())
+			i.Join();
+
+	threads.clear();
+}
+
+void
+WorkerPool::Push(Job &job) noexcept
+{
+	std::unique_lock lock{mutex};
+	assert(!quit);
+
+	job.finished = false;
+
+	if (threads.empty()) {
+		RunJob(lock, job);
+		return;
+	}
+
+	queue.push_back(job);
+	lock.unlock();
+
+	cond.notify_one();
+}
+
+inline void
+WorkerPool::RunJob(std::unique_lock<Mutex> &lock, Job &job) noexcept
+{
+	lock.unlock();
+	job.Run();
+	lock.lock();
+
+	job.finished = true;
+	finished_cond.notify_all();
+}
+
+void
+WorkerPool::Wait(Job &job) noexcept
+{
+	std::unique_lock lock{mutex};
+
+	while (!job.finished) {
+		if (!queue.empty()) {
+			RunJob(lock, queue.pop_front());
+			continue;
+		}
+
+		finished_cond.wait(lock);
+	}
+}
+
+void
+WorkerPool::Run() noexcept
+{
+	SetThreadName(name);
+
+	std::unique_lock lock{mutex};
+
+	while (!quit) {
+		if (queue.empty()) {
+			cond.wait(lock);
+			continue;
+		}
+
+		RunJob(lock, queue.pop_front());
+	}
+}
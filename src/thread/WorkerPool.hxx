@@ -0,0 +1,118 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#ifndef MPD_THREAD_WORKER_POOL_HXX
+#define MPD_THREAD_WORKER_POOL_HXX
+
+#include "Mutex.hxx"
+#include "Cond.hxx"
+#include "Thread.hxx"
+#include "util/IntrusiveList.hxx"
+
+#include <list>
+
+/**
+ * A fixed number of threads which run #Job instances submitted by
+ * other threads.  The pool does not own the #Job objects; the caller
+ * must keep them alive until they have finished.
+ *
+ * A pool without threads runs each #Job synchronously inside Push().
+ */
+class WorkerPool final {
+public:
+	class Job : public IntrusiveListHook<> {
+		friend class WorkerPool;
+
+		/**
+		 * Protected by WorkerPool::mutex.
+		 */
+		bool finished = false;
+
+	public:
+		Job() = default;
+		Job(const Job &) = delete;
+		Job &operator=(const Job &) = delete;
+
+		/**
+		 * Called in a worker thread (or in a thread calling
+		 * WorkerPool::Wait()).
+		 */
+		virtual void Run() noexcept = 0;
+
+	protected:
+		~Job() noexcept = default;
+	};
+
+private:
+	const char *const name;
+
+	Mutex mutex;
+
+	/**
+	 * Signalled when a #Job is pushed or when the pool shall
+	 * quit.
+	 */
+	Cond cond;
+
+	/**
+	 * Signalled when a #Job has finished.
+	 */
+	Cond finished_cond;
+
+	IntrusiveList<Job> queue;
+
+	std::list<Thread> threads;
+
+	bool quit = false;
+
+public:
+	/**
+	 * Throws on error.
+	 *
+	 * @param n_threads the number of worker threads; 0 means run
+	 * all jobs synchronously
+	 * @param _name the name of the worker threads
+	 */
+	WorkerPool(unsigned n_threads, const char *_name);
+
+	/**
+	 * Stops all threads.  Jobs which have not been started yet
+	 * are discarded.
+	 */
+	~WorkerPool() noexcept;
+
+	WorkerPool(const WorkerPool &) = delete;
+	WorkerPool &operator=(const WorkerPool &) = delete;
+
+	unsigned GetThreadCount() const noexcept {
+		return threads.size();
+	}
+
+	/**
+	 * Submit a #Job.  It will be run by the next idle worker
+	 * thread.
+	 */
+	void Push(Job &job) noexcept;
+
+	bool IsFinished(const Job &job) noexcept {
+		const std::scoped_lock lock{mutex};
+		return job.finished;
+	}
+
+	/**
+	 * Wait until the given #Job has finished.  While waiting,
+	 * the calling thread helps by running queued jobs, which
+	 * allows jobs to submit and wait for other jobs.
+	 */
+	void Wait(Job &job) noexcept;
+
+private:
+	void StopThreads() noexcept;
+
+	void RunJob(std::unique_lock<Mutex> &lock, Job &job) noexcept;
+
+	/* the worker thread */
+	void Run() noexcept;
+};
+
+#endif
@@ -5,8 +5,12 @@
 
 #include "StaticVector.hxx"
 
-#include <algorithm> // for std::find_if()
+#include <algorithm> // for std::find_if(), std::stable_sort()
 #include <concepts>
+#include <functional> // for std::invoke()
+#include <type_traits> // for std::invoke_result_t
+#include <utility> // for std::pair
+#include <vector>
 
 /**
  * Move all items from #src to #dest, keeping both sorted.
@@ -93,3 +97,32 @@ SortList(List &list,
 
 	swap(list, array.back());
 }
+
+/**
+ * Like SortList(), but obtain a key from each item once, and sort by
+ * comparing those keys with operator<.  This is faster than
+ * SortList() if comparing items is expensive, e.g. with locale
+ * collation.  The sort is stable, just like SortList().
+ */
+template<typename List, typename F>
+void
+SortListByKey(List &list, F &&get_key) noexcept
+{
+	using Key = std::invoke_result_t<F &, typename List::const_reference>;
+
+	if (list.empty() || std::next(list.begin()) == list.end())
+		return;
+
+	std::vector<std::pair<Key, typename List::pointer>> items;
+	for (auto &i : list)
+		items.emplace_back(std::invoke(get_key, std::as_const(i)), &i);
+
+	std::stable_sort(items.begin(), items.end(),
+			 [](const auto &a, const auto &b){
+				 return a.first < b.first;
+			 });
+
+	list.clear();
+	for (auto &i : items)
+		list.push_back(*i.second);
+}
@@ -0,0 +1,151 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+/*
+ * Generates a text database with many songs in memory and measures
+ * how long it takes to load it, in this thread and with a
+ * #WorkerPool.  Both results are saved again and compared.
+ */
+
+#include "config.h"
+#include "db/plugins/simple/DatabaseSave.hxx"
+#include "db/plugins/simple/Directory.hxx"
+#include "io/BufferedOutputStream.hxx"
+#include "io/MemoryLineReader.hxx"
+#include "io/StringOutputStream.hxx"
+#include "thread/WorkerPool.hxx"
+#include "util/PrintException.hxx"
+
+#include <fmt/format.h>
+
+#include <chrono>
+#include <iterator>
+#include <string>
+#include <thread>
+
+#include <stdlib.h>
+
+static constexpr unsigned SONGS_PER_ALBUM = 12;
+static constexpr unsigned ALBUMS_PER_ARTIST = 10;
+
+static std::string
+SaveDatabase(const Directory &root)
+{
+	StringOutputStream sos;
+	BufferedOutputStream bos{sos};
+	db_save_internal(bos, root);
+	bos.Flush();
+	return std::move(sos).GetValue();
+}
+
+/**
+ * Generate a database with the given number of songs: one
+ * top-level directory per artist with #ALBUMS_PER_ARTIST albums of
+ * #SONGS_PER_ALBUM songs each.
+ */
+static std::string
+GenerateDatabase(unsigned n_songs)
+{
+	/* the header of an empty database */
+	const Directory empty{{}, nullptr};
+	std::string db = SaveDatabase(empty);
+
+	auto out = std::back_inserter(db);
+
+	unsigned song = 0;
+	for (unsigned artist = 0; song < n_songs; ++artist) {
+		fmt::format_to(out,
+			       "directory: Artist {0}\n"
+			       "mtime: 1700000000\n"
+			       "begin: Artist {0}\n",
+			       artist);
+
+		for (unsigned album = 0;
+		     album < ALBUMS_PER_ARTIST && song < n_songs; ++album) {
+			fmt::format_to(out,
+				       "directory: Album {1}\n"
+				       "mtime: 1700000000\n"
+				       "begin: Artist {0}/Album {1}\n",
+				       artist, album);
+
+			for (unsigned track = 1;
+			     track <= SONGS_PER_ALBUM && song < n_songs;
+			     ++track, ++song)
+				fmt::format_to(out,
+					       "song_begin: {2:02} - Title {3}.flac\n"
+					       "Time: 241.500\n"
+					       "Artist: Artist {0}\n"
+					       "Album: Album {1}\n"
+					       "Title: Title {3}\n"
+					       "Track: {2}\n"
+					       "Date: {4}\n"
+					       "Genre: Genre {5}\n"
+					       "Format: 44100:16:2\n"
+					       "mtime: 1700000000\n"
+					       "song_end\n",
+					       artist, album, track, song,
+					       1960 + album, artist % 32);
+
+			fmt::format_to(out, "end: Artist {}/Album {}\n",
+				       artist, album);
+		}
+
+		fmt::format_to(out, "end: Artist {}\n", artist);
+	}
+
+	return db;
+}
+
+/**
+ * Load the database into the given #Directory and return the
+ * duration in seconds.
+ */
+static double
+Load(std::string db, Directory &root, WorkerPool *pool)
+{
+	const auto start = std::chrono::steady_clock::now();
+
+	MemoryLineReader reader{db};
+	db_load_internal(reader, root, true, pool);
+
+	return std::chrono::duration<double>(std::chrono::steady_clock::now()
+					     - start).count();
+}
+
+int
+main(int argc, char **argv)
+try {
+	if (argc > 3) {
+		fprintf(stderr, "Usage: BenchmarkLoadDatabase [SONGS [THREADS]]\n");
+		return EXIT_FAILURE;
+	}
+
+	const unsigned n_songs = argc > 1
+		? strtoul(argv[1], nullptr, 10)
+		: 1000000;
+	const unsigned n_threads = argc > 2
+		? strtoul(argv[2], nullptr, 10)
+		: std::thread::hardware_concurrency();
+
+	const std::string db = GenerateDatabase(n_songs);
+	fmt::print("generated {} songs, {} MB\n",
+		   n_songs, db.size() / (1024 * 1024));
+
+	Directory serial{{}, nullptr};
+	fmt::print("serial: {:.3f}s\n", Load(db, serial, nullptr));
+
+	WorkerPool pool{n_threads, "load"};
+	Directory parallel{{}, nullptr};
+	fmt::print("{} threads: {:.3f}s\n",
+		   n_threads, Load(db, parallel, &pool));
+
+	if (SaveDatabase(parallel) != SaveDatabase(serial)) {
+		fprintf(stderr, "Parallel load differs\n");
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+} catch (...) {
+	PrintException(std::current_exception());
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,148 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+/*
+ * Builds a database tree with many songs in memory and reports how
+ * many heap bytes it occupies per song, including the directories
+ * and the tag pool.
+ */
+
+#include "db/plugins/simple/Directory.hxx"
+#include "db/plugins/simple/Song.hxx"
+#include "db/DatabaseLock.hxx"
+#include "tag/Builder.hxx"
+#include "util/PrintException.hxx"
+
+#include <fmt/format.h>
+
+#include <malloc.h>
+#include <stdlib.h>
+
+static constexpr unsigned SONGS_PER_ALBUM = 12;
+static constexpr unsigned ALBUMS_PER_ARTIST = 10;
+
+/**
+ * Every n-th album is a single file with a CUE sheet, i.e. a
+ * virtual directory of songs which point to the file.
+ */
+static constexpr unsigned CUE_ALBUM_INTERVAL = 8;
+
+static std::size_t
+GetHeapSize() noexcept
+{
+	const auto info = mallinfo2();
+	return info.uordblks + info.hblkhd;
+}
+
+static void
+SetTag(Song &song, unsigned artist, unsigned album, unsigned track,
+       unsigned n)
+{
+	TagBuilder tag;
+	tag.SetDuration(SignedSongTime::FromMS(241500));
+	tag.AddItem(TAG_ARTIST, fmt::format("Artist {}", artist));
+	tag.AddItem(TAG_ALBUM, fmt::format("Album {}", album));
+	tag.AddItem(TAG_TITLE, fmt::format("Title {}", n));
+	tag.AddItem(TAG_TRACK, fmt::format("{}", track));
+	tag.AddItem(TAG_DATE, fmt::format("{}", 1960 + album));
+	tag.AddItem(TAG_GENRE, fmt::format("Genre {}", artist % 32));
+	tag.Commit(song.tag);
+}
+
+static void
+AddAlbum(Directory &directory, unsigned artist, unsigned album,
+	 unsigned n_songs, unsigned &n)
+{
+	const auto mtime = std::chrono::system_clock::from_time_t(1700000000);
+
+	if (album % CUE_ALBUM_INTERVAL == CUE_ALBUM_INTERVAL - 1) {
+		const auto name = fmt::format("Album {}.flac", album);
+		auto file = std::make_unique<Song>(name, directory);
+		file->mtime = mtime;
+		file->audio_format = AudioFormat(44100, SampleFormat::S16, 2);
+		directory.AddSong(std::move(file));
+
+		auto &cue = *directory.CreateChild(fmt::format("Album {}.cue", album));
+		cue.device = DEVICE_PLAYLIST;
+		cue.mtime = mtime;
+
+		for (unsigned track = 1; track <= n_songs; ++track, ++n) {
+			auto song = std::make_unique<Song>(fmt::format("track{:04}", track),
+							   cue);
+			song->target = "../" + name;
+			song->start_time = SongTime::FromS((track - 1) * 240);
+			song->end_time = SongTime::FromS(track * 240);
+			SetTag(*song, artist, album, track, n);
+			cue.AddSong(std::move(song));
+		}
+
+		return;
+	}
+
+	for (unsigned track = 1; track <= n_songs; ++track, ++n) {
+		auto song = std::make_unique<Song>(fmt::format("{:02} - Title {}.flac",
+							       track, n),
+						   directory);
+		song->mtime = mtime;
+		song->added = mtime;
+		song->audio_format = AudioFormat(44100, SampleFormat::S16, 2);
+		SetTag(*song, artist, album, track, n);
+		directory.AddSong(std::move(song));
+	}
+}
+
+/**
+ * Fill the root directory with the given number of songs: one
+ * top-level directory per artist with #ALBUMS_PER_ARTIST albums of
+ * #SONGS_PER_ALBUM songs each.
+ */
+static void
+Populate(Directory &root, unsigned n_songs)
+{
+	unsigned n = 0;
+	for (unsigned artist = 0; n < n_songs; ++artist) {
+		auto &artist_directory =
+			*root.CreateChild(fmt::format("Artist {}", artist));
+
+		for (unsigned album = 0;
+		     album < ALBUMS_PER_ARTIST && n < n_songs; ++album) {
+			auto &album_directory =
+				*artist_directory.CreateChild(fmt::format("Album {}", album));
+			AddAlbum(album_directory, artist, album,
+				 std::min(SONGS_PER_ALBUM, n_songs - n), n);
+		}
+	}
+}
+
+int
+main(int argc, char **argv)
+try {
+	if (argc > 2) {
+		fprintf(stderr, "Usage: BenchmarkSongMemory [SONGS]\n");
+		return EXIT_FAILURE;
+	}
+
+	const unsigned n_songs = argc > 1
+		? strtoul(argv[1], nullptr, 10)
+		: 1000000;
+
+	fmt::print("sizeof(Song)={} sizeof(Directory)={} sizeof(Tag)={}\n",
+		   sizeof(Song), sizeof(Directory), sizeof(Tag));
+
+	const ScopeDatabaseLock protect;
+
+	const std::size_t before = GetHeapSize();
+	auto *root = Directory::NewRoot();
+	Populate(*root, n_songs);
+	const std::size_t after = GetHeapSize();
+
+	fmt::print("{} songs: {} MB, {} bytes per song\n",
+		   n_songs, (after - before) / (1024 * 1024),
+		   (after - before) / std::max(n_songs, 1U));
+
+	delete root;
+	return EXIT_SUCCESS;
+} catch (...) {
+	PrintException(std::current_exception());
+	return EXIT_FAILURE;
+}
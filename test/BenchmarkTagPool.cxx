@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+/*
+ * Measures the throughput of the tag pool when several threads
+ * build tags at the same time, like the tag worker pool of the
+ * update walk does.
+ */
+
+#include "tag/Builder.hxx"
+#include "tag/Tag.hxx"
+#include "util/PrintException.hxx"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdlib.h>
+
+static constexpr unsigned SONGS_PER_THREAD = 200000;
+
+/**
+ * Build the tags of #SONGS_PER_THREAD songs and then discard them.
+ * Artist, album and genre repeat (and are shared by all threads);
+ * titles are distinct, so the pool grows by one value per song.
+ */
+static void
+Run(unsigned thread) noexcept
+{
+	std::vector<Tag> tags;
+	tags.reserve(SONGS_PER_THREAD);
+
+	for (unsigned n = 0; n < SONGS_PER_THREAD; ++n) {
+		TagBuilder builder;
+		builder.AddItem(TAG_ARTIST, fmt::format("Artist {}", n / 120));
+		builder.AddItem(TAG_ALBUM, fmt::format("Album {}", n / 12));
+		builder.AddItem(TAG_TITLE, fmt::format("Title {} {}", thread, n));
+		builder.AddItem(TAG_TRACK, fmt::format("{}", n % 12 + 1));
+		builder.AddItem(TAG_GENRE, fmt::format("Genre {}", n % 32));
+		tags.emplace_back(builder.Commit());
+	}
+}
+
+int
+main(int argc, char **argv)
+try {
+	if (argc > 2) {
+		fprintf(stderr, "Usage: BenchmarkTagPool [THREADS]\n");
+		return EXIT_FAILURE;
+	}
+
+	const unsigned max_threads = argc > 1
+		? strtoul(argv[1], nullptr, 10)
+		: std::max(std::thread::hardware_concurrency(), 1U);
+
+	for (unsigned n_threads = 1; n_threads <= max_threads; n_threads *= 2) {
+		const auto start = std::chrono::steady_clock::now();
+
+		std::vector<std::thread> threads;
+		for (unsigned i = 0; i < n_threads; ++i)
+			threads.emplace_back(Run, i);
+		for (auto &t : threads)
+			t.join();
+
+		const std::chrono::duration<double> duration =
+			std::chrono::steady_clock::now() - start;
+		const unsigned n_songs = n_threads * SONGS_PER_THREAD;
+		fmt::print("{:3} threads: {:.3f}s, {:.0f} tags/s\n",
+			   n_threads, duration.count(),
+			   n_songs / duration.count());
+	}
+
+	return EXIT_SUCCESS;
+} catch (...) {
+	PrintException(std::current_exception());
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,247 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#include "config.h"
+#include "db/plugins/simple/BinaryDatabase.hxx"
+#include "db/plugins/simple/DatabaseSave.hxx"
+#include "db/plugins/simple/Directory.hxx"
+#include "db/plugins/simple/Song.hxx"
+#include "db/DatabaseLock.hxx"
+#include "db/PlaylistInfo.hxx"
+#include "fs/AllocatedPath.hxx"
+#include "io/BufferedOutputStream.hxx"
+#include "io/FileOutputStream.hxx"
+#include "io/StringOutputStream.hxx"
+#include "tag/Builder.hxx"
+
+#include <fmt/format.h>
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <string_view>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+static void
+AddSong(Directory &directory, std::string_view name, unsigned i)
+{
+	auto song = std::make_unique<Song>(name, directory);
+
+	TagBuilder tag;
+	tag.AddItem(TAG_ARTIST, fmt::format("Artist {}", i % 7));
+	tag.AddItem(TAG_ALBUM, fmt::format("Album {}", i / 3));
+	tag.AddItem(TAG_TITLE, fmt::format("Title {}", i));
+	tag.AddItem(TAG_TRACK, fmt::format("{}", i));
+	tag.SetDuration(SignedSongTime::FromMS(180000 + i));
+	tag.Commit(song->tag);
+
+	song->mtime = std::chrono::system_clock::from_time_t(1700000000 + i);
+	if (i % 5 == 0)
+		song->audio_format = AudioFormat(44100, SampleFormat::S16, 2);
+	if (i % 11 == 0) {
+		song->start_time = SongTime::FromMS(i * 1000);
+		song->end_time = SongTime::FromMS(i * 2000);
+	}
+
+	directory.AddSong(std::move(song));
+}
+
+/**
+ * Fill the directory with a tree of the given width and depth; some
+ * directories are containers or have playlists.
+ */
+static void
+Populate(Directory &directory, unsigned width, unsigned depth,
+	 unsigned &counter)
+{
+	if (depth > 0) {
+		for (unsigned i = 0; i < width; ++i) {
+			auto &child = *directory.CreateChild(fmt::format("dir {}", i));
+			child.mtime = std::chrono::system_clock::from_time_t(1600000000 + ++counter);
+			if (counter % 4 == 0)
+				child.device = DEVICE_CONTAINER;
+
+			Populate(child, width, depth - 1, counter);
+		}
+	}
+
+	for (unsigned i = 0; i < 3; ++i) {
+		++counter;
+		AddSong(directory, fmt::format("{:03} song.flac", counter),
+			counter);
+	}
+
+	if (counter % 3 == 0)
+		directory.playlists.UpdateOrInsert(PlaylistInfo{fmt::format("list {}.m3u", counter)});
+}
+
+/**
+ * A tree with the songs "song-a", "song-b" and the subdirectories
+ * "dir-a", "dir-b", whose names can be patched in the saved file.
+ */
+static void
+PopulateNames(Directory &root)
+{
+	const ScopeDatabaseLock protect;
+	AddSong(root, "song-a", 1);
+	AddSong(root, "song-b", 2);
+	AddSong(*root.CreateChild("dir-a"), "x", 3);
+	AddSong(*root.CreateChild("dir-b"), "y", 4);
+}
+
+static std::string
+SaveText(const Directory &root)
+{
+	StringOutputStream sos;
+	BufferedOutputStream bos{sos};
+	db_save_internal(bos, root);
+	bos.Flush();
+	return std::move(sos).GetValue();
+}
+
+static std::string
+SaveBinary(const Directory &root)
+{
+	StringOutputStream sos;
+	db_save_binary(sos, root);
+	return std::move(sos).GetValue();
+}
+
+static void
+Replace(std::string &data, std::string_view from, std::string_view to)
+{
+	ASSERT_EQ(from.size(), to.size());
+
+	const auto i = data.find(from);
+	ASSERT_NE(i, data.npos);
+	data.replace(i, from.size(), to);
+}
+
+class BinaryDatabaseTest : public ::testing::Test {
+protected:
+	AllocatedPath path = nullptr;
+
+	void SetUp() override {
+		const char *tmpdir = getenv("TMPDIR");
+		path = AllocatedPath::FromFS(fmt::format("{}/TestBinaryDatabase.{}",
+							 tmpdir != nullptr ? tmpdir : "/tmp",
+							 getpid()));
+	}
+
+	void TearDown() override {
+		unlink(path.c_str());
+	}
+
+	void Load(std::string_view data, Directory &root) {
+		{
+			FileOutputStream fos{path};
+			fos.Write(std::as_bytes(std::span{data}));
+			fos.Commit();
+		}
+
+		db_load_binary(path, root, true);
+	}
+
+	void ExpectCorrupted(std::string_view data) {
+		Directory root{{}, nullptr};
+		EXPECT_THROW(Load(data, root), std::runtime_error);
+	}
+};
+
+TEST_F(BinaryDatabaseTest, RoundTrip)
+{
+	Directory root{{}, nullptr};
+
+	{
+		const ScopeDatabaseLock protect;
+		unsigned counter = 0;
+		Populate(root, 4, 3, counter);
+	}
+
+	Directory loaded{{}, nullptr};
+	Load(SaveBinary(root), loaded);
+
+	EXPECT_EQ(SaveText(loaded), SaveText(root));
+}
+
+TEST_F(BinaryDatabaseTest, Empty)
+{
+	Directory root{{}, nullptr};
+
+	Directory loaded{{}, nullptr};
+	Load(SaveBinary(root), loaded);
+
+	EXPECT_TRUE(loaded.IsEmpty());
+}
+
+TEST_F(BinaryDatabaseTest, Truncated)
+{
+	Directory root{{}, nullptr};
+	PopulateNames(root);
+
+	const auto data = SaveBinary(root);
+	for (std::size_t size : {std::size_t{0}, std::size_t{4},
+				 std::size_t{64}, data.size() / 2,
+				 data.size() - 1})
+		ExpectCorrupted(std::string_view{data}.substr(0, size));
+}
+
+TEST_F(BinaryDatabaseTest, Corrupted)
+{
+	Directory root{{}, nullptr};
+	PopulateNames(root);
+
+	const auto data = SaveBinary(root);
+
+	/* bad magic */
+	auto copy = data;
+	copy.front() ^= 0x20;
+	ExpectCorrupted(copy);
+
+	/* the string table (at the end of the file) is not
+	   terminated */
+	copy = data;
+	copy.back() = 'x';
+	ExpectCorrupted(copy);
+
+	/* trailing garbage */
+	copy = data;
+	copy.push_back('\0');
+	ExpectCorrupted(copy);
+}
+
+TEST_F(BinaryDatabaseTest, DuplicateSong)
+{
+	Directory root{{}, nullptr};
+	PopulateNames(root);
+
+	auto data = SaveBinary(root);
+	Replace(data, "song-b", "song-a");
+	ExpectCorrupted(data);
+}
+
+TEST_F(BinaryDatabaseTest, DuplicateDirectory)
+{
+	Directory root{{}, nullptr};
+	PopulateNames(root);
+
+	auto data = SaveBinary(root);
+	Replace(data, "dir-b", "dir-a");
+	ExpectCorrupted(data);
+}
+
+TEST_F(BinaryDatabaseTest, Slash)
+{
+	Directory root{{}, nullptr};
+	PopulateNames(root);
+
+	auto data = SaveBinary(root);
+	Replace(data, "song-b", "song/b");
+	ExpectCorrupted(data);
+
+	data = SaveBinary(root);
+	Replace(data, "dir-b", "dir/b");
+	ExpectCorrupted(data);
+}
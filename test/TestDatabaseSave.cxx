@@ -0,0 +1,175 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#include "config.h"
+#include "db/plugins/simple/DatabaseSave.hxx"
+#include "db/plugins/simple/Directory.hxx"
+#include "db/plugins/simple/Song.hxx"
+#include "db/plugins/simple/SaveFilter.hxx"
+#include "db/DatabaseLock.hxx"
+#include "db/PlaylistInfo.hxx"
+#include "io/BufferedOutputStream.hxx"
+#include "io/StringOutputStream.hxx"
+#include "lib/icu/Init.hxx"
+#include "tag/Builder.hxx"
+#include "thread/WorkerPool.hxx"
+
+#include <fmt/format.h>
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+static void
+AddSong(Directory &directory, unsigned i)
+{
+	auto song = std::make_unique<Song>(fmt::format("{:03} song.flac", i),
+					   directory);
+
+	TagBuilder tag;
+	tag.AddItem(TAG_ARTIST, fmt::format("Artist {}", i % 7));
+	tag.AddItem(TAG_ALBUM, fmt::format("Album {}", i / 3));
+	tag.AddItem(TAG_TITLE, fmt::format("Title {}", i));
+	tag.AddItem(TAG_TRACK, fmt::format("{}", i));
+	tag.SetDuration(SignedSongTime::FromMS(180000 + i));
+	tag.Commit(song->tag);
+
+	song->mtime = std::chrono::system_clock::from_time_t(1700000000 + i);
+	if (i % 5 == 0)
+		song->audio_format = AudioFormat(44100, SampleFormat::S16, 2);
+	if (i % 11 == 0) {
+		song->start_time = SongTime::FromMS(i * 1000);
+		song->end_time = SongTime::FromMS(i * 2000);
+	}
+
+	directory.AddSong(std::move(song));
+}
+
+/**
+ * Fill the directory with a tree of the given width and depth:
+ * each directory has #width subdirectories and a few songs; some of
+ * them are containers or have playlists.
+ */
+static void
+Populate(Directory &directory, unsigned width, unsigned depth,
+	 unsigned &counter)
+{
+	if (depth > 0) {
+		for (unsigned i = 0; i < width; ++i) {
+			auto &child = *directory.CreateChild(fmt::format("dir {}", i));
+			child.mtime = std::chrono::system_clock::from_time_t(1600000000 + ++counter);
+			if (counter % 4 == 0)
+				child.device = DEVICE_CONTAINER;
+
+			Populate(child, width, depth - 1, counter);
+		}
+	}
+
+	for (unsigned i = 0; i < 3; ++i)
+		AddSong(directory, ++counter);
+
+	if (counter % 3 == 0)
+		directory.playlists.UpdateOrInsert(PlaylistInfo{fmt::format("list {}.m3u", counter)});
+}
+
+/**
+ * Omits the songs with an even number and all songs of every other
+ * container, and renames some albums.
+ */
+class TestSaveFilter final : public DatabaseSaveFilter {
+public:
+	bool IncludeSong(const Directory &directory,
+			 const Song &song) const noexcept override {
+		if (directory.device == DEVICE_CONTAINER &&
+		    std::chrono::system_clock::to_time_t(directory.mtime) % 8 == 0)
+			return false;
+
+		return song.filename.c_str()[2] % 2 != 0;
+	}
+
+	std::optional<Tag> TransformTag(const Directory &,
+					const Song &song) const override {
+		if (song.filename.c_str()[2] != '3')
+			return std::nullopt;
+
+		TagBuilder tag{song.tag};
+		tag.RemoveType(TAG_ALBUM);
+		tag.AddItem(TAG_ALBUM, "Renamed");
+		return tag.Commit();
+	}
+};
+
+/**
+ * Save the tree and return the output and the output positions of
+ * all "split" calls.
+ */
+static std::pair<std::string, std::vector<std::size_t>>
+Save(const Directory &root, const DatabaseSaveFilter *filter,
+     WorkerPool *pool)
+{
+	StringOutputStream sos;
+	BufferedOutputStream bos{sos};
+
+	std::vector<std::size_t> splits;
+	db_save_internal(bos, root, filter, [&]{
+		bos.Flush();
+		splits.push_back(sos.GetValue().size());
+	}, pool);
+
+	bos.Flush();
+	return {std::move(sos).GetValue(), std::move(splits)};
+}
+
+static void
+CheckParallelSave(unsigned width, unsigned depth)
+{
+	/* for sorting songs with transformed tags */
+	const ScopeIcuInit icu_init;
+
+	Directory root{{}, nullptr};
+
+	{
+		const ScopeDatabaseLock protect;
+		unsigned counter = 0;
+		Populate(root, width, depth, counter);
+	}
+
+	const TestSaveFilter filter;
+
+	for (const DatabaseSaveFilter *f : {(const DatabaseSaveFilter *)nullptr,
+					    (const DatabaseSaveFilter *)&filter}) {
+		const auto expected = Save(root, f, nullptr);
+		EXPECT_EQ(expected.second.size(), width);
+
+		for (unsigned n_threads : {0, 1, 2, 4, 16}) {
+			WorkerPool pool{n_threads, "save"};
+			const auto actual = Save(root, f, &pool);
+			EXPECT_EQ(actual.first, expected.first);
+			EXPECT_EQ(actual.second, expected.second);
+		}
+	}
+}
+
+TEST(DatabaseSave, Empty)
+{
+	CheckParallelSave(0, 0);
+}
+
+/**
+ * Few top-level directories: the saver descends into them to find
+ * enough parallel jobs.
+ */
+TEST(DatabaseSave, Narrow)
+{
+	CheckParallelSave(2, 6);
+}
+
+/**
+ * Many top-level directories: one job per top-level directory.
+ */
+TEST(DatabaseSave, Wide)
+{
+	CheckParallelSave(40, 2);
+}
@@ -0,0 +1,124 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#include "db/plugins/simple/Directory.hxx"
+#include "db/plugins/simple/Song.hxx"
+#include "db/DatabaseLock.hxx"
+
+#include <fmt/format.h>
+
+#include <gtest/gtest.h>
+
+/**
+ * Enough entries to make FindChild() and FindSong() switch to the
+ * hash index.
+ */
+static constexpr unsigned N = 1000;
+
+static std::string
+SongName(unsigned i)
+{
+	return fmt::format("{:04} song.flac", i);
+}
+
+static std::string
+ChildName(unsigned i)
+{
+	return fmt::format("dir {}", i);
+}
+
+static void
+Populate(Directory &directory)
+{
+	for (unsigned i = 0; i < N; ++i) {
+		directory.AddSong(std::make_unique<Song>(SongName(i), directory));
+		directory.CreateChild(ChildName(i));
+	}
+}
+
+TEST(Directory, FindSmall)
+{
+	const ScopeDatabaseLock protect;
+	Directory root{{}, nullptr};
+
+	auto *child = root.CreateChild("a");
+	root.AddSong(std::make_unique<Song>("b.flac", root));
+
+	EXPECT_EQ(root.FindChild("a"), child);
+	EXPECT_EQ(root.FindChild("b.flac"), nullptr);
+	EXPECT_EQ(root.FindSong("a"), nullptr);
+	ASSERT_NE(root.FindSong("b.flac"), nullptr);
+	EXPECT_EQ(root.FindSong("b.flac")->filename, "b.flac");
+}
+
+TEST(Directory, FindLarge)
+{
+	const ScopeDatabaseLock protect;
+	Directory root{{}, nullptr};
+	Populate(root);
+
+	auto &sub = *root.FindChild(ChildName(N - 1));
+	Populate(sub);
+
+	for (auto *directory : {&root, &sub}) {
+		/* the first lookups scan the lists; the others
+		   use the index */
+		EXPECT_EQ(directory->FindSong("missing"), nullptr);
+		EXPECT_EQ(directory->FindChild("missing"), nullptr);
+
+		for (unsigned i = 0; i < N; ++i) {
+			const auto *song = directory->FindSong(SongName(i));
+			ASSERT_NE(song, nullptr);
+			EXPECT_EQ(song->filename, SongName(i));
+			EXPECT_EQ(&song->parent, directory);
+
+			const auto *child = directory->FindChild(ChildName(i));
+			ASSERT_NE(child, nullptr);
+			EXPECT_EQ(child->GetName(), ChildName(i));
+			EXPECT_EQ(child->parent, directory);
+		}
+	}
+
+	EXPECT_EQ(root.LookupDirectory(fmt::format("{}/{}", ChildName(N - 1),
+						   ChildName(7))).rest, "");
+}
+
+/**
+ * The index follows all modifications after it has been built.
+ */
+TEST(Directory, IndexUpdate)
+{
+	const ScopeDatabaseLock protect;
+	Directory root{{}, nullptr};
+	Populate(root);
+
+	/* build the index */
+	ASSERT_NE(root.FindSong(SongName(N - 1)), nullptr);
+	ASSERT_NE(root.FindChild(ChildName(N - 1)), nullptr);
+
+	/* removal */
+	for (unsigned i = 0; i < N; i += 2) {
+		auto song = root.RemoveSong(root.FindSong(SongName(i)));
+		EXPECT_EQ(song->filename, SongName(i));
+		EXPECT_EQ(root.FindSong(SongName(i)), nullptr);
+
+		root.FindChild(ChildName(i))->Delete();
+	}
+
+	/* empty directories are deleted by PruneEmpty() */
+	auto &keep = *root.FindChild(ChildName(1));
+	keep.AddSong(std::make_unique<Song>("x", keep));
+	root.PruneEmpty();
+
+	/* insertion */
+	root.AddSong(std::make_unique<Song>("new.flac", root));
+	auto *new_child = root.CreateChild("new");
+
+	for (unsigned i = 0; i < N; ++i) {
+		EXPECT_EQ(root.FindSong(SongName(i)) != nullptr, i % 2 != 0);
+		EXPECT_EQ(root.FindChild(ChildName(i)) != nullptr, i == 1);
+	}
+
+	EXPECT_NE(root.FindSong("new.flac"), nullptr);
+	EXPECT_EQ(root.FindChild("new"), new_child);
+}
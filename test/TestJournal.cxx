@@ -0,0 +1,244 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#include "config.h"
+#include "db/update/Journal.hxx"
+#include "db/plugins/simple/Directory.hxx"
+#include "db/plugins/simple/Song.hxx"
+#include "db/DatabaseLock.hxx"
+#include "fs/AllocatedPath.hxx"
+#include "io/FileOutputStream.hxx"
+#include "io/FileReader.hxx"
+#include "util/IterableSplitString.hxx"
+
+#include <fmt/format.h>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+/**
+ * Create the given directory (and its parents) with the given songs,
+ * replacing the old songs.
+ */
+static Directory &
+MakeDirectory(Directory &root, std::string_view uri,
+	      std::initializer_list<std::string_view> songs)
+{
+	Directory *directory = &root;
+	for (const std::string_view name : IterableSplitString(uri, '/'))
+		directory = directory->MakeChild(name);
+
+	directory->ForEachSongSafe([directory](Song &song){
+		directory->RemoveSong(&song);
+	});
+
+	for (const auto name : songs)
+		directory->AddSong(std::make_unique<Song>(name, *directory));
+
+	return *directory;
+}
+
+/**
+ * Returns the sorted song names of a directory, or a single "-" if
+ * the directory does not exist.
+ */
+static std::vector<std::string>
+GetSongs(Directory &root, std::string_view uri)
+{
+	const ScopeDatabaseLock protect;
+
+	const auto lr = root.LookupDirectory(uri);
+	if (!lr.rest.empty())
+		return {"-"};
+
+	const Directory *directory = lr.directory;
+
+	std::vector<std::string> result;
+	for (const auto &song : directory->songs)
+		result.emplace_back(song.filename);
+	std::sort(result.begin(), result.end());
+	return result;
+}
+
+using Names = std::vector<std::string>;
+
+class JournalTest : public ::testing::Test {
+protected:
+	AllocatedPath path = nullptr;
+
+	/**
+	 * The tree which was saved before the interrupted update.
+	 */
+	Directory old_root{{}, nullptr};
+
+	/**
+	 * The tree as seen by the interrupted updates; its
+	 * directories are written to the journal.
+	 */
+	Directory new_root{{}, nullptr};
+
+	void SetUp() override {
+		const char *tmpdir = getenv("TMPDIR");
+		path = AllocatedPath::FromFS(fmt::format("{}/TestJournal.{}",
+							 tmpdir != nullptr ? tmpdir : "/tmp",
+							 getpid()));
+
+		const ScopeDatabaseLock protect;
+		MakeDirectory(old_root, "a", {"a1"});
+		MakeDirectory(old_root, "a/sub", {"s1"});
+		MakeDirectory(old_root, "b", {"b1"});
+		MakeDirectory(old_root, "c", {"c1"});
+		MakeDirectory(old_root, "c/gone", {"g1"});
+		MakeDirectory(old_root, "d", {"d1"});
+	}
+
+	void TearDown() override {
+		unlink(path.c_str());
+	}
+
+	/**
+	 * Write a journal record for each of the given directories
+	 * of #new_root.
+	 */
+	void Write(bool append, std::initializer_list<std::string_view> uris) {
+		UpdateJournal journal{path, append};
+		for (const auto uri : uris) {
+			const ScopeDatabaseLock protect;
+			journal.Add(*new_root.LookupDirectory(uri).directory);
+		}
+		journal.Close();
+	}
+
+	std::string ReadFile() {
+		FileReader reader{path};
+		std::string data;
+		std::byte buffer[4096];
+		std::size_t nbytes;
+		while ((nbytes = reader.Read(buffer)) > 0)
+			data.append(reinterpret_cast<const char *>(buffer),
+				    nbytes);
+		return data;
+	}
+
+	void WriteFile(std::string_view data) {
+		FileOutputStream fos{path};
+		fos.Write(std::as_bytes(std::span{data}));
+		fos.Commit();
+	}
+
+	/**
+	 * Cut the journal off in the middle of the record for the
+	 * given directory.
+	 */
+	void CutRecord(std::string_view uri) {
+		auto data = ReadFile();
+		const auto begin = data.find(fmt::format("checkpoint: {}\n", uri));
+		ASSERT_NE(begin, data.npos);
+		const auto end = data.find(fmt::format("end: {}\n", uri), begin);
+		ASSERT_NE(end, data.npos);
+
+		data.resize(end + 3);
+		WriteFile(data);
+	}
+
+	UpdateJournal::UriSet Load() {
+		const ScopeDatabaseLock protect;
+		return UpdateJournal::Load(path, old_root);
+	}
+};
+
+TEST_F(JournalTest, Missing)
+{
+	EXPECT_TRUE(Load().empty());
+	EXPECT_EQ(GetSongs(old_root, "a"), Names{"a1"});
+}
+
+/**
+ * The last record was cut off by the interruption; it must be
+ * ignored, and the old contents of its directory are kept.
+ */
+TEST_F(JournalTest, TornRecord)
+{
+	{
+		const ScopeDatabaseLock protect;
+		MakeDirectory(new_root, "a/sub", {"s1", "s2"});
+		MakeDirectory(new_root, "a", {"a2"});
+		MakeDirectory(new_root, "b", {"b2", "b3"});
+	}
+
+	Write(false, {"a/sub", "a", "b"});
+	CutRecord("b");
+
+	const auto loaded = Load();
+	EXPECT_EQ(loaded, (UpdateJournal::UriSet{"a", "a/sub"}));
+
+	EXPECT_EQ(GetSongs(old_root, "a"), Names{"a2"});
+	EXPECT_EQ(GetSongs(old_root, "a/sub"), (Names{"s1", "s2"}));
+	EXPECT_EQ(GetSongs(old_root, "b"), Names{"b1"});
+	EXPECT_EQ(GetSongs(old_root, "c"), Names{"c1"});
+	EXPECT_EQ(GetSongs(old_root, "c/gone"), Names{"g1"});
+}
+
+/**
+ * A resumed update appends to the journal after the torn record of
+ * the previous run; its records may repeat directories of the
+ * previous run, and the later record wins.  A subdirectory without
+ * a record before its parent's record is deleted.
+ */
+TEST_F(JournalTest, AppendedRuns)
+{
+	{
+		const ScopeDatabaseLock protect;
+		MakeDirectory(new_root, "a/sub", {"s2"});
+		MakeDirectory(new_root, "a", {"a2"});
+		MakeDirectory(new_root, "b", {"b2"});
+	}
+
+	Write(false, {"a/sub", "a", "b"});
+	CutRecord("b");
+
+	{
+		const ScopeDatabaseLock protect;
+		MakeDirectory(new_root, "a/sub", {"s3"});
+		MakeDirectory(new_root, "c", {"c2"});
+		MakeDirectory(new_root, "new", {"n1"});
+	}
+
+	Write(true, {"a/sub", "c", "new"});
+
+	const auto loaded = Load();
+	EXPECT_EQ(loaded, (UpdateJournal::UriSet{"a", "a/sub", "c", "new"}));
+
+	/* the second record of "a/sub" replaces the first one */
+	EXPECT_EQ(GetSongs(old_root, "a"), Names{"a2"});
+	EXPECT_EQ(GetSongs(old_root, "a/sub"), Names{"s3"});
+
+	/* the torn record was not repeated */
+	EXPECT_EQ(GetSongs(old_root, "b"), Names{"b1"});
+
+	/* "c/gone" has no record, so it does not exist anymore */
+	EXPECT_EQ(GetSongs(old_root, "c"), Names{"c2"});
+	EXPECT_EQ(GetSongs(old_root, "c/gone"), Names{"-"});
+
+	EXPECT_EQ(GetSongs(old_root, "new"), Names{"n1"});
+	EXPECT_EQ(GetSongs(old_root, "d"), Names{"d1"});
+}
+
+/**
+ * A journal of an unknown format is ignored.
+ */
+TEST_F(JournalTest, UnknownFormat)
+{
+	WriteFile("journal: 999\ncheckpoint: a\nbegin: a\nend: a\n");
+
+	EXPECT_TRUE(Load().empty());
+	EXPECT_EQ(GetSongs(old_root, "a"), Names{"a1"});
+}
@@ -2,6 +2,7 @@
 // Copyright The Music Player Daemon Project
 
 #include "lib/zlib/GzipOutputStream.hxx"
+#include "lib/zlib/ParallelGzipOutputStream.hxx"
 #include "io/StdioOutputStream.hxx"
 #include "system/Error.hxx"
 #include "util/PrintException.hxx"
@@ -28,29 +29,38 @@ Copy(OutputStream &dest, int src)
 }
 
 static void
-CopyGzip(OutputStream &_dest, int src)
+CopyGzip(OutputStream &_dest, int src, int level, unsigned n_threads)
 {
-	GzipOutputStream dest(_dest);
-	Copy(dest, src);
-	dest.Finish();
+	if (n_threads > 0) {
+		ParallelGzipOutputStream dest(_dest, level, n_threads);
+		Copy(dest, src);
+		dest.Finish();
+	} else {
+		GzipOutputStream dest(_dest, level);
+		Copy(dest, src);
+		dest.Finish();
+	}
 }
 
 static void
-CopyGzip(FILE *_dest, int src)
+CopyGzip(FILE *_dest, int src, int level, unsigned n_threads)
 {
 	StdioOutputStream dest(_dest);
-	CopyGzip(dest, src);
+	CopyGzip(dest, src, level, n_threads);
 }
 
 int
-main(int argc, [[maybe_unused]] char **argv)
+main(int argc, char **argv)
 try {
-	if (argc != 1) {
-		fprintf(stderr, "Usage: run_gzip\n");
+	if (argc > 3) {
+		fprintf(stderr, "Usage: run_gzip [LEVEL [THREADS]]\n");
 		return EXIT_FAILURE;
 	}
 
-	CopyGzip(stdout, STDIN_FILENO);
+	const int level = argc > 1 ? atoi(argv[1]) : Z_DEFAULT_COMPRESSION;
+	const unsigned n_threads = argc > 2 ? strtoul(argv[2], nullptr, 10) : 0;
+
+	CopyGzip(stdout, STDIN_FILENO, level, n_threads);
 	return EXIT_SUCCESS;
 } catch (...) {
 	PrintException(std::current_exception());
@@ -0,0 +1,90 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright The Music Player Daemon Project
+
+#include "tag/Pool.hxx"
+#include "tag/Item.hxx"
+#include "tag/Type.hxx"
+
+#include <gtest/gtest.h>
+
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::string_view_literals::operator""sv;
+
+TEST(TagPool, Get)
+{
+	TagItem *a = tag_pool_get_item(TAG_ARTIST, "foo"sv);
+	EXPECT_EQ(a->type, TAG_ARTIST);
+	EXPECT_STREQ(a->value, "foo");
+
+	/* equal values share one item */
+	TagItem *b = tag_pool_get_item(TAG_ARTIST, "foo"sv);
+	EXPECT_EQ(a, b);
+	EXPECT_EQ(tag_pool_dup_item(a), a);
+
+	/* ... but not if the type differs */
+	TagItem *c = tag_pool_get_item(TAG_ALBUM, "foo"sv);
+	EXPECT_NE(a, c);
+	EXPECT_EQ(c->type, TAG_ALBUM);
+
+	tag_pool_put_item(a);
+	tag_pool_put_item(a);
+	tag_pool_put_item(b);
+	tag_pool_put_item(c);
+}
+
+TEST(TagPool, RefOverflow)
+{
+	/* more references than one item's counter can hold */
+	std::vector<TagItem *> items;
+	items.push_back(tag_pool_get_item(TAG_TITLE, "overflow"sv));
+	for (unsigned i = 1; i < 1000; ++i)
+		items.push_back(i % 2 == 0
+				? tag_pool_get_item(TAG_TITLE, "overflow"sv)
+				: tag_pool_dup_item(items.back()));
+
+	const std::set<TagItem *> distinct(items.begin(), items.end());
+	EXPECT_GE(distinct.size(), 4U);
+
+	for (TagItem *i : items) {
+		EXPECT_EQ(i->type, TAG_TITLE);
+		EXPECT_STREQ(i->value, "overflow");
+	}
+
+	for (TagItem *i : items)
+		tag_pool_put_item(i);
+}
+
+TEST(TagPool, Concurrent)
+{
+	static constexpr unsigned N_THREADS = 8, N_VALUES = 50;
+
+	std::vector<std::thread> threads;
+	for (unsigned t = 0; t < N_THREADS; ++t) {
+		threads.emplace_back([]{
+			std::vector<TagItem *> items;
+			for (unsigned i = 0; i < 20000; ++i) {
+				const auto value = std::to_string(i % N_VALUES);
+				TagItem *item = tag_pool_get_item(TAG_GENRE, value);
+				ASSERT_STREQ(item->value, value.c_str());
+				items.push_back(tag_pool_dup_item(item));
+				tag_pool_put_item(item);
+
+				if (items.size() >= 700) {
+					for (TagItem *j : items)
+						tag_pool_put_item(j);
+					items.clear();
+				}
+			}
+
+			for (TagItem *j : items)
+				tag_pool_put_item(j);
+		});
+	}
+
+	for (auto &t : threads)
+		t.join();
+}
@@ -27,7 +27,7 @@ CompareTagTitle(const Tag &tag, const std::string &title)
 {
 	EXPECT_EQ(uint16_t(1), tag.num_items);
 
-	const TagItem &item = *tag.items[0];
+	const TagItem &item = *tag.GetItems()[0];
 	EXPECT_EQ(TAG_TITLE, item.type);
 	EXPECT_EQ(title, std::string(item.value));
 }